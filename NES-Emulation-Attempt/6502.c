@@ -1,5 +1,14 @@
 #include "6502.h"
 #include "logger.h"
+#include "breakpoints.h"
+#include "watchpoints.h"
+#include "cpuTrace.h"
+#include "cpuProfile.h"
+#include "ppu.h"
+#include "nes.h"
+#include "cartridge.h"
+#include "cpuJit.h"
+#include "ram.h"
 #include <stdio.h>
 #include <stdint.h>
 
@@ -19,8 +28,10 @@ uint16_t temp = 0x0000; // A convenience variable used everywhere
 uint16_t addr_abs = 0x0000; // All used memory addresses end up in here
 uint16_t addr_rel = 0x00;   // Represents absolute address following a branch
 uint8_t  opcode = 0x00;   // Is the instruction byte
-uint8_t  cycles = 0;	   // Counts how many cycles the instruction has remaining
+uint16_t instruction_pc = 0x0000; // Address the current instruction was fetched from
+int      cycles = 0;	   // Counts how many cycles the instruction (or skipped idle loop) has remaining
 uint32_t clock_count = 0;	   // A global accumulation of the number of clocks
+static bool instruction_pending = false; //accurate profile only, the opcode has been fetched and the rest waits for its last cycle
 
 typedef enum {
 	CARRY = (1 << 0),
@@ -33,13 +44,53 @@ typedef enum {
 	NEGATIVE = (1 << 7)
 } StatusFlags;
 
-void initialize_6502_cpu(Bus* bus) {
+/*
+ zero page and the stack are always internal ram, while nothing is trapping accesses (access breakpoints,
+ watchpoints) they go straight to the array instead of through the bus. checked again at every fetch.
+ the perf counter builds always use the bus so its access counts stay complete
+*/
+static uint8_t* internal_ram = NULL;
+static bool direct_memory = false;
+
+static void classify_dummy_accesses();
+
+void initialize_6502_cpu(Bus* bus, Nes_profile profile) {
 	cpu_bus = bus;
+	internal_ram = get_ram_buffer();
+	classify_dummy_accesses();
+	cpu_6502_clock = profile == NES_PROFILE_ACCURATE ? cpu_6502_clock_accurate : cpu_6502_clock_fast;
+}
+
+
+/*
+ lazy flags, nearly every instruction sets n and z (some c and v as well) and the next one usually overwrites them
+ before anything looks. so the values they come from are kept instead and the flags in lazy_flags are only worked
+ out of them when something reads the status: a branch, php, an interrupt push or the debugger
+*/
+static uint8_t lazy_flags = 0; //flags in cpu_status that are stale
+static uint16_t flag_result = 0; //z is set when it is 0 and n is its bit 7, some handlers leave a 9 or 16 bit result
+static uint16_t flag_carry = 0; //c is set when it is not 0
+static uint8_t flag_overflow = 0; //v is its bit 7
+
+//the status with the stale flags worked out, changes nothing so anything can look
+static uint8_t current_status() {
+	uint8_t flags = (flag_result & NEGATIVE) | (flag_result == 0 ? ZERO : 0) | (flag_carry ? CARRY : 0) | ((flag_overflow & 0x80) >> 1);
+	return (cpu_status & ~lazy_flags) | (flags & lazy_flags);
+}
+
+static void materialise_flags() {
+	cpu_status = current_status();
+	lazy_flags = 0;
 }
 
+static void set_nz(uint16_t result) {
+	flag_result = result;
+	lazy_flags |= ZERO | NEGATIVE;
+}
 
 // flag manipulation functions
 static void set_flag(StatusFlags flag, uint8_t value) {
+	lazy_flags &= ~flag;
 	if (value)
 		cpu_status |= flag;
 	else
@@ -47,20 +98,290 @@ static void set_flag(StatusFlags flag, uint8_t value) {
 }
 
 static uint8_t get_flag(StatusFlags flag) {
+	if (lazy_flags & flag) materialise_flags();
 	return (cpu_status & flag) > 0 ? 1 : 0;
 }
 
+/*
+ predecoded blocks, straight runs of instructions decoded once into the handler, the operand, the base cycles
+ and the index at which an indexed operand crosses a page. blocks are keyed by (bank, pc) so code in rom stays
+ good until the mapper switches its bank out and code in ram until something writes over it.
+ the cpu still runs one instruction per fetch so the ppu and everything else see exactly the same timing,
+ a block only saves decoding and the opcode and operand reads through the bus.
+ only rom ($8000-$FFFF) and internal ram are cached and nothing is used while debugging.
+*/
+#define ROM_BLOCK_COUNT 1024 //both counts must be powers of two
+#define RAM_BLOCK_COUNT 64
+#define BLOCK_MAX_INSTRUCTIONS 16
+
+typedef enum {
+	DECODED_IMP, DECODED_IMM, DECODED_ZP0, DECODED_ZPX, DECODED_ZPY, DECODED_ABS,
+	DECODED_ABX, DECODED_ABY, DECODED_IND, DECODED_IZX, DECODED_IZY, DECODED_REL,
+}Decoded_mode;
+
+typedef struct {
+	uint8_t(*operate)();
+	uint16_t operand; //address, pointer, immediate value or sign extended branch offset
+	uint16_t page_cross_at; //ABX/ABY cross a page when the index is at least this
+	uint8_t opcode;
+	uint8_t length;
+	uint8_t cycles;
+	uint8_t mode;
+}Decoded_instruction;
+
+typedef struct {
+	bool valid;
+	uint16_t start;
+	uint16_t bank;
+	uint8_t size; //bytes of code
+	uint8_t ram_pages; //bit per page of ram the code is in
+	uint8_t count;
+	Decoded_instruction instructions[BLOCK_MAX_INSTRUCTIONS];
+}Code_block;
+
+static Code_block rom_blocks[ROM_BLOCK_COUNT];
+static Code_block ram_blocks[RAM_BLOCK_COUNT];
+static uint32_t rom_generation = 0; //cartridge_prg_generation() the rom blocks were decoded under
+static uint8_t ram_code_pages = 0; //bit per page of ram that some block has code in
+
+static Code_block* current_block = NULL;
+static uint8_t current_index = 0;
+static uint16_t block_next_pc = 0x0000;
+static Cpu6502_block_stats block_stats;
+
+static bool operand_prefetched = false; //set when the decoded instruction already put its operand in fetched
+
+//a write to ram that has code in it, every block the byte belongs to is decoded again next time
+static void invalidate_ram_blocks(uint16_t addr)
+{
+	ram_code_pages = 0;
+	for (int i = 0; i < RAM_BLOCK_COUNT; i++)
+	{
+		Code_block* block = &ram_blocks[i];
+		if (!block->valid) continue;
+		//ram is mirrored every 2k so the distance is taken round the 2k ring
+		if (((addr - block->start) & 0x07FF) < block->size)
+		{
+			block->valid = false;
+			block_stats.invalidations++;
+			if (block == current_block) current_block = NULL;
+			continue;
+		}
+		ram_code_pages |= block->ram_pages;
+	}
+}
+
 static uint8_t read(uint16_t addr) {
-	return read_bus_at_address(cpu_bus, addr);
+	if (addr < 0x0200 && direct_memory) return internal_ram[addr];
+	uint8_t data = read_bus_at_address(cpu_bus, addr);
+	if (access_breakpoint_count && breakpoint_bit_set(read_breakpoints, addr)) trigger_breakpoint(addr, BREAK_ON_READ);
+	return data;
 }
 
 static void write(uint16_t addr, uint8_t data) {
+	if (addr < 0x0200 && direct_memory)
+	{
+		internal_ram[addr] = data;
+		if (ram_code_pages & (1 << (addr >> 8))) invalidate_ram_blocks(addr);
+		return;
+	}
+	if (access_breakpoint_count && breakpoint_bit_set(write_breakpoints, addr)) trigger_breakpoint(addr, BREAK_ON_WRITE);
 	write_bus_at_address(cpu_bus, addr, data);
+
+	if (addr < 0x2000)
+	{
+		if (ram_code_pages & (1 << ((addr & 0x07FF) >> 8))) invalidate_ram_blocks(addr);
+	}
+	else if (addr >= 0x4020)
+	{
+		//might be a bank switch, the next fetch looks the block up again which checks for one
+		current_block = NULL;
+	}
+}
+
+//bus read for the debugger, never triggers a breakpoint or a watchpoint and leaves the ppu and io registers alone
+static uint8_t peek(uint16_t addr) {
+	if (bus_read_has_side_effects(cpu_bus, addr)) return 0xFF;
+	return bus_read_underlying(cpu_bus, addr);
+}
+
+static void update_direct_memory() {
+#ifdef PERF_COUNTERS
+	direct_memory = false;
+#else
+	direct_memory = !access_breakpoint_count && !watchpoint_count();
+#endif
+}
+
+static void push(uint8_t data) {
+	uint16_t addr = 0x0100 + sp;
+	sp--;
+	if (!direct_memory) {
+		write(addr, data);
+		return;
+	}
+	internal_ram[addr] = data;
+	if (ram_code_pages & 0x02) invalidate_ram_blocks(addr);
+}
+
+static uint8_t pull() {
+	sp++;
+	return direct_memory ? internal_ram[0x0100 + sp] : read(0x0100 + sp);
+}
+
+//the pointer at addr in zero page, the high byte wraps round to $00
+static uint16_t read_zero_page_pointer(uint8_t addr) {
+	uint8_t next = (uint8_t)(addr + 1);
+	if (direct_memory) return internal_ram[addr] | (internal_ram[next] << 8);
+	uint16_t low = read(addr);
+	return low | (read(next) << 8);
+}
+
+//interrupt and reset vectors, both bytes come straight out of the rom when it is plain rom
+static uint16_t read_vector(uint16_t addr) {
+	const uint8_t* window = direct_memory ? cartridge_prg_window(addr) : NULL;
+	if (window) return window[addr & 0x1FFF] | (window[(addr + 1) & 0x1FFF] << 8);
+	uint16_t low = read(addr);
+	return low | (read(addr + 1) << 8);
+}
+
+#ifdef CPU_TRACE
+static int get_instruction_length(uint8_t opcode);
+
+static Trace_record* current_trace_record = NULL;
+
+//called with the opcode fetched but before it runs, operands are read past any watchpoint overlay
+static void record_instruction_trace() {
+	Trace_record* r = cpu_trace_next();
+	current_trace_record = r;
+	int length = get_instruction_length(opcode);
+	r->cycle = get_cpu_cycle_count();
+	r->pc = pc;
+	r->bytes[0] = opcode;
+	r->bytes[1] = length > 1 ? bus_read_underlying(cpu_bus, (uint16_t)(pc + 1)) : 0;
+	r->bytes[2] = length > 2 ? bus_read_underlying(cpu_bus, (uint16_t)(pc + 2)) : 0;
+	if (lazy_flags) materialise_flags();
+	r->a = a; r->x = x; r->y = y; r->sp = sp; r->p = cpu_status;
+	r->scanline = (int16_t)ppu_get_scanline();
+	r->dot = (uint16_t)ppu_get_dot();
+	r->addr = 0x0000;
+}
+#endif
+
+//pc has just moved to the next opcode, this is the only place execute breakpoints are tested
+static void check_execute_breakpoint() {
+	if (execute_breakpoint_count && breakpoint_bit_set(execute_breakpoints, pc)) trigger_breakpoint(pc, BREAK_ON_EXECUTE);
+}
+
+//trace, profile, breakpoints and watchpoints all need every byte of every instruction to go through read()
+static bool debugging_active()
+{
+	return cpu_trace_active || cpu_profile_active || execute_breakpoint_count || access_breakpoint_count || watchpoint_count();
+}
+
+/*
+ idle loops, most games spend a large part of every frame in one of
+  loop: JMP loop
+  loop: LDA $2002 / BPL loop          (BIT works too)
+  loop: LDA flag / BEQ loop           (any load, BIT or compare of ram with any branch)
+ waiting for vblank or for the nmi handler to change something. once one iteration has really run the next ones
+ are known to do exactly the same thing, ram only changes when the cpu writes it and the only bit of $2002 the
+ branch looks at only changes at vblank. so whole iterations are counted down without running them, stopping
+ early enough that the nmi still lands on a real iteration. registers end up as the last real iteration left them.
+ nothing is skipped while stepping or debugging (breakpoints, watchpoints, trace, profile).
+*/
+typedef struct {
+	uint16_t head; //address of the first instruction in the loop
+	uint16_t read_addr;
+	uint8_t instructions; //per iteration
+	int cycles; //per iteration
+	bool reads_ppu_status;
+}Idle_loop;
+
+static Idle_loop idle_loop;
+static bool idle_loop_armed = false; //set by the jump that closed a loop, only good for the very next fetch
+static uint64_t idle_cycles_skipped = 0;
+
+//the instruction before the current one, a loop is only recognised when it is the read at the top
+static uint8_t previous_opcode = 0x00;
+static uint16_t previous_pc = 0x0000;
+static uint16_t previous_addr = 0x0000;
+static int previous_cycles = 0;
+
+static bool is_idle_read(uint8_t op)
+{
+	switch (op)
+	{
+	case 0xA5: case 0xAD: //LDA
+	case 0xA6: case 0xAE: //LDX
+	case 0xA4: case 0xAC: //LDY
+	case 0x24: case 0x2C: //BIT
+	case 0xC5: case 0xCD: //CMP
+	case 0xE4: case 0xEC: //CPX
+	case 0xC4: case 0xCC: //CPY
+		return true;
+	default:
+		return false;
+	}
+}
+
+//called after an instruction that jumped backwards
+static void detect_idle_loop()
+{
+	if (opcode == 0x4C && pc == instruction_pc)
+	{
+		idle_loop = (Idle_loop){ .head = pc, .instructions = 1, .cycles = cycles };
+		idle_loop_armed = true;
+		return;
+	}
+
+	//a branch straight back to the read before it
+	if ((opcode & 0x1F) != 0x10 || previous_pc != pc || !is_idle_read(previous_opcode)) return;
+
+	bool reads_ppu_status = (previous_addr & 0xE007) == 0x2002;
+	if (reads_ppu_status)
+	{
+		//only the vblank bit is known not to change, so only LDA/BIT tested with BPL/BMI
+		if ((previous_opcode != 0xAD && previous_opcode != 0x2C) || (opcode != 0x10 && opcode != 0x30)) return;
+	}
+	else if (previous_addr >= 0x2000) return;
+
+	idle_loop = (Idle_loop){
+		.head = pc,
+		.read_addr = previous_addr,
+		.instructions = 2,
+		.cycles = previous_cycles + cycles,
+		.reads_ppu_status = reads_ppu_status,
+	};
+	idle_loop_armed = true;
+}
+
+//called instead of fetching at the top of a loop that just ran one iteration, returns true if iterations were skipped
+static bool skip_idle_loop()
+{
+	idle_loop_armed = false;
+	if (pc != idle_loop.head || !is_emulator_running() || ppu_nmi()) return false;
+	if (debugging_active()) return false;
+
+	//reading $2002 clears vblank and the write latch, skipping is only the same if both already are
+	uint8_t status;
+	if (idle_loop.reads_ppu_status && !ppu_peek_status(&status)) return false;
+
+	//the next real fetch has to come before vblank, one iteration is kept spare
+	uint32_t iterations = ppu_dots_until_vblank() / (idle_loop.cycles * 3);
+	if (iterations < 3) return false;
+	iterations--;
+
+	cycles = (int)iterations * idle_loop.cycles;
+	clock_count += iterations * idle_loop.instructions;
+	idle_cycles_skipped += cycles;
+	return true;
 }
 
 void reset_6502_cpu()
 {
-	pc = (read(0xFFFD) << 8) | read(0xFFFC);
+	update_direct_memory();
+	pc = read_vector(0xFFFC);
 	set_flag(INTERRUPT_DISABLE, 1);
 
 	a = 0;
@@ -75,6 +396,10 @@ void reset_6502_cpu()
 	temp = 0x00;
 
 	cycles = 8;
+	instruction_pending = false;
+	idle_loop_armed = false;
+	cpu6502_flush_block_cache();
+	cpu_jit_flush();
 
 	log_info("resetted to address 0x%04X", pc);
 }
@@ -129,26 +454,318 @@ Instruction lookup[16][16] = {
 	{{"BEQ",BEQ,REL,2},{"SBC",SBC,IZY,5},{"???",XXX,IMP,2},{"???",XXX,IMP,2},{"???",XXX,IMP,2},{"SBC",SBC,ZPX,4},{"INC",INC,ZPX,6},{"???",XXX,IMP,2},{"SED",SED,IMP,2},{"SBC",SBC,ABY,4},{"???",XXX,IMP,2},{"???",XXX,IMP,2},{"???",XXX,IMP,2},{"SBC",SBC,ABX,4},{"INC",INC,ABX,7},{"???",XXX,IMP,2}},
 };
 
-void cpu_6502_clock(){
-	
-	if (cycles == 0)
+static int get_instruction_length(uint8_t opcode);
+static uint8_t indirect(uint16_t ptr);
+static uint8_t indexed_indirect(uint8_t t);
+static uint8_t indirect_indexed(uint8_t t);
+
+static Decoded_mode decoded_mode(uint8_t(*mode)())
+{
+	if (mode == IMM) return DECODED_IMM;
+	if (mode == ZP0) return DECODED_ZP0;
+	if (mode == ZPX) return DECODED_ZPX;
+	if (mode == ZPY) return DECODED_ZPY;
+	if (mode == ABS) return DECODED_ABS;
+	if (mode == ABX) return DECODED_ABX;
+	if (mode == ABY) return DECODED_ABY;
+	if (mode == IND) return DECODED_IND;
+	if (mode == IZX) return DECODED_IZX;
+	if (mode == IZY) return DECODED_IZY;
+	if (mode == REL) return DECODED_REL;
+	return DECODED_IMP;
+}
+
+//anything that can take pc somewhere else finishes the block
+static bool ends_block(uint8_t op, Decoded_mode mode)
+{
+	return mode == DECODED_REL || op == 0x00 || op == 0x20 || op == 0x40 || op == 0x4C || op == 0x60 || op == 0x6C;
+}
+
+//returns false if not even the first instruction could be decoded
+static bool decode_block(Code_block* block, uint16_t start, uint16_t bank)
+{
+	bool in_ram = start < 0x2000;
+	uint32_t region_end = in_ram ? 0x1FFF : 0xFFFF;
+	uint16_t addr = start;
+
+	block->start = start;
+	block->bank = bank;
+	block->ram_pages = 0;
+	block->count = 0;
+
+	while (block->count < BLOCK_MAX_INSTRUCTIONS)
 	{
-		opcode = read(pc);
-		pc++;
+		uint8_t op = peek(addr);
+		int length = get_instruction_length(op);
+		uint16_t last = (uint16_t)(addr + length - 1);
+
+		//operands past the end of ram would be ppu registers, and rom blocks stay inside one 8k bank window
+		if ((uint32_t)addr + length - 1 > region_end) break;
+		if (!in_ram && ((addr ^ last) & 0xE000)) break;
+
+		Instruction* inst = &lookup[op >> 4][op & 0xF];
+		Decoded_instruction* d = &block->instructions[block->count++];
+		d->operate = inst->operate;
+		d->opcode = op;
+		d->length = (uint8_t)length;
+		d->cycles = lookup[op & 0xF][op >> 4].cycles; //same (transposed) cycles the fetch has always used
+		d->mode = decoded_mode(inst->address_mode);
+
+		uint16_t operand = 0;
+		if (length > 1) operand = peek((uint16_t)(addr + 1));
+		if (length > 2) operand |= peek((uint16_t)(addr + 2)) << 8;
+		if (d->mode == DECODED_REL && (operand & 0x80)) operand |= 0xFF00;
+		d->operand = operand;
+		d->page_cross_at = 0x100 - (operand & 0xFF);
+
+		if (in_ram)
+		{
+			for (int i = 0; i < length; i++) block->ram_pages |= 1 << (((addr + i) & 0x07FF) >> 8);
+		}
 
-		cycles = lookup[opcode & 0xF][opcode >> 4 & 0xF].cycles;
+		addr = (uint16_t)(addr + length);
+		if (ends_block(op, d->mode)) break;
+	}
 
-		uint8_t additional_cycle1 = lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode();
-		uint8_t additional_cycle2 = lookup[opcode >> 4 & 0xF][opcode & 0xF].operate();
+	block->size = (uint8_t)(addr - start);
+	block->valid = block->count > 0;
+	if (in_ram) ram_code_pages |= block->ram_pages;
+	return block->valid;
+}
 
-		cycles += (additional_cycle1 & additional_cycle2);
+static void flush_rom_blocks()
+{
+	for (int i = 0; i < ROM_BLOCK_COUNT; i++) rom_blocks[i].valid = false;
+	rom_generation = cartridge_prg_generation();
+	current_block = NULL;
+}
 
-		clock_count++;
+static Code_block* find_block(uint16_t addr)
+{
+	Code_block* block;
+	uint16_t bank = 0;
+	if (addr < 0x2000)
+	{
+		block = &ram_blocks[(addr ^ (addr >> 6)) & (RAM_BLOCK_COUNT - 1)];
+	}
+	else if (addr >= 0x8000)
+	{
+		if (rom_generation != cartridge_prg_generation()) flush_rom_blocks();
+		bank = cartridge_prg_bank(addr);
+		block = &rom_blocks[(addr ^ (addr >> 10) ^ (bank << 3)) & (ROM_BLOCK_COUNT - 1)];
+	}
+	else return NULL;
+
+	if (block->valid && block->start == addr && block->bank == bank)
+	{
+		block_stats.hits++;
+		return block;
 	}
 
-	cycles--;
+	block_stats.misses++;
+	return decode_block(block, addr, bank) ? block : NULL;
 }
 
+//the decoded instruction at pc, or NULL if it has to go through the normal fetch
+static const Decoded_instruction* next_decoded_instruction()
+{
+	if (!current_block || pc != block_next_pc || current_index >= current_block->count)
+	{
+		current_block = find_block(pc);
+		if (!current_block) return NULL;
+		current_index = 0;
+	}
+
+	const Decoded_instruction* d = &current_block->instructions[current_index++];
+	block_next_pc = (uint16_t)(pc + d->length);
+	block_stats.instructions++;
+	return d;
+}
+
+//the same as the fetch below but with the opcode and operand already known
+static void run_decoded_instruction(const Decoded_instruction* d)
+{
+	opcode = d->opcode;
+	pc = (uint16_t)(instruction_pc + d->length);
+	cycles = d->cycles;
+	operand_prefetched = false;
+
+	uint8_t additional_cycle1 = 0;
+	switch (d->mode)
+	{
+	case DECODED_IMP: fetched = a; operand_prefetched = true; break;
+	case DECODED_IMM: addr_abs = instruction_pc + 1; fetched = (uint8_t)d->operand; operand_prefetched = true; break;
+	case DECODED_ZP0: addr_abs = d->operand; break;
+	case DECODED_ZPX: addr_abs = (d->operand + x) & 0xFF; break;
+	case DECODED_ZPY: addr_abs = (d->operand + y) & 0xFF; break;
+	case DECODED_ABS: addr_abs = d->operand; break;
+	case DECODED_ABX: addr_abs = d->operand + x; additional_cycle1 = x >= d->page_cross_at; break;
+	case DECODED_ABY: addr_abs = d->operand + y; additional_cycle1 = y >= d->page_cross_at; break;
+	case DECODED_IND: additional_cycle1 = indirect(d->operand); break;
+	case DECODED_IZX: additional_cycle1 = indexed_indirect((uint8_t)d->operand); break;
+	case DECODED_IZY: additional_cycle1 = indirect_indexed((uint8_t)d->operand); break;
+	case DECODED_REL: addr_rel = d->operand; break;
+	}
+
+	uint8_t additional_cycle2 = d->operate();
+	cycles += (additional_cycle1 & additional_cycle2);
+}
+
+void cpu6502_flush_block_cache()
+{
+	flush_rom_blocks();
+	for (int i = 0; i < RAM_BLOCK_COUNT; i++) ram_blocks[i].valid = false;
+	ram_code_pages = 0;
+}
+
+Cpu6502_block_stats cpu6502_get_block_stats()
+{
+	return block_stats;
+}
+
+uint8_t cpu6502_opcode_cycles(uint8_t op)
+{
+	return lookup[op & 0xF][op >> 4].cycles;
+}
+
+/*
+ the recompiled blocks only touch ram and rom so a run of them can be counted down as one long instruction,
+ as long as it is over before anything the ppu does could be seen. the nmi and the end of the frame are the
+ only things that happen on their own, a few dots are kept spare so the last block never ends on either.
+ nothing runs on the clock that completes a frame, whoever is waiting for it looks at ram before the next clock
+*/
+#define JIT_SPARE_DOTS 12
+
+static bool jit_enabled = false;
+
+static bool run_jit()
+{
+	if (pc < 0x8000 || !is_emulator_running() || ppu_nmi() || is_frame_complete() || debugging_active()) return false;
+
+	uint32_t dots = ppu_dots_until_vblank();
+	uint32_t frame_end = ppu_dots_until_frame_end();
+	if (frame_end < dots) dots = frame_end;
+	if (dots <= JIT_SPARE_DOTS) return false;
+
+	Cpu6502_Regs regs = cpu6502_get_regs();
+	uint32_t instructions;
+	uint32_t used = cpu_jit_run(&regs, (dots - JIT_SPARE_DOTS) / 3, ram_code_pages, &instructions);
+	if (!used) return false;
+
+	cpu6502_set_regs(regs);
+	cycles = (int)used;
+	clock_count += instructions;
+	previous_opcode = 0x00;
+	current_block = NULL;
+	return true;
+}
+
+bool cpu6502_set_jit(bool enabled)
+{
+	if (enabled && !cpu_jit_available()) {
+		log_warn("the jit is not available on this build or host, staying with the interpreter");
+		return false;
+	}
+	jit_enabled = enabled;
+	log_info("jit %s", enabled ? "enabled" : "disabled");
+	return true;
+}
+
+bool cpu6502_jit_enabled()
+{
+	return jit_enabled;
+}
+
+static void fetch_opcode()
+{
+	opcode = read(pc);
+#ifdef CPU_TRACE
+	if (cpu_trace_active) record_instruction_trace();
+#endif
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_instruction(pc);
+#endif
+	pc++;
+
+	cycles = lookup[opcode & 0xF][opcode >> 4 & 0xF].cycles;
+}
+
+static void finish_instruction()
+{
+	clock_count++;
+
+	if (pc <= instruction_pc) detect_idle_loop();
+	previous_opcode = opcode;
+	previous_pc = instruction_pc;
+	previous_addr = addr_abs;
+	previous_cycles = cycles;
+
+	check_execute_breakpoint();
+}
+
+/*
+ the accurate profile's extra bus accesses, only the ones that can reach a register are made.
+ indexed reads that cross a page read the address before the high byte was fixed and stores and
+ read-modify-writes always do, read-modify-writes also write back the unmodified value first
+*/
+#define DUMMY_INDEXED_X 0x01
+#define DUMMY_INDEXED_Y 0x02
+#define DUMMY_STORE 0x04
+#define DUMMY_READ_MODIFY_WRITE 0x08
+
+static uint8_t dummy_access_kinds[256];
+
+static void classify_dummy_accesses()
+{
+	for (int op = 0; op < 256; op++)
+	{
+		Instruction inst = lookup[op >> 4][op & 0xF];
+		uint8_t kind = 0;
+		if (inst.address_mode == ABX) kind |= DUMMY_INDEXED_X;
+		if (inst.address_mode == ABY || inst.address_mode == IZY) kind |= DUMMY_INDEXED_Y;
+		if (inst.operate == STA || inst.operate == STX || inst.operate == STY) kind |= DUMMY_STORE;
+		else if (instruction_writes_memory((uint8_t)op)) kind |= DUMMY_READ_MODIFY_WRITE;
+		dummy_access_kinds[op] = kind;
+	}
+}
+
+static void dummy_accesses(uint8_t page_crossed)
+{
+	uint8_t kind = dummy_access_kinds[opcode];
+	if (!kind) return;
+
+	if ((kind & (DUMMY_INDEXED_X | DUMMY_INDEXED_Y)) && (page_crossed || (kind & (DUMMY_STORE | DUMMY_READ_MODIFY_WRITE))))
+	{
+		uint8_t index = (kind & DUMMY_INDEXED_X) ? x : y;
+		read((addr_abs & 0x00FF) | ((addr_abs - index) & 0xFF00));
+	}
+
+	if (kind & DUMMY_READ_MODIFY_WRITE)
+	{
+		fetched = read(addr_abs);
+		operand_prefetched = true;
+		write(addr_abs, fetched);
+	}
+}
+
+#define CPU_CLOCK cpu_6502_clock_fast
+#define CPU_EXECUTE execute_instruction_fast
+#define CPU_ACCURATE 0
+#include "cpuClock.h"
+#undef CPU_CLOCK
+#undef CPU_EXECUTE
+#undef CPU_ACCURATE
+
+#define CPU_CLOCK cpu_6502_clock_accurate
+#define CPU_EXECUTE execute_instruction_accurate
+#define CPU_ACCURATE 1
+#include "cpuClock.h"
+#undef CPU_CLOCK
+#undef CPU_EXECUTE
+#undef CPU_ACCURATE
+
+void (*cpu_6502_clock)() = cpu_6502_clock_fast;
+
 int get_cycles()
 {
 	return cycles;
@@ -157,10 +774,12 @@ int get_cycles()
 void set_cycles(int cycle)
 {
 	cycles = cycle;
+	instruction_pending = false;
 }
 
 static uint8_t fetch()
 {
+	if (operand_prefetched) return fetched;
 	if (!(lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP))
 		fetched = read(addr_abs);
 	return fetched;
@@ -168,23 +787,30 @@ static uint8_t fetch()
 
 void nmi()
 {
-	write(0x0100 + sp, (pc >> 8) & 0x00FF);
-	sp--;
-	write(0x0100 + sp, pc & 0x00FF);
-	sp--;
+#ifdef CPU_PROFILE
+	uint8_t caller_sp = sp;
+#endif
+	update_direct_memory();
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
 
 	set_flag(BREAK, 0);
 	set_flag(UNUSED, 1);
 	set_flag(INTERRUPT_DISABLE, 1);
-	write(0x0100 + sp, cpu_status);
-	sp--;
+	if (lazy_flags) materialise_flags();
+	push(cpu_status);
 
 	addr_abs = 0xFFFA;
-	uint16_t lo = read(addr_abs + 0);
-	uint16_t hi = read(addr_abs + 1);
-	pc = (hi << 8) | lo;
+	pc = read_vector(addr_abs);
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_call(pc, caller_sp, PROFILE_CALL_NMI);
+#endif
 
 	cycles = 8;
+	idle_loop_armed = false;
+	previous_opcode = 0x00;
+
+	check_execute_breakpoint();
 }
 
 static uint8_t IMM() {
@@ -192,16 +818,10 @@ static uint8_t IMM() {
 	return 0;
 }
 
-static uint8_t IND()
+//the pointer reads of the indirect modes, shared with the predecoded blocks which already have the operand
+static uint8_t indirect(uint16_t ptr)
 {
-	uint16_t ptr_lo = read(pc);
-	pc++;
-	uint16_t ptr_hi = read(pc);
-	pc++;
-
-	uint16_t ptr = (ptr_hi << 8) | ptr_lo;
-
-	if (ptr_lo == 0x00FF) // Simulate page boundary hardware bug
+	if ((ptr & 0x00FF) == 0x00FF) // Simulate page boundary hardware bug
 	{
 		addr_abs = (read(ptr & 0xFF00) << 8) | read(ptr + 0);
 	}
@@ -213,31 +833,46 @@ static uint8_t IND()
 	return 0;
 }
 
-static uint8_t IZX() {
-	uint8_t t = read(pc);
-	pc++;
+static uint8_t indexed_indirect(uint8_t t)
+{
+	addr_abs = read_zero_page_pointer((uint8_t)(t + x));
+
+	return 0;
+}
+
+static uint8_t indirect_indexed(uint8_t t)
+{
+	uint16_t pointer = read_zero_page_pointer(t);
 
-	uint16_t lower = read((((uint16_t)t + (uint16_t)x) & 0xff));
-	uint16_t upper = read((((uint16_t)t + (uint16_t)x + 1) & 0xff));
+	addr_abs = pointer + y;
 
-	addr_abs = (upper << 8) | lower;
+	if ((addr_abs & 0xFF00) != (pointer & 0xFF00)) return 1;
 
 	return 0;
 }
 
-static uint8_t IZY() {
-	uint8_t t = read(pc);
+static uint8_t IND()
+{
+	uint16_t ptr_lo = read(pc);
+	pc++;
+	uint16_t ptr_hi = read(pc);
 	pc++;
 
-	uint16_t lower = read(((uint16_t)t & 0xff));
-	uint16_t upper = read(((uint16_t)t + 1 & 0xff));
+	return indirect((ptr_hi << 8) | ptr_lo);
+}
 
-	addr_abs = (upper << 8) | lower;
-	addr_abs += y;
+static uint8_t IZX() {
+	uint8_t t = read(pc);
+	pc++;
 
-	if ((addr_abs & 0xFF00) != (upper << 8)) return 1;
+	return indexed_indirect(t);
+}
 
-	return 0;
+static uint8_t IZY() {
+	uint8_t t = read(pc);
+	pc++;
+
+	return indirect_indexed(t);
 }
 
 static uint8_t ZP0() {
@@ -319,10 +954,10 @@ static uint8_t IMP() {
 static uint8_t ADC() {
 	fetch();
 	uint16_t temp = (uint16_t)a + (uint16_t)fetched + (uint16_t)get_flag(CARRY);
-	set_flag(CARRY, temp > 0x00FF);
-	set_flag(ZERO, (temp&0x00FF) == 0);
-	set_flag(NEGATIVE,  (temp&0x80)>>7);
-	set_flag(OVERFLOW, (((((uint8_t) temp & 0x00FF)^a)&(((uint8_t)temp & 0x00FF)^fetched))&0x80)>>7);
+	flag_carry = temp & 0xFF00;
+	flag_overflow = ((uint8_t)temp ^ a) & ((uint8_t)temp ^ fetched);
+	set_nz(temp & 0x00FF);
+	lazy_flags |= CARRY | OVERFLOW;
 
 	a = temp & 0x00FF;
 
@@ -332,8 +967,7 @@ static uint8_t ADC() {
 static uint8_t AND() {
 	fetch();
 	a = a&fetched;
-	set_flag(ZERO, a == 0);
-	set_flag(NEGATIVE, a&0x80);
+	set_nz(a);
 	return 1;
 }
 
@@ -341,9 +975,9 @@ static uint8_t ASL()
 {
 	fetch();
 	temp = (uint16_t) fetched << 1;
-	set_flag(ZERO, temp == 0);
-	set_flag(NEGATIVE, (temp&0x80)>>7);
-	set_flag(CARRY, (fetched&0x80)>>7);
+	set_nz(temp);
+	flag_carry = fetched & 0x80;
+	lazy_flags |= CARRY;
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP) {
 		a = temp & 0xFF;
 	}
@@ -406,9 +1040,9 @@ static uint8_t BIT()
 {
 	fetch();
 	temp = a & fetched;
-	set_flag(ZERO, temp==0);
-	set_flag(NEGATIVE, (temp&0x80)>>7);
-	set_flag(OVERFLOW, (temp&0x40)>>6);
+	set_nz(temp);
+	flag_overflow = (uint8_t)(temp << 1);
+	lazy_flags |= OVERFLOW;
 	return 0;
 }
 
@@ -519,18 +1153,18 @@ static uint8_t CLV()
 static uint8_t CMP()
 {
 	fetch();
-	set_flag(CARRY, a >= fetched);
-	set_flag(ZERO, a == fetched);
-	set_flag(NEGATIVE, ((a-fetched)&0x80)>>7);
+	flag_carry = a >= fetched;
+	set_nz((uint8_t)(a - fetched));
+	lazy_flags |= CARRY;
 	return 1;
 }
 
 static uint8_t CPX()
 {
 	fetch();
-	set_flag(CARRY, x >= fetched);
-	set_flag(ZERO, x == fetched);
-	set_flag(NEGATIVE, ((x - fetched) & 0x80) >> 7);
+	flag_carry = x >= fetched;
+	set_nz((uint8_t)(x - fetched));
+	lazy_flags |= CARRY;
 
 	return 0;
 }
@@ -538,9 +1172,9 @@ static uint8_t CPX()
 static uint8_t CPY()
 {
 	fetch();
-	set_flag(CARRY, y >= fetched);
-	set_flag(ZERO, y == fetched);
-	set_flag(NEGATIVE, ((y - fetched) & 0x80) >> 7);
+	flag_carry = y >= fetched;
+	set_nz((uint8_t)(y - fetched));
+	lazy_flags |= CARRY;
 
 	return 0;
 }
@@ -549,8 +1183,7 @@ static uint8_t DEC()
 {
 	fetch();
 	temp = fetched - 1;
-	set_flag(ZERO, temp==0);
-	set_flag(NEGATIVE, (temp&0x80)>>7);
+	set_nz(temp);
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP) {
 		a = temp & 0xFF;
 	}
@@ -563,16 +1196,14 @@ static uint8_t DEC()
 static uint8_t DEX()
 {
 	x--;
-	set_flag(ZERO, x == 0);
-	set_flag(NEGATIVE, (x & 0x80) >> 7);
+	set_nz(x);
 	return 0;
 }
 
 static uint8_t DEY()
 {
 	y--;
-	set_flag(ZERO, y == 0);
-	set_flag(NEGATIVE, (y & 0x80) >> 7);
+	set_nz(y);
 	return 0;
 }
 
@@ -580,8 +1211,7 @@ static uint8_t EOR()
 {
 	fetch();
 	a = fetched ^ a;
-	set_flag(ZERO, a == 0);
-	set_flag(NEGATIVE, (a & 0x80) >> 7);
+	set_nz(a);
 	return 1;
 }
 
@@ -589,8 +1219,7 @@ static uint8_t INC()
 {
 	fetch();
 	temp = fetched + 1;
-	set_flag(ZERO, temp == 0);
-	set_flag(NEGATIVE, (temp & 0x80) >> 7);
+	set_nz(temp);
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP) {
 		a = temp & 0xFF;
 	}
@@ -603,16 +1232,14 @@ static uint8_t INC()
 static uint8_t INX()
 {
 	x++;
-	set_flag(ZERO, x == 0);
-	set_flag(NEGATIVE, (x & 0x80) >> 7);
+	set_nz(x);
 	return 0;
 }
 
 static uint8_t INY()
 {
 	y++;
-	set_flag(ZERO, y == 0);
-	set_flag(NEGATIVE, (y & 0x80) >> 7);
+	set_nz(y);
 	return 0;
 }
 
@@ -624,12 +1251,13 @@ static uint8_t JMP()
 
 static uint8_t JSR()
 {
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_call(addr_abs, sp, PROFILE_CALL_JSR);
+#endif
 	pc--;
 
-	write(0x100+sp, (uint8_t) ((pc & 0xFF00) >> 8) & 0xFF);
-	sp--;
-	write(0x100 + sp, (uint8_t)pc & 0xFF);
-	sp--;
+	push((uint8_t) ((pc & 0xFF00) >> 8) & 0xFF);
+	push((uint8_t)pc & 0xFF);
 
 	pc = addr_abs;
 	return 0;
@@ -639,8 +1267,7 @@ static uint8_t LDA()
 {
 	fetch();
 	a = fetched;
-	set_flag(ZERO, a==0);
-	set_flag(NEGATIVE, (a&0x80)>>7);
+	set_nz(a);
 	return 1;
 }
 
@@ -648,8 +1275,7 @@ static uint8_t LDX()
 {
 	fetch();
 	x = fetched;
-	set_flag(ZERO, x == 0);
-	set_flag(NEGATIVE, (x & 0x80) >> 7);
+	set_nz(x);
 	return 1;
 }
 
@@ -657,18 +1283,17 @@ static uint8_t LDY()
 {
 	fetch();
 	y = fetched;
-	set_flag(ZERO, y == 0);
-	set_flag(NEGATIVE, (y & 0x80) >> 7);
+	set_nz(y);
 	return 1;
 }
 
 static uint8_t LSR()
 {
 	fetch();
-	set_flag(CARRY, fetched & 0x1);
+	flag_carry = fetched & 0x1;
+	lazy_flags |= CARRY;
 	temp = fetched >> 1;
-	set_flag(ZERO, temp == 0);
-	set_flag(NEGATIVE, (temp & 0x80) >> 7);
+	set_nz(temp);
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP) {
 		a = temp & 0xFF;
 	}
@@ -682,40 +1307,36 @@ static uint8_t ORA()
 {
 	fetch();
 	a |= fetched;
-	set_flag(ZERO, a == 0x00);
-	set_flag(NEGATIVE, a&0x80);
+	set_nz(a);
 	return 1;
 }
 
 static uint8_t PHA()
 {
-	write(0x100+sp, a);
-	sp--;
+	push(a);
 	return 0;
 }
 
 static uint8_t PHP()
 {
-	write(0x100 + sp, cpu_status|BREAK|UNUSED);
+	if (lazy_flags) materialise_flags();
+	push(cpu_status|BREAK|UNUSED);
 	set_flag(BREAK, 0);
 	set_flag(UNUSED, 0);
-	sp--;
 	return 0;
 }
 
 static uint8_t PLA()
 {
-	sp++;
-	a = read(0x100+sp);
-	set_flag(ZERO, a == 0x00);
-	set_flag(NEGATIVE, (a & 0x80)>>7);
+	a = pull();
+	set_nz(a);
 	return 0;
 }
 
 static uint8_t PLP()
 {
-	sp++;
-	cpu_status = read(0x100 + sp);
+	cpu_status = pull();
+	lazy_flags = 0;
 	set_flag(UNUSED, 1);
 	return 0;
 }
@@ -724,9 +1345,9 @@ uint8_t static ROL()
 {
 	fetch();
 	temp = (uint16_t)(fetched << 1) | get_flag(CARRY);
-	set_flag(CARRY, (fetched&0x80)>>7);
-	set_flag(ZERO,  temp == 0);
-	set_flag(NEGATIVE, (temp & 0x80) >> 7);
+	flag_carry = fetched & 0x80;
+	lazy_flags |= CARRY;
+	set_nz(temp);
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP)
 		a = temp & 0x00FF;
 	else
@@ -738,9 +1359,9 @@ uint8_t static ROR()
 {
 	fetch();
 	temp = (uint16_t)(get_flag(CARRY) << 7) | (fetched>>1);
-	set_flag(CARRY, fetched & 0x1);
-	set_flag(ZERO, temp == 0);
-	set_flag(NEGATIVE, (temp & 0x80)>>7);
+	flag_carry = fetched & 0x1;
+	lazy_flags |= CARRY;
+	set_nz(temp);
 	if (lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode == IMP)
 		a = temp & 0x00FF;
 	else
@@ -750,29 +1371,31 @@ uint8_t static ROR()
 
 uint8_t static RTI()
 {
-	sp++;
-	cpu_status = read(0x100+sp);
-	sp++;
+	cpu_status = pull();
+	lazy_flags = 0;
 
 	set_flag(BREAK, 0);
 	set_flag(UNUSED, 0);
 
 
-	uint8_t low = read(0x100 + sp);
-	sp++;
-	uint8_t high = read(0x100 + sp);
+	uint8_t low = pull();
+	uint8_t high = pull();
 	pc = (high<<8) | low;
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_return(sp);
+#endif
 	return 0;
 }
 
 uint8_t static RTS()
 {
-	sp++;
-	uint8_t low = read(0x100 + sp);
-	sp++;
-	uint8_t high = read(0x100 + sp);
+	uint8_t low = pull();
+	uint8_t high = pull();
 	pc = (high << 8) | low;
 	pc++;
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_return(sp);
+#endif
 	return 0;
 }
 
@@ -783,10 +1406,10 @@ uint8_t static SBC()
 	uint16_t value = ((uint16_t)fetched) ^ 0x00FF;
 
 	temp = (uint16_t)a + value + (uint16_t) get_flag(CARRY);
-	set_flag(CARRY, temp & 0xFF00);
-	set_flag(ZERO, (temp & 0xFF) == 0);
-	set_flag(OVERFLOW, ((temp^a)&(temp^~fetched)&0x80)>>7);
-	set_flag(NEGATIVE, (temp & 0x80)>>7);
+	flag_carry = 0; //carry has always gone through set_flag's uint8_t which drops temp & 0xFF00, so sbc clears it
+	flag_overflow = (temp ^ a) & (temp ^ ~fetched);
+	set_nz(temp & 0xFF);
+	lazy_flags |= CARRY | OVERFLOW;
 	a = temp & 0x00FF;
 	return 1;
 }
@@ -830,65 +1453,63 @@ uint8_t static STY()
 uint8_t static TAX()
 {
 	x = a;
-	set_flag(ZERO, x == 0);
-	set_flag(NEGATIVE, (x&0x80)>>7);
+	set_nz(x);
 	return 0;
 }
 
 uint8_t static TAY()
 {
 	y = a;
-	set_flag(ZERO, y == 0);
-	set_flag(NEGATIVE, (y & 0x80) >> 7);
+	set_nz(y);
 	return 0;
 }
 
 uint8_t static TSX()
 {
 	x = sp;
-	set_flag(ZERO, x == 0);
-	set_flag(NEGATIVE, (x & 0x80) >> 7);
+	set_nz(x);
 	return 0;
 }
 
 uint8_t static TXA()
 {
 	a = x;
-	set_flag(ZERO, a == 0);
-	set_flag(NEGATIVE, (a & 0x80) >> 7);
+	set_nz(a);
 	return 0;
 }
 
 uint8_t static TXS()
 {
 	sp = x;
-	set_flag(ZERO, sp == 0);
-	set_flag(NEGATIVE, (sp & 0x80) >> 7);
+	set_nz(sp);
 	return 0;
 }
 
 uint8_t static TYA()
 {
 	a = y;
-	set_flag(ZERO, a == 0);
-	set_flag(NEGATIVE, (a & 0x80) >> 7);
+	set_nz(a);
 	return 0;
 }
 
 static uint8_t BRK() {
+#ifdef CPU_PROFILE
+	uint8_t caller_sp = sp;
+#endif
 	pc++;
 	set_flag(INTERRUPT_DISABLE, 1);
-	write(0x0100 + sp, (pc >> 8) & 0x00FF);
-	sp--;
-	write(0x0100 + sp, pc & 0x00FF);
-	sp--;
+	push((pc >> 8) & 0x00FF);
+	push(pc & 0x00FF);
 
 	set_flag(BREAK, 1);
-	write(0x0100 + sp, cpu_status);
-	sp--;
+	if (lazy_flags) materialise_flags();
+	push(cpu_status);
 	set_flag(BREAK, 0);
 
-	pc = (uint16_t)read(0xFFFE) | ((uint16_t)read(0xFFFF) << 8);
+	pc = read_vector(0xFFFE);
+#ifdef CPU_PROFILE
+	if (cpu_profile_active) profile_call(pc, caller_sp, PROFILE_CALL_BRK);
+#endif
 	return 0;
 }
 
@@ -902,148 +1523,187 @@ static uint8_t NOP()
 	return 0;
 }
 
-static Debug_instructions g_dbg[24];
+static Debug_instructions g_dbg[DEBUG_INSTRUCTIONS];
 
-Debug_instructions* reset_debug_instructions()
+static int get_instruction_length(uint8_t opcode)
 {
-	uint16_t cursor_pc = pc; // start from current CPU PC
+	uint8_t(*mode)() = lookup[(opcode >> 4) & 0xF][opcode & 0xF].address_mode;
+	if (mode == IMP) return 1;
+	if (mode == ABS || mode == ABX || mode == ABY || mode == IND) return 3;
+	return 2;
+}
 
-	for (int i = 0; i < 24; i++)
-	{
-		Debug_instructions* di = &g_dbg[i];
+void disassemble_instruction(uint16_t address, const uint8_t* bytes, Debug_instructions* di)
+{
+	di->address = address;
+	di->bytes[0] = bytes[0];
+	di->bytes[1] = 0;
+	di->bytes[2] = 0;
+	di->numberOfBytes = 1;
 
-		uint8_t op = read(cursor_pc);
+	Instruction inst = lookup[(bytes[0] >> 4) & 0xF][bytes[0] & 0xF];
 
-		di->address = cursor_pc;
-		di->bytes[0] = op;
-		di->bytes[1] = 0;
-		di->bytes[2] = 0;
+	if (inst.address_mode == IMP)
+	{
+		swprintf(di->mneumonics, 128, L"%hs", inst.name);
 		di->numberOfBytes = 1;
+	}
+	else if (inst.address_mode == IMM)
+	{
+		uint8_t imm = bytes[1];
+		di->bytes[1] = imm;
+		di->numberOfBytes = 2;
 
-		Instruction inst = lookup[(op >> 4) & 0xF][op & 0xF];
+		// Example formatting: "LDA #$10"
+		swprintf(di->mneumonics, 128, L"%hs #$%02X", inst.name, imm);
+	}
+	else if (inst.address_mode == ZP0)
+	{
+		uint8_t zp = bytes[1];
+		di->bytes[1] = zp;
+		di->numberOfBytes = 2;
 
-		if (inst.address_mode == IMP)
-		{
-			swprintf(di->mneumonics, 128, L"%hs", inst.name);
-			di->numberOfBytes = 1;
-		}
-		else if (inst.address_mode == IMM)
-		{
-			uint8_t imm = read((uint16_t)(cursor_pc + 1));
-			di->bytes[1] = imm;
-			di->numberOfBytes = 2;
+		swprintf(di->mneumonics, 128, L"%hs $%02X", inst.name, zp);
+	}
+	else if (inst.address_mode == ABS)
+	{
+		uint8_t lo = bytes[1];
+		uint8_t hi = bytes[2];
+		uint16_t addr = (uint16_t)(lo | (hi << 8));
+
+		di->bytes[1] = lo;
+		di->bytes[2] = hi;
+		di->numberOfBytes = 3;
+
+		swprintf(di->mneumonics, 128, L"%hs $%04X", inst.name, addr);
+	}else if (inst.address_mode == REL){
+		int8_t rel = (int8_t) bytes[1];
+
+		di->bytes[1] = rel;
+		di->numberOfBytes = 2;
+
+		swprintf(di->mneumonics, 128, L"%hs %d", inst.name, rel);
+	} else if (inst.address_mode == ABY) {
+		uint8_t lo = bytes[1];
+		uint8_t hi = bytes[2];
+		uint16_t addr = (uint16_t)(lo | (hi << 8));
+
+		di->bytes[1] = lo;
+		di->bytes[2] = hi;
+		di->numberOfBytes = 3;
+
+		swprintf(di->mneumonics, 128, L"%hs $%04X,Y", inst.name, addr);
+	}else if (inst.address_mode == ABX) {
+		uint8_t lo = bytes[1];
+		uint8_t hi = bytes[2];
+		uint16_t addr = (uint16_t)(lo | (hi << 8));
+
+		di->bytes[1] = lo;
+		di->bytes[2] = hi;
+		di->numberOfBytes = 3;
+
+		swprintf(di->mneumonics, 128, L"%hs $%04X,X", inst.name, addr);
+	}else if (inst.address_mode == ZPX) {
+		uint8_t zp = bytes[1];
+		
+		di->bytes[1] = zp;
+		di->numberOfBytes = 2;
+
+		swprintf(di->mneumonics, 128, L"%hs $%02X,X", inst.name, zp);
+	}else if (inst.address_mode == ZPY) {
+		uint8_t zp = bytes[1];
+
+		di->bytes[1] = zp;
+		di->numberOfBytes = 2;
+
+		swprintf(di->mneumonics, 128, L"%hs $%02X,Y", inst.name, zp);
+	}else if (inst.address_mode == IZX) {
+		uint8_t zp = bytes[1];
+
+		di->bytes[1] = zp;
+		di->numberOfBytes = 2;
+
+		swprintf(di->mneumonics, 128, L"%hs ($%02X,X)", inst.name, zp);
+	}else if (inst.address_mode == IZY) {
+		uint8_t zp = bytes[1];
+
+		di->bytes[1] = zp;
+		di->numberOfBytes = 2;
+
+		swprintf(di->mneumonics, 128, L"%hs ($%02X),Y", inst.name, zp);
+	}else if (inst.address_mode == IND) {
+		uint8_t lo = bytes[1];
+		uint8_t hi = bytes[2];
+		uint16_t addr = (uint16_t)(lo | (hi << 8));
+
+		di->bytes[1] = lo;
+		di->bytes[2] = hi;
+		di->numberOfBytes = 3;
+
+		swprintf(di->mneumonics, 128, L"%hs ($%04X)", inst.name, addr);
+	}
+	else
+	{
+		// Fallback: at least show mnemonic
+		swprintf(di->mneumonics, 128, L"%hs", inst.name);
+		di->numberOfBytes = 1;
+	}
+}
 
-			// Example formatting: "LDA #$10"
-			swprintf(di->mneumonics, 128, L"%hs #$%02X", inst.name, imm);
-		}
-		else if (inst.address_mode == ZP0)
-		{
-			uint8_t zp = read((uint16_t)(cursor_pc + 1));
-			di->bytes[1] = zp;
-			di->numberOfBytes = 2;
+Debug_instructions* reset_debug_instructions(uint16_t start_pc)
+{
+	uint16_t cursor_pc = start_pc;
 
-			swprintf(di->mneumonics, 128, L"%hs $%02X", inst.name, zp);
-		}
-		else if (inst.address_mode == ABS)
-		{
-			uint8_t lo = read((uint16_t)(cursor_pc + 1));
-			uint8_t hi = read((uint16_t)(cursor_pc + 2));
-			uint16_t addr = (uint16_t)(lo | (hi << 8));
-
-			di->bytes[1] = lo;
-			di->bytes[2] = hi;
-			di->numberOfBytes = 3;
-
-			swprintf(di->mneumonics, 128, L"%hs $%04X", inst.name, addr);
-		}else if (inst.address_mode == REL){
-			int8_t rel = (int8_t) read((uint16_t)(cursor_pc + 1));
-
-			di->bytes[1] = rel;
-			di->numberOfBytes = 2;
-
-			swprintf(di->mneumonics, 128, L"%hs %d", inst.name, rel);
-		} else if (inst.address_mode == ABY) {
-			uint8_t lo = read((uint16_t)(cursor_pc + 1));
-			uint8_t hi = read((uint16_t)(cursor_pc + 2));
-			uint16_t addr = (uint16_t)(lo | (hi << 8));
-
-			di->bytes[1] = lo;
-			di->bytes[2] = hi;
-			di->numberOfBytes = 3;
-
-			swprintf(di->mneumonics, 128, L"%hs $%04X,Y", inst.name, addr);
-		}else if (inst.address_mode == ABX) {
-			uint8_t lo = read((uint16_t)(cursor_pc + 1));
-			uint8_t hi = read((uint16_t)(cursor_pc + 2));
-			uint16_t addr = (uint16_t)(lo | (hi << 8));
-
-			di->bytes[1] = lo;
-			di->bytes[2] = hi;
-			di->numberOfBytes = 3;
-
-			swprintf(di->mneumonics, 128, L"%hs $%04X,X", inst.name, addr);
-		}else if (inst.address_mode == ZPX) {
-			uint8_t zp = read((uint16_t)(cursor_pc + 1));
-			
-			di->bytes[1] = zp;
-			di->numberOfBytes = 2;
-
-			swprintf(di->mneumonics, 128, L"%hs $%02X,X", inst.name, zp);
-		}else if (inst.address_mode == ZPY) {
-			uint8_t zp = read((uint16_t)(cursor_pc + 1));
-
-			di->bytes[1] = zp;
-			di->numberOfBytes = 2;
-
-			swprintf(di->mneumonics, 128, L"%hs $%02X,Y", inst.name, zp);
-		}else if (inst.address_mode == IZX) {
-			uint8_t zp = read((uint16_t)(cursor_pc + 1));
-
-			di->bytes[1] = zp;
-			di->numberOfBytes = 2;
-
-			swprintf(di->mneumonics, 128, L"%hs ($%02X,X)", inst.name, zp);
-		}else if (inst.address_mode == IZY) {
-			uint8_t zp = read((uint16_t)(cursor_pc + 1));
-
-			di->bytes[1] = zp;
-			di->numberOfBytes = 2;
-
-			swprintf(di->mneumonics, 128, L"%hs ($%02X),Y", inst.name, zp);
-		}else if (inst.address_mode == IND) {
-			uint8_t lo = read((uint16_t)(cursor_pc + 1));
-			uint8_t hi = read((uint16_t)(cursor_pc + 2));
-			uint16_t addr = (uint16_t)(lo | (hi << 8));
-
-			di->bytes[1] = lo;
-			di->bytes[2] = hi;
-			di->numberOfBytes = 3;
-
-			swprintf(di->mneumonics, 128, L"%hs ($%04X)", inst.name, addr);
-		}
-		else
-		{
-			// Fallback: at least show mnemonic
-			swprintf(di->mneumonics, 128, L"%hs", inst.name);
-			di->numberOfBytes = 1;
-		}
+	for (int i = 0; i < DEBUG_INSTRUCTIONS; i++)
+	{
+		//only the bytes the instruction actually has are read
+		uint8_t bytes[3] = { peek(cursor_pc), 0, 0 };
+		int length = get_instruction_length(bytes[0]);
+		for (int b = 1; b < length; b++) bytes[b] = peek((uint16_t)(cursor_pc + b));
 
-		cursor_pc = (uint16_t)(cursor_pc + di->numberOfBytes);
+		disassemble_instruction(cursor_pc, bytes, &g_dbg[i]);
+		cursor_pc = (uint16_t)(cursor_pc + g_dbg[i].numberOfBytes);
 	}
 
-
 	return g_dbg;
 }
 
-Debug_instructions* get_debug_instructions()
+bool instruction_writes_memory(uint8_t opcode)
 {
-	return g_dbg;
+	Instruction inst = lookup[(opcode >> 4) & 0xF][opcode & 0xF];
+	if (inst.address_mode == IMP || inst.address_mode == IMM || inst.address_mode == REL) return false;
+
+	return inst.operate == STA || inst.operate == STX || inst.operate == STY
+		|| inst.operate == ASL || inst.operate == LSR || inst.operate == ROL || inst.operate == ROR
+		|| inst.operate == INC || inst.operate == DEC;
+}
+
+uint16_t cpu6502_get_instruction_pc()
+{
+	return instruction_pc;
+}
+
+uint32_t cpu6502_get_instruction_count()
+{
+	return clock_count;
+}
+
+uint64_t cpu6502_get_idle_cycles_skipped()
+{
+	return idle_cycles_skipped;
+}
+
+void cpu6502_set_regs(Cpu6502_Regs r)
+{
+	pc = r.pc;
+	a = r.a; x = r.x; y = r.y; sp = r.sp; cpu_status = r.status;
+	lazy_flags = 0;
 }
 
 Cpu6502_Regs cpu6502_get_regs(void)
 {
 	Cpu6502_Regs r;
 	r.pc = pc;
-	r.a = a; r.x = x; r.y = y; r.sp = sp; r.status = cpu_status;
+	r.a = a; r.x = x; r.y = y; r.sp = sp; r.status = current_status();
 	return r;
 }
@@ -1,9 +1,13 @@
 #pragma once
 #include "bus.h"
+#include "nes.h"
 
-void initialize_6502_cpu(Bus* bus);
+//the profile picks which build of the clock cpu_6502_clock points at
+void initialize_6502_cpu(Bus* bus, Nes_profile profile);
 void reset_6502_cpu();
-void cpu_6502_clock();
+extern void (*cpu_6502_clock)();
+void cpu_6502_clock_fast();
+void cpu_6502_clock_accurate();
 int get_cycles();
 void set_cycles(int cycle);
 
@@ -17,13 +21,58 @@ typedef struct
 	wchar_t mneumonics[128];
 }Debug_instructions;
 
-//debug functions
-Debug_instructions* reset_debug_instructions();
-Debug_instructions* get_debug_instructions();
+#define DEBUG_INSTRUCTIONS 24
+
+/*
+ debug functions, disassembles the DEBUG_INSTRUCTIONS instructions from start_pc.
+ the bytes are read off the live bus so only the emulation thread may call it (the ui gets a copy in get_emulation_state)
+*/
+Debug_instructions* reset_debug_instructions(uint16_t start_pc);
+
+//disassembles one instruction from its bytes (at least as many as the instruction has), used by the trace decoder
+void disassemble_instruction(uint16_t address, const uint8_t* bytes, Debug_instructions* di);
+
+//true for stores and read-modify-write instructions that write their operand address (stack pushes don't count)
+bool instruction_writes_memory(uint8_t opcode);
 
 typedef struct {
 	uint16_t pc;
 	uint8_t  a, x, y, sp, status;
 } Cpu6502_Regs;
 
-Cpu6502_Regs cpu6502_get_regs();
\ No newline at end of file
+//the live registers, the ui reads the copy in get_emulation_state instead as emulation may be running
+Cpu6502_Regs cpu6502_get_regs();
+
+//only safe between instructions, used by the test harnesses to start from a known state
+void cpu6502_set_regs(Cpu6502_Regs regs);
+
+//instructions executed since the program started
+uint32_t cpu6502_get_instruction_count();
+
+//cpu cycles spent in idle loops that were counted down without running them
+uint64_t cpu6502_get_idle_cycles_skipped();
+
+typedef struct {
+	uint64_t hits; //fetches that started a block that was already decoded
+	uint64_t misses; //blocks that had to be decoded
+	uint64_t invalidations; //ram blocks thrown away because their code was written over
+	uint64_t instructions; //instructions run from a decoded block
+}Cpu6502_block_stats;
+
+Cpu6502_block_stats cpu6502_get_block_stats();
+
+//throws away every decoded block, needed after ram is changed without going through the cpu
+void cpu6502_flush_block_cache();
+
+//base cycles of an opcode, without the page crossing and branch extras
+uint8_t cpu6502_opcode_cycles(uint8_t op);
+
+/*
+ runs hot rom code through the x86-64 recompiler in cpuJit.c instead of the interpreter, only the fast profile uses it
+ returns false (and stays off) if the jit is not available
+*/
+bool cpu6502_set_jit(bool enabled);
+bool cpu6502_jit_enabled();
+
+//address of the instruction currently executing, unlike pc this does not move while operands are read
+uint16_t cpu6502_get_instruction_pc();
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "Graphics.h"
 #include "resource.h"
 #include "logger.h"
+#include "frameBuffer.h"
+#include "timeline.h"
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
@@ -19,7 +21,6 @@ ID3D11InputLayout* input_layout = NULL;
 
 ID3D11Buffer* vertex_buffer = NULL;
 
-UINT32 framebuffer[240][256];
 ID3D11Texture2D* framebuffer_texture = NULL;
 ID3D11ShaderResourceView* framebuffer_view = NULL;
 ID3D11SamplerState* sample_state = NULL;
@@ -167,17 +168,18 @@ int create_graphics_for_window(HWND hwnd)
 	device_ctx->lpVtbl->OMSetRenderTargets(device_ctx, 1, &render_target, NULL);
 
 	//setup texture and apply to pipeline
-	for (int y = 0 ; y < 240; y++)
+	static UINT32 blank_frame[FRAME_HEIGHT][FRAME_WIDTH];
+	for (int y = 0 ; y < FRAME_HEIGHT; y++)
 	{
-		for(int x = 0; x < 256; x++)
+		for(int x = 0; x < FRAME_WIDTH; x++)
 		{
-			framebuffer[y][x] = 0xFF000000;
+			blank_frame[y][x] = 0xFF000000;
 		}
 	}
 
 	D3D11_SUBRESOURCE_DATA texture = {
-		.pSysMem = framebuffer,
-		.SysMemPitch = sizeof(UINT32) * 256,
+		.pSysMem = blank_frame,
+		.SysMemPitch = sizeof(UINT32) * FRAME_WIDTH,
 	};
 
 	D3D11_TEXTURE2D_DESC td = {
@@ -217,21 +219,23 @@ int create_graphics_for_window(HWND hwnd)
 }
 
 const float colour[4] = {0.0f,0.0f,0.0f,1.0f};
-void update_window_graphics()
+bool update_window_graphics()
 {
-	device_ctx->lpVtbl->UpdateSubresource(device_ctx, framebuffer_texture, 0, NULL, framebuffer, 256 * sizeof(UINT32), 0);
+	//only upload when the emulation thread has published something new, otherwise redraw the last frame
+	bool new_frame = acquire_latest_frame();
+	if (new_frame)
+	{
+		if (timeline_active) timeline_event(TIMELINE_UI_THREAD, TIMELINE_UPLOAD_BEGIN, 0, 0);
+		device_ctx->lpVtbl->UpdateSubresource(device_ctx, framebuffer_texture, 0, NULL, get_front_buffer(), FRAME_WIDTH * sizeof(UINT32), 0);
+		if (timeline_active) timeline_event(TIMELINE_UI_THREAD, TIMELINE_UPLOAD_END, 0, 0);
+	}
 
+	if (timeline_active) timeline_event(TIMELINE_UI_THREAD, TIMELINE_PRESENT_BEGIN, 0, 0);
 	device_ctx->lpVtbl->ClearRenderTargetView(device_ctx, render_target, colour);
 	device_ctx->lpVtbl->Draw(device_ctx, 6, 0);
 	swapchain->lpVtbl->Present(swapchain, 0, 0);
-}
-
-void set_pixel(int x, int y, UINT32 colour)
-{
-	if ( x >= 0 && y >= 0 && x < 256 && y < 240)
-	{
-		framebuffer[y][x] = 0xFF000000 | (colour & 0xFFFFFF);
-	}
+	if (timeline_active) timeline_event(TIMELINE_UI_THREAD, TIMELINE_PRESENT_END, 0, 0);
+	return new_frame;
 }
 
 void delete_graphics()
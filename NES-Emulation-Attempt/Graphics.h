@@ -1,7 +1,11 @@
 #pragma once
 #include <Windows.h>
+#include <stdbool.h>
 
 int create_graphics_for_window(HWND hwnd);
-void update_window_graphics();
-void set_pixel(int x, int y, UINT32 colour);
+/*
+ presents the most recent frame published by the emulation thread
+ returns true if a new frame was uploaded, false if the previous one was redrawn
+*/
+bool update_window_graphics();
 void delete_graphics();
@@ -1,8 +1,7 @@
 #include "app.h"
 #include "nes.h"
-#include "ppu.h"
-#include "6502.h"
 #include "cartridge.h"
+#include "emuThread.h"
 #include "window.h"
 #include "logger.h"
 
@@ -27,41 +26,28 @@ bool initialise_app(char* file)
 	//create windows
 	if (!create_windows()) return false;
 
+	//the nes is only touched by the emulation thread from here on
+	if (!start_emulation_thread()) return false;
+
 	return true;
 }
 
 void deinitialise_app()
 {
+	stop_emulation_thread();
+	dump_frame_times();
 	remove_cartridge();
 	deinitalise_nes();
 	log_deinialise();
 }
 
-static uint16_t breakpoint = 0xC016;
-//static uint16_t breakpoint = 0xC5AF;
-static void run_frame()
-{
-	if (is_emulator_running())
-	{
-		while (!is_frame_complete())
-		{
-			nes_clock();
-			if (cpu6502_get_regs().pc == breakpoint)
-			{
-				send_break();
-				break;
-			}
-		}
-	}
-}
-
 int run()
 {
-	run_frame();
 	int ecode = 0;
 	if ((ecode = updateWindows()) != 0) {
 		running = false;
 	}
+	return ecode;
 }
 
 bool is_running(){
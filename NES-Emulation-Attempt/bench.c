@@ -0,0 +1,348 @@
+#include "bench.h"
+#include "nes.h"
+#include "6502.h"
+#include "ppu.h"
+#include "bus.h"
+#include "ram.h"
+#include "cartridge.h"
+#include "platform.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BASELINE_ENTRIES 64
+#define BENCH_NAME_SIZE 48
+#define DOTS_PER_SCANLINE 341
+
+//program copied into ram for the cpu benchmarks, all of them loop back to $0200 forever
+#define BENCH_PROGRAM_ADDRESS 0x0200
+
+typedef struct Benchmark Benchmark;
+
+/*
+ setup is untimed and puts the emulator in the state the benchmark needs,
+ run does ops operations and returns the ns spent on them (so it can leave out anything it has to do in between)
+*/
+struct Benchmark {
+	const char* name;
+	uint32_t ops; //per repetition, roughly 10-50ms each
+	void (*setup)(const Benchmark* bench);
+	uint64_t (*run)(const Benchmark* bench, uint32_t ops);
+	int arg;
+	const uint8_t* program;
+	int program_size;
+};
+
+typedef struct {
+	char name[BENCH_NAME_SIZE];
+	double ns_per_op;
+}Baseline_entry;
+
+//the compiler must not be allowed to throw away reads that nothing uses
+static volatile uint8_t sink;
+
+//bus reads, arg is the bus and the address is chosen so nothing gets logged
+static const uint16_t read_addresses[] = { 0x0010, 0x2002, 0x4016, 0x8000, 0x0000, 0x2000, 0x3F00 };
+
+static void setup_nothing(const Benchmark* bench) { (void)bench; }
+
+static uint64_t run_bus_read(const Benchmark* bench, uint32_t ops)
+{
+	const Bus* bus = get_bus(bench->arg >> 8);
+	uint16_t addr = read_addresses[bench->arg & 0xFF];
+	uint8_t total = 0;
+
+	uint64_t start = platform_now_ns();
+	for (uint32_t i = 0; i < ops; i++) total += read_bus_at_address(bus, addr);
+	uint64_t elapsed = platform_now_ns() - start;
+
+	sink = total;
+	return elapsed;
+}
+
+/*
+ instruction mixes, each loops forever and is run from ram so it does not depend on the rom.
+ loads/stores: LDA zp, STA zp, LDA abs,X, STA abs,X, LDA (zp),Y, JMP
+*/
+static const uint8_t load_store_program[] = {
+	0xA5, 0x10, 0x85, 0x11, 0xBD, 0x00, 0x03, 0x9D, 0x00, 0x03, 0xB1, 0x20, 0x4C, 0x00, 0x02,
+};
+
+//alu: LDA #, ADC #, AND #, ORA #, EOR #, ASL A, INX, INY, CMP #, JMP
+static const uint8_t alu_program[] = {
+	0xA9, 0x01, 0x69, 0x03, 0x29, 0x7F, 0x09, 0x10, 0x49, 0xFF, 0x0A, 0xE8, 0xC8, 0xC9, 0x40, 0x4C, 0x00, 0x02,
+};
+
+//branches: LDX #8, DEX, BNE back to DEX, JSR to an RTS, JMP
+static const uint8_t branch_program[] = {
+	0xA2, 0x08, 0xCA, 0xD0, 0xFD, 0x20, 0x0B, 0x02, 0x4C, 0x00, 0x02, 0x60,
+};
+
+//stack: PHA, PHP, PLP, PLA, TSX, TXS, JMP
+static const uint8_t stack_program[] = {
+	0x48, 0x08, 0x28, 0x68, 0xBA, 0x9A, 0x4C, 0x00, 0x02,
+};
+
+static void setup_cpu_program(const Benchmark* bench)
+{
+	uint8_t* ram = get_ram_buffer();
+	memset(ram, 0, 2048);
+	memcpy(ram + BENCH_PROGRAM_ADDRESS, bench->program, bench->program_size);
+	ram[0x20] = 0x00; //(zp),Y pointer to $0300
+	ram[0x21] = 0x03;
+
+	Cpu6502_Regs regs = { .pc = BENCH_PROGRAM_ADDRESS, .sp = 0xFD, .status = 0x24 };
+	cpu6502_set_regs(regs);
+	set_cycles(0);
+	cpu6502_flush_block_cache(); //the program was copied in behind the cpu's back
+}
+
+//one op is one whole instruction, the cpu does all its work on the first cycle and counts the rest down
+static uint64_t run_cpu_program(const Benchmark* bench, uint32_t ops)
+{
+	(void)bench;
+	uint64_t start = platform_now_ns();
+	for (uint32_t i = 0; i < ops; i++)
+	{
+		do cpu_6502_clock(); while (get_cycles() != 0);
+	}
+	return platform_now_ns() - start;
+}
+
+//scanlines, arg is the first and last scanline of the kind plus whether rendering is enabled
+#define SCANLINE_ARG(first, last, rendering) (((first) << 16) | ((last) << 1) | (rendering))
+
+static void setup_ppu_scanlines(const Benchmark* bench)
+{
+	Bus* cpu_bus = get_bus(1);
+	write_bus_at_address(cpu_bus, 0x2000, 0x00); //no nmi, nothing clocks the cpu
+	write_bus_at_address(cpu_bus, 0x2001, (bench->arg & 1) ? 0x1E : 0x00);
+	ppu_set_pixel_composition(true);
+}
+
+static uint64_t run_ppu_scanlines(const Benchmark* bench, uint32_t ops)
+{
+	int first = bench->arg >> 16;
+	int last = (bench->arg >> 1) & 0x7FFF;
+	uint64_t elapsed = 0;
+
+	for (uint32_t i = 0; i < ops; i++)
+	{
+		//getting to the start of a scanline of the right kind is not part of the measurement
+		while (ppu_get_dot() != 0 || ppu_get_scanline() < first || ppu_get_scanline() > last) ppu_clock();
+
+		uint64_t start = platform_now_ns();
+		for (int dot = 0; dot < DOTS_PER_SCANLINE; dot++) ppu_clock();
+		elapsed += platform_now_ns() - start;
+	}
+	reset_frame_complete();
+	return elapsed;
+}
+
+//nametable writes, arg is the mirroring mode
+static Nt_mirroring_mode rom_mirroring;
+
+static void setup_mirroring(const Benchmark* bench)
+{
+	set_mirroring_mode((Nt_mirroring_mode)bench->arg);
+}
+
+static uint64_t run_nametable_write(const Benchmark* bench, uint32_t ops)
+{
+	(void)bench;
+	bus_write_fn write = get_nametables_device()->write;
+
+	uint64_t start = platform_now_ns();
+	for (uint32_t i = 0; i < ops; i++) write(0x2000 + (i & 0xFFF), (uint8_t)i);
+	return platform_now_ns() - start;
+}
+
+//whole frames from reset, ram is cleared first so every run starts the same
+static void setup_frame(const Benchmark* bench)
+{
+	(void)bench;
+	set_mirroring_mode(rom_mirroring);
+	memset(get_ram_buffer(), 0, 2048);
+	reset_nes();
+	ppu_set_pixel_composition(true);
+}
+
+static uint64_t run_frame(const Benchmark* bench, uint32_t ops)
+{
+	(void)bench;
+	uint64_t start = platform_now_ns();
+	for (uint32_t i = 0; i < ops; i++)
+	{
+		while (!is_frame_complete()) nes_clock();
+		reset_frame_complete();
+	}
+	return platform_now_ns() - start;
+}
+
+#define BUS_READ(name, bus, index) { name, 2000000, setup_nothing, run_bus_read, ((bus) << 8) | (index) }
+#define CPU_MIX(name, program) { name, 1000000, setup_cpu_program, run_cpu_program, 0, program, sizeof(program) }
+#define SCANLINES(name, first, last, rendering) { name, 2000, setup_ppu_scanlines, run_ppu_scanlines, SCANLINE_ARG(first, last, rendering) }
+
+static const Benchmark benchmarks[] = {
+	BUS_READ("read cpu ram", 1, 0),
+	BUS_READ("read cpu ppu registers", 1, 1),
+	BUS_READ("read cpu controller", 1, 2),
+	BUS_READ("read cpu cartridge", 1, 3),
+	BUS_READ("read ppu cartridge", 2, 4),
+	BUS_READ("read ppu nametable", 2, 5),
+	BUS_READ("read ppu palette", 2, 6),
+	CPU_MIX("cpu loads/stores", load_store_program),
+	CPU_MIX("cpu alu", alu_program),
+	CPU_MIX("cpu branches", branch_program),
+	CPU_MIX("cpu stack", stack_program),
+	SCANLINES("ppu rendering scanline", 0, 239, 1),
+	SCANLINES("ppu disabled scanline", 0, 239, 0),
+	SCANLINES("ppu vblank scanline", 241, 260, 1),
+	{ "nametable write vertical", 2000000, setup_mirroring, run_nametable_write, VERTICAL },
+	{ "nametable write horisontal", 2000000, setup_mirroring, run_nametable_write, HORISONTAL },
+	{ "nametable write single screen", 2000000, setup_mirroring, run_nametable_write, SINGLE_SCREEN_LOWER },
+	{ "nametable write four screen", 2000000, setup_mirroring, run_nametable_write, FOUR_SCREEN },
+	{ "full frame", 20, setup_frame, run_frame },
+};
+
+#define BENCHMARK_COUNT (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int compare_doubles(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+//median ns/op over the timed repetitions
+static double measure(const Benchmark* bench, const Bench_options* options)
+{
+	double* samples = malloc(options->reps * sizeof(double));
+	if (!samples) return 0.0;
+
+	bench->setup(bench);
+	for (uint32_t i = 0; i < options->warmup; i++) bench->run(bench, bench->ops);
+	for (uint32_t i = 0; i < options->reps; i++) samples[i] = (double)bench->run(bench, bench->ops) / bench->ops;
+
+	qsort(samples, options->reps, sizeof(double), compare_doubles);
+	double median = samples[options->reps / 2];
+	free(samples);
+	return median;
+}
+
+//only reads what save_results writes, one benchmark per line
+static int load_baseline(const char* path, Baseline_entry* entries, int max)
+{
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		log_warn("could not open baseline %s", path);
+		return -1;
+	}
+
+	int count = 0;
+	char line[256];
+	while (count < max && fgets(line, sizeof(line), file))
+	{
+		char* name = strstr(line, "\"name\": \"");
+		char* value = strstr(line, "\"ns_per_op\": ");
+		if (!name || !value) continue;
+
+		name += strlen("\"name\": \"");
+		char* end = strchr(name, '"');
+		if (!end || end - name >= BENCH_NAME_SIZE) continue;
+
+		memcpy(entries[count].name, name, end - name);
+		entries[count].name[end - name] = '\0';
+		entries[count].ns_per_op = atof(value + strlen("\"ns_per_op\": "));
+		count++;
+	}
+	fclose(file);
+	return count;
+}
+
+static const Baseline_entry* find_baseline(const Baseline_entry* entries, int count, const char* name)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(entries[i].name, name) == 0) return &entries[i];
+	}
+	return NULL;
+}
+
+static int save_results(const char* path, const double* results)
+{
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		log_warn("could not open %s", path);
+		return -1;
+	}
+
+	fprintf(file, "{\"benchmarks\": [\n");
+	bool first = true;
+	for (int i = 0; i < BENCHMARK_COUNT; i++)
+	{
+		if (results[i] <= 0.0) continue;
+		fprintf(file, "%s {\"name\": \"%s\", \"ns_per_op\": %.3f, \"ops_per_second\": %.0f}", first ? "" : ",\n",
+			benchmarks[i].name, results[i], 1e9 / results[i]);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return 0;
+}
+
+int run_benchmarks(const char* rom_path, const Bench_options* options)
+{
+	Baseline_entry baseline[MAX_BASELINE_ENTRIES];
+	int baseline_count = 0;
+	if (options->baseline_path)
+	{
+		baseline_count = load_baseline(options->baseline_path, baseline, MAX_BASELINE_ENTRIES);
+		if (baseline_count == -1) return -1;
+	}
+
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		log_warn("could not load %s", rom_path);
+		return -1;
+	}
+	reset_nes();
+	set_emulator_running(true);
+	rom_mirroring = current_mirroring_mode();
+
+	Bench_options opts = *options;
+	if (opts.reps == 0) opts.reps = 1;
+
+	double results[BENCHMARK_COUNT] = { 0 };
+	int regressions = 0;
+	printf("%-28s %12s %14s %10s\n", "benchmark", "ns/op", "ops/s", "vs base");
+	for (int i = 0; i < BENCHMARK_COUNT; i++)
+	{
+		const Benchmark* bench = &benchmarks[i];
+		if (opts.filter && !strstr(bench->name, opts.filter)) continue;
+
+		results[i] = measure(bench, &opts);
+		printf("%-28s %12.2f %14.0f", bench->name, results[i], 1e9 / results[i]);
+
+		const Baseline_entry* base = find_baseline(baseline, baseline_count, bench->name);
+		if (base && base->ns_per_op > 0.0)
+		{
+			double change = (results[i] / base->ns_per_op - 1.0) * 100.0;
+			bool regressed = change > opts.threshold;
+			printf(" %+9.1f%%%s", change, regressed ? "  REGRESSED" : "");
+			if (regressed) regressions++;
+		}
+		printf("\n");
+	}
+	set_mirroring_mode(rom_mirroring);
+
+	set_emulator_running(false);
+	remove_cartridge();
+	deinitalise_nes();
+
+	if (opts.save_path && save_results(opts.save_path, results) == -1) return -1;
+	if (regressions) {
+		printf("%d benchmark%s slower than the baseline by more than %.1f%%\n", regressions, regressions == 1 ? "" : "s", opts.threshold);
+		return -1;
+	}
+	return 0;
+}
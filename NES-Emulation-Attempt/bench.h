@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ micro benchmarks for the hot paths of the core, bus reads per device, cpu instruction mixes,
+ ppu scanlines of each kind, nametable writes under both mirrorings and a whole frame.
+ each benchmark runs warmup untimed repetitions then reps timed ones, the median ns/op is reported.
+
+ a baseline is the json written by save_path:
+  {"benchmarks": [
+   {"name": "read cpu ram", "ns_per_op": 3.12, "ops_per_second": 320512820},
+   ...
+  ]}
+ every benchmark more than threshold percent slower than its baseline is flagged as a regression.
+*/
+
+typedef struct {
+	uint32_t warmup;
+	uint32_t reps;
+	double threshold; //percent
+	const char* filter; //only run benchmarks with this in their name, NULL for all
+	const char* baseline_path;
+	const char* save_path;
+}Bench_options;
+
+/*
+ runs the benchmarks against rom_path (nestest.nes is what the baselines are meant for)
+ returns -1 if the rom could not be loaded, a file could not be read or written or anything regressed
+*/
+int run_benchmarks(const char* rom_path, const Bench_options* options);
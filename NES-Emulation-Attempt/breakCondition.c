@@ -0,0 +1,356 @@
+#include "breakCondition.h"
+#include "6502.h"
+#include "ppu.h"
+#include "nes.h"
+#include "bus.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MAX_STACK_DEPTH 16
+
+typedef enum {
+	OP_CONST,
+	OP_FIELD,
+	OP_READ,
+	OP_NOT,
+	OP_NEG,
+	OP_ADD,
+	OP_SUB,
+	OP_BAND,
+	OP_BOR,
+	OP_BXOR,
+	OP_EQ,
+	OP_NE,
+	OP_LT,
+	OP_LE,
+	OP_GT,
+	OP_GE,
+	OP_AND_JUMP, //if top is 0 jump to operand leaving it, otherwise pop
+	OP_OR_JUMP, //if top is not 0 replace it with 1 and jump to operand, otherwise pop
+	OP_BOOL,
+}Condition_opcode;
+
+typedef enum {
+	FIELD_PC,
+	FIELD_A,
+	FIELD_X,
+	FIELD_Y,
+	FIELD_SP,
+	FIELD_P,
+	FIELD_CTRL,
+	FIELD_MASK,
+	FIELD_STATUS,
+	FIELD_VRAM,
+	FIELD_TRAM,
+	FIELD_SCANLINE,
+	FIELD_DOT,
+	FIELD_FRAME,
+	FIELD_CYCLE,
+}Condition_field;
+
+static const struct {
+	const char* name;
+	Condition_field field;
+}field_names[] = {
+	{"PC", FIELD_PC}, {"A", FIELD_A}, {"X", FIELD_X}, {"Y", FIELD_Y}, {"SP", FIELD_SP}, {"P", FIELD_P},
+	{"CTRL", FIELD_CTRL}, {"MASK", FIELD_MASK}, {"STATUS", FIELD_STATUS}, {"VRAM", FIELD_VRAM}, {"TRAM", FIELD_TRAM},
+	{"SCANLINE", FIELD_SCANLINE}, {"DOT", FIELD_DOT}, {"FRAME", FIELD_FRAME}, {"CYCLE", FIELD_CYCLE},
+};
+
+typedef struct {
+	const char* text;
+	const char* cursor;
+	Break_condition* out;
+	int depth; //stack depth at the current point of the program
+	int max_depth;
+	char* error;
+	int error_size;
+	bool failed;
+}Parser;
+
+static void fail(Parser* p, const char* message)
+{
+	if (p->failed) return;
+	p->failed = true;
+	snprintf(p->error, p->error_size, "%s at column %d", message, (int)(p->cursor - p->text) + 1);
+}
+
+//stack effect is how many values the op leaves on the stack minus how many it takes
+static int emit(Parser* p, Condition_opcode op, int32_t operand, int stack_effect)
+{
+	if (p->failed) return -1;
+	if (p->out->count >= MAX_CONDITION_OPS) {
+		fail(p, "expression is too long");
+		return -1;
+	}
+
+	p->depth += stack_effect;
+	if (p->depth > p->max_depth) p->max_depth = p->depth;
+
+	p->out->ops[p->out->count].op = op;
+	p->out->ops[p->out->count].operand = operand;
+	return p->out->count++;
+}
+
+static void skip_spaces(Parser* p)
+{
+	while (*p->cursor == ' ' || *p->cursor == '\t') p->cursor++;
+}
+
+//consumes token if it is next, two character tokens have to be checked before their one character prefix
+static bool accept(Parser* p, const char* token)
+{
+	skip_spaces(p);
+	size_t len = strlen(token);
+	if (strncmp(p->cursor, token, len) != 0) return false;
+	p->cursor += len;
+	return true;
+}
+
+static void parse_or(Parser* p);
+
+static void parse_number(Parser* p)
+{
+	int base = 10;
+	if (*p->cursor == '$') { base = 16; p->cursor++; }
+	else if (*p->cursor == '%') { base = 2; p->cursor++; }
+	else if (p->cursor[0] == '0' && (p->cursor[1] == 'x' || p->cursor[1] == 'X')) { base = 16; p->cursor += 2; }
+
+	char* end = NULL;
+	long value = strtol(p->cursor, &end, base);
+	if (end == p->cursor) {
+		fail(p, "expected a number");
+		return;
+	}
+	p->cursor = end;
+	emit(p, OP_CONST, (int32_t)value, 1);
+}
+
+static void parse_field(Parser* p)
+{
+	char name[16];
+	int len = 0;
+	while (isalpha((unsigned char)*p->cursor) && len < (int)sizeof(name) - 1)
+	{
+		name[len++] = (char)toupper((unsigned char)*p->cursor);
+		p->cursor++;
+	}
+	name[len] = '\0';
+
+	for (int i = 0; i < (int)(sizeof(field_names) / sizeof(field_names[0])); i++)
+	{
+		if (strcmp(name, field_names[i].name) == 0)
+		{
+			emit(p, OP_FIELD, field_names[i].field, 1);
+			return;
+		}
+	}
+	fail(p, "unknown name");
+}
+
+static void parse_unary(Parser* p)
+{
+	skip_spaces(p);
+	if (p->failed) return;
+
+	if (accept(p, "!"))
+	{
+		parse_unary(p);
+		emit(p, OP_NOT, 0, 0);
+	}
+	else if (accept(p, "-"))
+	{
+		parse_unary(p);
+		emit(p, OP_NEG, 0, 0);
+	}
+	else if (accept(p, "("))
+	{
+		parse_or(p);
+		if (!accept(p, ")")) fail(p, "expected )");
+	}
+	else if (accept(p, "["))
+	{
+		parse_or(p);
+		if (!accept(p, "]")) fail(p, "expected ]");
+		emit(p, OP_READ, 0, 0);
+	}
+	else if (isdigit((unsigned char)*p->cursor) || *p->cursor == '$' || *p->cursor == '%')
+	{
+		parse_number(p);
+	}
+	else if (isalpha((unsigned char)*p->cursor))
+	{
+		parse_field(p);
+	}
+	else
+	{
+		fail(p, "expected a value");
+	}
+}
+
+static void parse_arithmetic(Parser* p)
+{
+	parse_unary(p);
+	while (!p->failed)
+	{
+		Condition_opcode op;
+		skip_spaces(p);
+		//&& and || belong to the looser levels
+		if (p->cursor[0] == '&' && p->cursor[1] == '&') break;
+		if (p->cursor[0] == '|' && p->cursor[1] == '|') break;
+
+		if (accept(p, "+")) op = OP_ADD;
+		else if (accept(p, "-")) op = OP_SUB;
+		else if (accept(p, "&")) op = OP_BAND;
+		else if (accept(p, "|")) op = OP_BOR;
+		else if (accept(p, "^")) op = OP_BXOR;
+		else break;
+
+		parse_unary(p);
+		emit(p, op, 0, -1);
+	}
+}
+
+static void parse_comparison(Parser* p)
+{
+	parse_arithmetic(p);
+
+	Condition_opcode op;
+	if (accept(p, "==")) op = OP_EQ;
+	else if (accept(p, "!=")) op = OP_NE;
+	else if (accept(p, "<=")) op = OP_LE;
+	else if (accept(p, ">=")) op = OP_GE;
+	else if (accept(p, "<")) op = OP_LT;
+	else if (accept(p, ">")) op = OP_GT;
+	else return;
+
+	parse_arithmetic(p);
+	emit(p, op, 0, -1);
+}
+
+static void parse_and(Parser* p)
+{
+	parse_comparison(p);
+	while (!p->failed && accept(p, "&&"))
+	{
+		int jump = emit(p, OP_AND_JUMP, 0, -1);
+		parse_comparison(p);
+		emit(p, OP_BOOL, 0, 0);
+		if (jump >= 0) p->out->ops[jump].operand = p->out->count;
+	}
+}
+
+static void parse_or(Parser* p)
+{
+	parse_and(p);
+	while (!p->failed && accept(p, "||"))
+	{
+		int jump = emit(p, OP_OR_JUMP, 0, -1);
+		parse_and(p);
+		emit(p, OP_BOOL, 0, 0);
+		if (jump >= 0) p->out->ops[jump].operand = p->out->count;
+	}
+}
+
+int compile_break_condition(const char* text, Break_condition* condition, char* error, int error_size)
+{
+	Parser p = {
+		.text = text,
+		.cursor = text,
+		.out = condition,
+		.error = error,
+		.error_size = error_size,
+	};
+
+	condition->count = 0;
+	if (strlen(text) >= MAX_CONDITION_TEXT) {
+		fail(&p, "expression is too long");
+		return -1;
+	}
+
+	parse_or(&p);
+	skip_spaces(&p);
+	if (*p.cursor != '\0') fail(&p, "unexpected character");
+	if (p.max_depth > MAX_STACK_DEPTH) fail(&p, "expression is nested too deeply");
+	if (p.failed) return -1;
+
+	strcpy(condition->source, text);
+	return 0;
+}
+
+static int32_t read_field(Condition_field field)
+{
+	switch (field)
+	{
+	case FIELD_PC: return cpu6502_get_regs().pc;
+	case FIELD_A: return cpu6502_get_regs().a;
+	case FIELD_X: return cpu6502_get_regs().x;
+	case FIELD_Y: return cpu6502_get_regs().y;
+	case FIELD_SP: return cpu6502_get_regs().sp;
+	case FIELD_P: return cpu6502_get_regs().status;
+	case FIELD_CTRL: return ppu_get_regs().ctrl;
+	case FIELD_MASK: return ppu_get_regs().mask;
+	case FIELD_STATUS: return ppu_get_regs().status;
+	case FIELD_VRAM: return ppu_get_regs().vram;
+	case FIELD_TRAM: return ppu_get_regs().tram;
+	case FIELD_SCANLINE: return ppu_get_scanline();
+	case FIELD_DOT: return ppu_get_dot();
+	case FIELD_FRAME: return (int32_t)ppu_get_frame_count();
+	case FIELD_CYCLE: return (int32_t)get_cpu_cycle_count();
+	default: return 0;
+	}
+}
+
+static int32_t read_memory(int32_t addr)
+{
+	addr &= 0xFFFF;
+	//reading ppu or apu/io registers changes their state, a condition must never do that
+	if (addr >= 0x2000 && addr < 0x4020) return 0;
+	//underneath any watchpoint trap, evaluating a condition is not an access by the program
+	const Bus* bus = get_bus(1);
+	if (!bus) return 0;
+	return bus_read_underlying(bus, (uint16_t)addr);
+}
+
+bool evaluate_break_condition(const Break_condition* condition)
+{
+	int32_t stack[MAX_STACK_DEPTH];
+	int top = -1;
+
+	for (int i = 0; i < condition->count; i++)
+	{
+		const Condition_op* op = &condition->ops[i];
+		switch (op->op)
+		{
+		case OP_CONST: stack[++top] = op->operand; break;
+		case OP_FIELD: stack[++top] = read_field(op->operand); break;
+		case OP_READ: stack[top] = read_memory(stack[top]); break;
+		case OP_NOT: stack[top] = !stack[top]; break;
+		case OP_NEG: stack[top] = -stack[top]; break;
+		case OP_ADD: top--; stack[top] = stack[top] + stack[top + 1]; break;
+		case OP_SUB: top--; stack[top] = stack[top] - stack[top + 1]; break;
+		case OP_BAND: top--; stack[top] = stack[top] & stack[top + 1]; break;
+		case OP_BOR: top--; stack[top] = stack[top] | stack[top + 1]; break;
+		case OP_BXOR: top--; stack[top] = stack[top] ^ stack[top + 1]; break;
+		case OP_EQ: top--; stack[top] = stack[top] == stack[top + 1]; break;
+		case OP_NE: top--; stack[top] = stack[top] != stack[top + 1]; break;
+		case OP_LT: top--; stack[top] = stack[top] < stack[top + 1]; break;
+		case OP_LE: top--; stack[top] = stack[top] <= stack[top + 1]; break;
+		case OP_GT: top--; stack[top] = stack[top] > stack[top + 1]; break;
+		case OP_GE: top--; stack[top] = stack[top] >= stack[top + 1]; break;
+		case OP_AND_JUMP:
+			if (stack[top] == 0) i = op->operand - 1;
+			else top--;
+			break;
+		case OP_OR_JUMP:
+			if (stack[top] != 0) { stack[top] = 1; i = op->operand - 1; }
+			else top--;
+			break;
+		case OP_BOOL: stack[top] = stack[top] != 0; break;
+		}
+	}
+
+	return top >= 0 && stack[top] != 0;
+}
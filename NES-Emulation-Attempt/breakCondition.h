@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ conditions like "PC == $C5AF && A > 3 && [$0300] == 0" are compiled once into a small stack bytecode,
+ the breakpoint code only runs it when the address bitmap already matched.
+
+ operands:
+  numbers     $C5AF 0xC5AF 42 %1010
+  cpu         PC A X Y SP P
+  ppu         CTRL MASK STATUS VRAM TRAM SCANLINE DOT
+  counters    FRAME CYCLE (cpu cycles since reset)
+  memory      [expr] reads a byte from the cpu bus, ppu/apu registers read as 0 so evaluating has no side effects
+ operators (loosest first):
+  ||   &&   == != < <= > >=   + - & | ^   ! - (unary)   ( )
+ names are case insensitive.
+*/
+
+#define MAX_CONDITION_OPS 64
+#define MAX_CONDITION_TEXT 128
+
+typedef struct {
+	uint8_t op;
+	int32_t operand;
+}Condition_op;
+
+typedef struct {
+	Condition_op ops[MAX_CONDITION_OPS];
+	int count;
+	char source[MAX_CONDITION_TEXT];
+}Break_condition;
+
+/*
+ compiles text into condition, on failure a message is written to error
+ returns 0 when successful or -1 on a syntax error or if the expression is too large
+*/
+int compile_break_condition(const char* text, Break_condition* condition, char* error, int error_size);
+
+//runs the compiled bytecode against the current cpu/ppu state, true means the breakpoint should stop
+bool evaluate_break_condition(const Break_condition* condition);
@@ -0,0 +1,209 @@
+#include "breakpoints.h"
+#include "logger.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ slots are only claimed and released by the ui thread, the emulation thread reads them when a bitmap hits.
+ types is written last when claiming and first when releasing so a half written slot is never evaluated
+*/
+typedef struct {
+	volatile int types; //0 when the slot is free
+	uint16_t addr;
+	Break_condition condition;
+	uint64_t evaluations;
+	uint64_t hits;
+	double total_seconds;
+}Conditional_breakpoint;
+
+static Conditional_breakpoint conditional_breakpoints[MAX_CONDITIONAL_BREAKPOINTS];
+static volatile int conditional_breakpoint_count = 0;
+
+uint8_t execute_breakpoints[8192];
+uint8_t read_breakpoints[8192];
+uint8_t write_breakpoints[8192];
+volatile int execute_breakpoint_count = 0;
+volatile int access_breakpoint_count = 0;
+
+bool breakpoint_triggered = false;
+uint16_t breakpoint_address = 0x0000;
+Breakpoint_type breakpoint_reason = BREAK_ON_EXECUTE;
+
+//only one bitmap per type so this just picks the right one
+static uint8_t* bitmap_for(Breakpoint_type type)
+{
+	switch (type)
+	{
+	case BREAK_ON_EXECUTE: return execute_breakpoints;
+	case BREAK_ON_READ: return read_breakpoints;
+	case BREAK_ON_WRITE: return write_breakpoints;
+	default: return NULL;
+	}
+}
+
+static volatile int* count_for(Breakpoint_type type)
+{
+	return type == BREAK_ON_EXECUTE ? &execute_breakpoint_count : &access_breakpoint_count;
+}
+
+int add_breakpoint(uint16_t addr, int types)
+{
+	for (int type = BREAK_ON_EXECUTE; type <= BREAK_ON_WRITE; type <<= 1)
+	{
+		if (!(types & type)) continue;
+
+		uint8_t* bitmap = bitmap_for(type);
+		if (breakpoint_bit_set(bitmap, addr)) continue;
+
+		bitmap[addr >> 3] |= (1 << (addr & 7));
+		(*count_for(type))++;
+		log_info("added breakpoint type %d at 0x%04X", type, addr);
+	}
+	return 0;
+}
+
+int remove_breakpoint(uint16_t addr, int types)
+{
+	int removed = -1;
+	for (int type = BREAK_ON_EXECUTE; type <= BREAK_ON_WRITE; type <<= 1)
+	{
+		if (!(types & type)) continue;
+
+		uint8_t* bitmap = bitmap_for(type);
+		if (!breakpoint_bit_set(bitmap, addr)) continue;
+
+		bitmap[addr >> 3] &= ~(1 << (addr & 7));
+		(*count_for(type))--;
+		removed = 0;
+		log_info("removed breakpoint type %d at 0x%04X", type, addr);
+	}
+
+	if (get_breakpoint(addr) == 0) clear_breakpoint_condition(addr);
+	return removed;
+}
+
+int get_breakpoint(uint16_t addr)
+{
+	int types = 0;
+	if (breakpoint_bit_set(execute_breakpoints, addr)) types |= BREAK_ON_EXECUTE;
+	if (breakpoint_bit_set(read_breakpoints, addr)) types |= BREAK_ON_READ;
+	if (breakpoint_bit_set(write_breakpoints, addr)) types |= BREAK_ON_WRITE;
+	return types;
+}
+
+void clear_breakpoints()
+{
+	for (int i = 0; i < MAX_CONDITIONAL_BREAKPOINTS; i++) conditional_breakpoints[i].types = 0;
+	conditional_breakpoint_count = 0;
+
+	//counts first so the cpu stops looking before the bitmaps change underneath it
+	execute_breakpoint_count = 0;
+	access_breakpoint_count = 0;
+	memset(execute_breakpoints, 0, sizeof(execute_breakpoints));
+	memset(read_breakpoints, 0, sizeof(read_breakpoints));
+	memset(write_breakpoints, 0, sizeof(write_breakpoints));
+}
+
+int breakpoint_count()
+{
+	return execute_breakpoint_count + access_breakpoint_count;
+}
+
+/*
+ a trigger passes if there is no condition for it or any matching condition is true
+ this only runs once a bitmap has already matched so the linear search is cheap enough
+*/
+static bool conditions_pass(uint16_t addr, Breakpoint_type reason)
+{
+	bool has_condition = false;
+	bool pass = false;
+
+	for (int i = 0; i < MAX_CONDITIONAL_BREAKPOINTS; i++)
+	{
+		Conditional_breakpoint* slot = &conditional_breakpoints[i];
+		if (!(slot->types & reason) || slot->addr != addr) continue;
+
+		has_condition = true;
+		double start = platform_now_seconds();
+		bool result = evaluate_break_condition(&slot->condition);
+		slot->total_seconds += platform_now_seconds() - start;
+		slot->evaluations++;
+
+		if (result)
+		{
+			slot->hits++;
+			pass = true;
+		}
+	}
+
+	return !has_condition || pass;
+}
+
+void trigger_breakpoint(uint16_t addr, Breakpoint_type reason)
+{
+	if (conditional_breakpoint_count && !conditions_pass(addr, reason)) return;
+
+	breakpoint_triggered = true;
+	breakpoint_address = addr;
+	breakpoint_reason = reason;
+}
+
+int set_breakpoint_condition(uint16_t addr, int types, const char* expression, char* error, int error_size)
+{
+	clear_breakpoint_condition(addr);
+
+	Conditional_breakpoint* slot = NULL;
+	for (int i = 0; i < MAX_CONDITIONAL_BREAKPOINTS && !slot; i++)
+	{
+		if (conditional_breakpoints[i].types == 0) slot = &conditional_breakpoints[i];
+	}
+	if (!slot) {
+		snprintf(error, error_size, "all %d conditional breakpoints are in use", MAX_CONDITIONAL_BREAKPOINTS);
+		return -1;
+	}
+
+	if (compile_break_condition(expression, &slot->condition, error, error_size) == -1) return -1;
+
+	slot->addr = addr;
+	slot->evaluations = 0;
+	slot->hits = 0;
+	slot->total_seconds = 0.0;
+	slot->types = types;
+	conditional_breakpoint_count++;
+
+	add_breakpoint(addr, types);
+	log_info("breakpoint at 0x%04X only stops when %s (%d ops)", addr, slot->condition.source, slot->condition.count);
+	return 0;
+}
+
+void clear_breakpoint_condition(uint16_t addr)
+{
+	for (int i = 0; i < MAX_CONDITIONAL_BREAKPOINTS; i++)
+	{
+		Conditional_breakpoint* slot = &conditional_breakpoints[i];
+		if (slot->types == 0 || slot->addr != addr) continue;
+
+		slot->types = 0;
+		conditional_breakpoint_count--;
+	}
+}
+
+int get_breakpoint_stats(Breakpoint_stats* stats, int max)
+{
+	int count = 0;
+	for (int i = 0; i < MAX_CONDITIONAL_BREAKPOINTS && count < max; i++)
+	{
+		Conditional_breakpoint* slot = &conditional_breakpoints[i];
+		if (slot->types == 0) continue;
+
+		stats[count].addr = slot->addr;
+		stats[count].types = slot->types;
+		stats[count].expression = slot->condition.source;
+		stats[count].evaluations = slot->evaluations;
+		stats[count].hits = slot->hits;
+		stats[count].average_ns = slot->evaluations ? slot->total_seconds / slot->evaluations * 1e9 : 0.0;
+		count++;
+	}
+	return count;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "breakCondition.h"
+
+typedef enum {
+	BREAK_ON_EXECUTE = (1 << 0),
+	BREAK_ON_READ = (1 << 1),
+	BREAK_ON_WRITE = (1 << 2),
+}Breakpoint_type;
+
+/*
+ one bit per cpu address for each breakpoint type (64 Kbit each).
+ the cpu only looks at a bitmap when the matching count is non zero so an empty set costs a single branch.
+ execute breakpoints are tested once per fetched opcode, read/write breakpoints on every cpu bus access.
+ everything here can be called from the ui thread while the emulation thread is running.
+*/
+extern uint8_t execute_breakpoints[8192];
+extern uint8_t read_breakpoints[8192];
+extern uint8_t write_breakpoints[8192];
+extern volatile int execute_breakpoint_count;
+extern volatile int access_breakpoint_count; //read and write combined
+
+//set by the cpu when a breakpoint is reached, whoever stops emulation clears it
+extern bool breakpoint_triggered;
+extern uint16_t breakpoint_address; //address that caused the last trigger
+extern Breakpoint_type breakpoint_reason;
+
+#define breakpoint_bit_set(bitmap, addr) (((bitmap)[(addr) >> 3] >> ((addr) & 7)) & 1)
+
+/*
+ types can be or'd together
+ returns 0 if the breakpoint was added or was already there
+*/
+int add_breakpoint(uint16_t addr, int types);
+
+/*
+ types can be or'd together
+ returns 0 if a breakpoint was removed, -1 if there was none
+*/
+int remove_breakpoint(uint16_t addr, int types);
+
+//returns the Breakpoint_type flags set at addr
+int get_breakpoint(uint16_t addr);
+
+void clear_breakpoints();
+
+//total number of breakpoints across all types
+int breakpoint_count();
+
+/*
+ called by the cpu when a bitmap test passes,
+ if a condition is attached to the address it is evaluated here and the trigger is dropped when it is false
+*/
+void trigger_breakpoint(uint16_t addr, Breakpoint_type reason);
+
+#define MAX_CONDITIONAL_BREAKPOINTS 32
+
+typedef struct {
+	uint16_t addr;
+	int types;
+	const char* expression;
+	uint64_t evaluations;
+	uint64_t hits; //evaluations that stopped emulation
+	double average_ns; //measured cost of one evaluation
+}Breakpoint_stats;
+
+/*
+ adds a breakpoint at addr that only stops when expression is true, see breakCondition.h for the syntax.
+ replaces any condition already attached to the same address and types
+ returns 0 when successful, -1 with a message in error if the expression does not compile or all slots are used
+*/
+int set_breakpoint_condition(uint16_t addr, int types, const char* expression, char* error, int error_size);
+
+//detaches any condition from addr, the breakpoint itself stays
+void clear_breakpoint_condition(uint16_t addr);
+
+/*
+ copies out the statistics of every conditional breakpoint
+ returns how many were written
+*/
+int get_breakpoint_stats(Breakpoint_stats* stats, int max);
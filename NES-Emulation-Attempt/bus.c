@@ -1,10 +1,12 @@
 #include "bus.h"
 #include "logger.h"
+#include "diagnostics.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
 #define INITIAL_BUS_DEVICE_REGISTRY_CAPACITY 5
+#define BUS_PAGE_COUNT 256
 
 typedef struct {
 	int count;
@@ -16,6 +18,18 @@ struct Bus {
 	char* name;
 	Device_registry registry;
 	bool islocked;
+	/*
+	 built when the registry is locked, a page points at the device covering all 256 bytes of it
+	 or NULL if the page is split between devices (or empty) in which case the binary search is used.
+	 pages is what accesses go through and can hold an overlay, underlying always holds the real device
+	*/
+	const Bus_device* volatile pages[BUS_PAGE_COUNT];
+	const Bus_device* underlying[BUS_PAGE_COUNT];
+#ifdef PERF_COUNTERS
+	//one entry per registry slot, allocated when the registry is locked
+	uint64_t* reads;
+	uint64_t* writes;
+#endif
 };
 
 Bus bus_6502 = {
@@ -89,6 +103,29 @@ static int cmp_device(const void* a, const void* b)
 	return 0;
 }
 
+static int find_bus_device_by_address(const Bus* bus,const uint16_t addr)
+{
+	int lower = 0;
+	int higher = bus->registry.count - 1;
+
+	while (lower <= higher) {
+		int middle = lower + (higher - lower) / 2;
+		const Bus_device* device = &bus->registry.bus_device_array_List[middle];
+
+		if (addr < device->start_range) {
+			higher = middle - 1;
+		}
+		else if (addr > device->end_range) {
+			lower = middle + 1;
+		}
+		else {
+			return middle;
+		}
+	}
+
+	return -1;
+}
+
 int lock_device_registry(Bus* bus)
 {
 	if (!bus->registry.bus_device_array_List){
@@ -125,6 +162,29 @@ int lock_device_registry(Bus* bus)
 		}
 	}
 
+	//build the page table, only pages owned entirely by one device get a direct entry
+	for (int page = 0; page < BUS_PAGE_COUNT; page++) {
+		uint16_t first = (uint16_t)(page << 8);
+		uint16_t last = (uint16_t)(first | 0xFF);
+		int idx = find_bus_device_by_address(bus, first);
+		const Bus_device* device = NULL;
+		if (idx >= 0 && bus->registry.bus_device_array_List[idx].end_range >= last) {
+			device = &bus->registry.bus_device_array_List[idx];
+		}
+		bus->underlying[page] = device;
+		bus->pages[page] = device;
+	}
+
+#ifdef PERF_COUNTERS
+	free(bus->reads);
+	bus->reads = calloc(bus->registry.count * 2, sizeof(uint64_t));
+	if (!bus->reads) {
+		log_critical("Failed to allocate bus access counters");
+		return -1;
+	}
+	bus->writes = bus->reads + bus->registry.count;
+#endif
+
 	//log the devices and their regions
 	for(int i = 0; i < bus->registry.count; i++) {
 		Bus_device* device = &bus->registry.bus_device_array_List[i];
@@ -137,49 +197,70 @@ int lock_device_registry(Bus* bus)
 	return 0;
 }
 
-static int find_bus_device_by_address(const Bus* bus,const uint16_t addr)
+//slow path for pages that are split between devices or have nothing on them
+static const Bus_device* find_device(const Bus* bus, const uint16_t addr)
 {
-	int lower = 0;
-	int higher = bus->registry.count - 1;
-
-	while (lower <= higher) {
-		int middle = lower + (higher - lower) / 2;
-		const Bus_device* device = &bus->registry.bus_device_array_List[middle];
-
-		if (addr < device->start_range) {
-			higher = middle - 1;
-		}
-		else if (addr > device->end_range) {
-			lower = middle + 1;
-		}
-		else {
-			return middle;
-		}
-	}
+	int idx = find_bus_device_by_address(bus, addr);
+	if (idx < 0) return NULL;
+	return &bus->registry.bus_device_array_List[idx];
+}
 
-	return -1;
+#ifdef PERF_COUNTERS
+//overlays are not in the registry, they forward to the underlying device which is counted instead
+static void count_access(const Bus* bus, const Bus_device* device, uint64_t* counts)
+{
+	const Bus_device* list = bus->registry.bus_device_array_List;
+	if (device >= list && device < list + bus->registry.count) counts[device - list]++;
 }
+#endif
 
-uint8_t read_bus_at_address(const Bus* bus, const uint16_t addr)
+static uint8_t dispatch_read(const Bus* bus, const Bus_device* device, const uint16_t addr)
 {
-	if (!bus || !bus->islocked) {
-		log_warn("attempted to read to locked or non-existant bus");
-		return 0x00;
-	}
-	int idx = find_bus_device_by_address(bus, addr);
-	if (idx < 0) {
-		log_warn("Attempted read at address 0x%04x on %s bus, but there is no device defaulted to 0x00", addr, bus->name);
+	if (!device) device = find_device(bus, addr);
+	if (!device) {
+		diag_warn(addr, "Attempted read at address 0x%04x on %s bus, but there is no device defaulted to 0x00", addr, bus->name);
 		return 0x00;
 	}
 
-	const Bus_device* device = &bus->registry.bus_device_array_List[idx];
 	if (!device->read) {
-		log_warn("Attempted read at address 0x%04x on %s bus, but device has no response defaulted to 0x00", addr, bus->name);
+		diag_warn(addr, "Attempted read at address 0x%04x on %s bus, but device has no response defaulted to 0x00", addr, bus->name);
 		return 0x00;
 	}
 
+#ifdef PERF_COUNTERS
+	count_access(bus, device, bus->reads);
+#endif
 	return device->read(addr);
+}
+
+static void dispatch_write(const Bus* bus, const Bus_device* device, const uint16_t addr, const uint8_t data)
+{
+	if (!device) device = find_device(bus, addr);
+	if (!device) {
+		diag_warn(addr, "Attempted write at address 0x%04x on %s bus, but there is no device", addr, bus->name);
+		return;
+	}
+
+	if (!device->write)
+	{
+		diag_warn(addr, "Attempted write at address 0x%04x on %s bus, but device has no response", addr, bus->name);
+		return;
+	}
 
+#ifdef PERF_COUNTERS
+	count_access(bus, device, bus->writes);
+#endif
+	device->write(addr, data);
+}
+
+uint8_t read_bus_at_address(const Bus* bus, const uint16_t addr)
+{
+	if (!bus || !bus->islocked) {
+		log_warn("attempted to read to locked or non-existant bus");
+		return 0x00;
+	}
+
+	return dispatch_read(bus, bus->pages[addr >> 8], addr);
 }
 
 void write_bus_at_address(const Bus* bus, const uint16_t addr, const uint8_t data)
@@ -190,20 +271,54 @@ void write_bus_at_address(const Bus* bus, const uint16_t addr, const uint8_t dat
 		return;
 	}
 
-	int idx = find_bus_device_by_address(bus, addr);
-	if (idx < 0) {
-		log_warn("Attempted write at address 0x%04x on %s bus, but there is no device", addr, bus->name);
-		return;
+	dispatch_write(bus, bus->pages[addr >> 8], addr, data);
+}
+
+uint8_t bus_read_underlying(const Bus* bus, const uint16_t addr)
+{
+	return dispatch_read(bus, bus->underlying[addr >> 8], addr);
+}
+
+void bus_write_underlying(const Bus* bus, const uint16_t addr, const uint8_t data)
+{
+	dispatch_write(bus, bus->underlying[addr >> 8], addr, data);
+}
+
+int bus_set_page_overlay(Bus* bus, uint8_t page, const Bus_device* overlay)
+{
+	if (!bus || !bus->islocked) {
+		log_warn("attempted to overlay a page on an unlocked or non-existant bus");
+		return -1;
 	}
 
-	const Bus_device* device = &bus->registry.bus_device_array_List[idx];
-	if (!device->write)
+	bus->pages[page] = overlay ? overlay : bus->underlying[page];
+	return 0;
+}
+
+bool bus_read_has_side_effects(const Bus* bus, const uint16_t addr)
+{
+	const Bus_device* device = bus->underlying[addr >> 8];
+	if (!device) device = find_device(bus, addr);
+	return !device || !device->read || device->read_has_side_effects;
+}
+
+int bus_get_access_counts(const Bus* bus, Bus_access_count* counts, int max)
+{
+#ifdef PERF_COUNTERS
+	if (!bus || !bus->islocked) return 0;
+
+	int count = bus->registry.count < max ? bus->registry.count : max;
+	for (int i = 0; i < count; i++)
 	{
-		log_warn("Attempted write at address 0x%04x on %s bus, but device has no response", addr, bus->name);
-		return;
+		counts[i].name = bus->registry.bus_device_array_List[i].name;
+		counts[i].reads = bus->reads[i];
+		counts[i].writes = bus->writes[i];
 	}
-
-	device->write(addr, data);
+	return count;
+#else
+	(void)bus; (void)counts; (void)max;
+	return 0;
+#endif
 }
 
 void free_buses()
@@ -211,6 +326,12 @@ void free_buses()
 	bus_6502.islocked = false;
 	bus_ppu.islocked = false;
 
+	//the page tables point into the registries being freed
+	memset((void*)bus_6502.pages, 0, sizeof(bus_6502.pages));
+	memset(bus_6502.underlying, 0, sizeof(bus_6502.underlying));
+	memset((void*)bus_ppu.pages, 0, sizeof(bus_ppu.pages));
+	memset(bus_ppu.underlying, 0, sizeof(bus_ppu.underlying));
+
 	if (bus_6502.registry.bus_device_array_List)
 	{
 		free(bus_6502.registry.bus_device_array_List);
@@ -226,5 +347,11 @@ void free_buses()
 		bus_ppu.registry.count = 0;
 	}
 
+#ifdef PERF_COUNTERS
+	free(bus_6502.reads);
+	free(bus_ppu.reads);
+	bus_6502.reads = bus_6502.writes = NULL;
+	bus_ppu.reads = bus_ppu.writes = NULL;
+#endif
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct Bus_device Bus_device;
 typedef struct Bus Bus;
@@ -45,6 +46,37 @@ uint8_t read_bus_at_address(const Bus* bus, const uint16_t addr);
 */
 void write_bus_at_address(const Bus* bus, const uint16_t addr, const uint8_t data);
 
+/*
+ swaps the device that answers for one 256 byte page of a locked bus, passing NULL restores the normal device.
+ the overlay sees every access to the page so it is expected to forward to bus_read_underlying/bus_write_underlying,
+ this is how watchpoints trap accesses without adding any cost to pages that are not watched.
+ returns -1 if the bus is not locked
+*/
+int bus_set_page_overlay(Bus* bus, uint8_t page, const Bus_device* overlay);
+
+//same as read_bus_at_address/write_bus_at_address but ignoring any page overlay
+uint8_t bus_read_underlying(const Bus* bus, const uint16_t addr);
+void bus_write_underlying(const Bus* bus, const uint16_t addr, const uint8_t data);
+
+/*
+ true if reading addr would change device state (ppu registers), or there is nothing there,
+ anything that wants to peek at a value without disturbing emulation checks this first
+*/
+bool bus_read_has_side_effects(const Bus* bus, const uint16_t addr);
+
+typedef struct {
+	const char* name;
+	uint64_t reads;
+	uint64_t writes;
+}Bus_access_count;
+
+/*
+ copies out how many reads and writes each device on a locked bus has answered since it was locked,
+ accesses through a page overlay are counted against the device underneath.
+ returns how many devices were written to counts, always 0 unless built with PERF_COUNTERS
+*/
+int bus_get_access_counts(const Bus* bus, Bus_access_count* counts, int max);
+
 /*
  frees any allocated memory on the buses can be done before and after a registry lock,
  it will unlock the registry after
@@ -62,4 +94,5 @@ struct Bus_device {
 
 	bus_read_fn read; //if NULL then device does not respond will read back 0xFF, attempt may be logged
 	bus_write_fn write; //if NULL then device does not respond, attempt may be logged
+	bool read_has_side_effects; //set if a read changes device state so debugging tools must not peek at it
 };
\ No newline at end of file
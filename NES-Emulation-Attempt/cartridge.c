@@ -1,5 +1,7 @@
 #include "cartridge.h"
 #include "logger.h"
+#include "diagnostics.h"
+#include "ppu.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <malloc.h>
@@ -14,6 +16,8 @@ uint8_t* chr_rom = NULL;
 
 Nt_mirroring_mode nametable_mirroring = VERTICAL;
 
+static uint32_t prg_generation = 0;
+
 static bool mapper_0_cpu_map(uint16_t* addr);
 
 /*
@@ -31,7 +35,7 @@ static uint8_t read(uint16_t addr)
 			if (!mapper_0_cpu_map(&addr)) return 0xFF;
 			return prg_rom[addr];
 		default:
-			log_critical("the mapper %d is unimplemented cartridge read is not possible defaulting to 0xFF", mapperId);
+			diag_critical(addr, "the mapper %d is unimplemented cartridge read at 0x%04X is not possible defaulting to 0xFF", mapperId, addr);
 			return 0xFF;
 		}
 	}
@@ -44,7 +48,7 @@ static uint8_t read(uint16_t addr)
 			addr &= 0x1FFF;
 			return chr_rom[addr];
 		default:
-			log_critical("the mapper %d is unimplemented cartridge read is not possible defaulting to 0xFF", mapperId);
+			diag_critical(addr, "the mapper %d is unimplemented cartridge read at 0x%04X is not possible defaulting to 0xFF", mapperId, addr);
 		}
 	}
 }
@@ -115,9 +119,11 @@ int insert_cartridge(const char* file)
 	}header;
 
 	fread(&header, sizeof(header), 1, nes_file);
+	prg_generation++;
 
 	mapperId = header.flag7&0xF0 | (header.flag6 & 0xFF)>>4;
-	nametable_mirroring = (header.flag6 & 0x01 ? VERTICAL : HORISONTAL);
+	if (header.flag6 & 0x08) set_mirroring_mode(FOUR_SCREEN);
+	else set_mirroring_mode(header.flag6 & 0x01 ? VERTICAL : HORISONTAL);
 	prg_rom = malloc(header.prgBanks*16384);
 	if (!prg_rom) return -1;
 
@@ -147,6 +153,7 @@ int insert_cartridge(const char* file)
 
 void remove_cartridge()
 {
+	prg_generation++;
 	if (prg_rom)
 	{
 		free(prg_rom);
@@ -164,6 +171,30 @@ Nt_mirroring_mode current_mirroring_mode()
 	return nametable_mirroring;
 }
 
+void set_mirroring_mode(Nt_mirroring_mode mode)
+{
+	nametable_mirroring = mode;
+	ppu_map_nametables(mode);
+}
+
+//mapper 0 has the same rom at $8000-$FFFF for as long as the cartridge is in
+uint16_t cartridge_prg_bank(uint16_t addr)
+{
+	(void)addr;
+	return 0;
+}
+
+const uint8_t* cartridge_prg_window(uint16_t addr)
+{
+	if (mapperId != 0 || !prg_rom || !mapper_0_cpu_map(&addr)) return NULL;
+	return prg_rom + (addr & ~0x1FFF);
+}
+
+uint32_t cartridge_prg_generation()
+{
+	return prg_generation;
+}
+
 Bus_device* get_cartridge_device()
 {
 	return &cartridge_device;
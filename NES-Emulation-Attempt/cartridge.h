@@ -4,10 +4,26 @@
 typedef enum {
 	VERTICAL,
 	HORISONTAL,
+	SINGLE_SCREEN_LOWER, //all four nametables are the first 1k of ram
+	SINGLE_SCREEN_UPPER, //all four are the second 1k
+	FOUR_SCREEN, //the cartridge has another 2k so each nametable is its own
 }Nt_mirroring_mode;
 
 int insert_cartridge(const char* file);
 void remove_cartridge();
 Bus_device* get_cartridge_device();
 Bus_device* get_ppu_cartridge_device();
-Nt_mirroring_mode current_mirroring_mode();
\ No newline at end of file
+Nt_mirroring_mode current_mirroring_mode();
+
+//for mappers that switch mirroring at runtime, also used by the benchmarks to try both
+void set_mirroring_mode(Nt_mirroring_mode mode);
+
+/*
+ which prg bank is mapped at addr ($8000-$FFFF), the generation goes up whenever a cartridge is inserted, removed
+ or a bank switch maps different rom in. together they let the cpu cache decoded code from rom
+*/
+uint16_t cartridge_prg_bank(uint16_t addr);
+uint32_t cartridge_prg_generation();
+
+//the 8k of rom mapped at the window holding addr so window[addr & 0x1FFF] is what the cpu reads, NULL if it is not plain rom
+const uint8_t* cartridge_prg_window(uint16_t addr);
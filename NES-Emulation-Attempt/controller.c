@@ -0,0 +1,48 @@
+#include "controller.h"
+#include <stdbool.h>
+
+static volatile uint8_t buttons[2];
+static uint8_t shifters[2];
+static bool strobe = false;
+
+static uint8_t read(uint16_t addr)
+{
+	int port = addr & 1;
+
+	//while strobe is held the shifter keeps reloading so only A is ever seen
+	if (strobe) return buttons[port] & BUTTON_A;
+
+	uint8_t bit = shifters[port] & 1;
+	//an official controller returns 1 once all 8 buttons have been read
+	shifters[port] = (shifters[port] >> 1) | 0x80;
+	return bit;
+}
+
+static void write(uint16_t addr, uint8_t data)
+{
+	//$4017 writes belong to the apu frame counter which isn't emulated
+	if (addr != 0x4016) return;
+
+	strobe = data & 1;
+	shifters[0] = buttons[0];
+	shifters[1] = buttons[1];
+}
+
+Bus_device controller_device = {
+	.name = "CONTROLLER",
+	.start_range = 0x4016,
+	.end_range = 0x4017,
+	.read = read,
+	.write = write,
+	.read_has_side_effects = true, //reading shifts the next button out
+};
+
+Bus_device* get_controller_device()
+{
+	return &controller_device;
+}
+
+void set_controller_buttons(int port, uint8_t pressed)
+{
+	buttons[port & 1] = pressed;
+}
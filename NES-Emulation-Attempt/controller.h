@@ -0,0 +1,24 @@
+#pragma once
+#include "bus.h"
+
+//bit order the controller shifts them out in
+typedef enum {
+	BUTTON_A = (1 << 0),
+	BUTTON_B = (1 << 1),
+	BUTTON_SELECT = (1 << 2),
+	BUTTON_START = (1 << 3),
+	BUTTON_UP = (1 << 4),
+	BUTTON_DOWN = (1 << 5),
+	BUTTON_LEFT = (1 << 6),
+	BUTTON_RIGHT = (1 << 7),
+}Controller_button;
+
+/*
+ the standard controller at $4016/$4017. a read returns each of the 8 buttons in turn then 1 like an official
+ controller does, so games see one plugged in with nothing held rather than the 0 the unmapped ports used to read.
+ $4016 writes strobe both ports, $4017 writes belong to the apu frame counter and are dropped without being logged
+*/
+Bus_device* get_controller_device();
+
+//buttons currently held on port 0 or 1, picked up the next time the game strobes $4016
+void set_controller_buttons(int port, uint8_t buttons);
@@ -0,0 +1,76 @@
+/*
+ not a normal header, 6502.c includes it once per emulation profile (see Nes_profile in nes.h) to build that
+ profile's clock. CPU_CLOCK and CPU_EXECUTE name the functions and CPU_ACCURATE picks the timing:
+  0 - the whole instruction happens on its first cycle and the rest are counted down,
+      it can come from a predecoded block, the idle loop skip or the jit
+  1 - the opcode is fetched on the first cycle and everything else happens on the last base cycle,
+      along with the dummy reads and writes the real cpu makes to registers
+*/
+
+//addressing and operation of the opcode that was just fetched
+static void CPU_EXECUTE()
+{
+	operand_prefetched = false;
+
+	uint8_t additional_cycle1 = lookup[opcode >> 4 & 0xF][opcode & 0xF].address_mode();
+#ifdef CPU_TRACE
+	if (cpu_trace_active) current_trace_record->addr = addr_abs;
+#endif
+#if CPU_ACCURATE
+	dummy_accesses(additional_cycle1);
+#endif
+	uint8_t additional_cycle2 = lookup[opcode >> 4 & 0xF][opcode & 0xF].operate();
+
+	cycles += (additional_cycle1 & additional_cycle2);
+}
+
+void CPU_CLOCK()
+{
+	if (cycles == 0)
+	{
+#if !CPU_ACCURATE
+		if (idle_loop_armed && skip_idle_loop())
+		{
+			cycles--;
+			return;
+		}
+
+		if (jit_enabled && run_jit())
+		{
+			cycles--;
+			return;
+		}
+#endif
+
+		update_direct_memory();
+		instruction_pc = pc;
+#if CPU_ACCURATE
+		fetch_opcode();
+		instruction_pending = true;
+#else
+		const Decoded_instruction* decoded = debugging_active() ? NULL : next_decoded_instruction();
+		if (decoded)
+		{
+			run_decoded_instruction(decoded);
+		}
+		else
+		{
+			fetch_opcode();
+			CPU_EXECUTE();
+		}
+		finish_instruction();
+#endif
+	}
+
+#if CPU_ACCURATE
+	//the last base cycle, page crossing and branch cycles are counted after it
+	if (instruction_pending && cycles == 1)
+	{
+		instruction_pending = false;
+		CPU_EXECUTE();
+		finish_instruction();
+	}
+#endif
+
+	cycles--;
+}
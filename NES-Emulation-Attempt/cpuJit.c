@@ -0,0 +1,1286 @@
+#include "cpuJit.h"
+#include "cartridge.h"
+#include "ram.h"
+#include "platform.h"
+#include "logger.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_JIT_X64
+#endif
+
+static Cpu_jit_stats stats;
+
+#ifdef CPU_JIT_X64
+
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCK_CODE (32 * 1024) //a block never needs more than this, checked before compiling
+#define JIT_BLOCK_COUNT 4096 //power of two
+#define JIT_MAX_INSTRUCTIONS 32
+#define JIT_HOT_THRESHOLD 16 //times a block start is reached before it is compiled
+#define JIT_MAX_LABELS 512
+#define JIT_MAX_FIXUPS 1024
+
+//everything the generated code reads and writes, rbx points at it the whole time a block runs
+typedef struct {
+	uint8_t* ram;
+	const uint8_t* prg[4]; //8k windows at $8000, $A000, $C000, $E000, NULL if not plain rom
+	uint32_t a, x, y, status, sp, pc;
+	uint32_t cycles;
+	uint32_t instructions;
+	uint32_t ram_code_pages;
+	uint32_t side_exit;
+}Jit_context;
+
+typedef void (*Jit_code)(Jit_context* context);
+
+typedef struct {
+	bool valid;
+	uint16_t pc;
+	uint16_t bank;
+	uint16_t max_cycles;
+	Jit_code code; //NULL when not even the first instruction could be compiled
+}Jit_block;
+
+static Jit_block blocks[JIT_BLOCK_COUNT];
+static uint8_t heat[0x8000];
+static uint8_t* code_memory = NULL;
+static uint32_t code_used = 0;
+static uint32_t generation = 0;
+static bool initialised = false;
+
+typedef enum {
+	JIT_UNSUPPORTED, //zero so every opcode missing from the table is unsupported
+	JIT_LDA, JIT_LDX, JIT_LDY, JIT_STA, JIT_STX, JIT_STY,
+	JIT_ADC, JIT_SBC, JIT_AND, JIT_ORA, JIT_EOR, JIT_CMP, JIT_CPX, JIT_CPY, JIT_BIT,
+	JIT_INC, JIT_DEC, JIT_ASL, JIT_LSR, JIT_ROL, JIT_ROR,
+	JIT_INX, JIT_INY, JIT_DEX, JIT_DEY, JIT_TAX, JIT_TAY, JIT_TXA, JIT_TYA, JIT_TSX, JIT_TXS,
+	JIT_CLC, JIT_SEC, JIT_CLI, JIT_SEI, JIT_CLD, JIT_SED, JIT_CLV, JIT_NOP,
+	JIT_PHA, JIT_PLA, JIT_PHP, JIT_PLP, JIT_JMP, JIT_JSR, JIT_RTS,
+	JIT_BPL, JIT_BMI, JIT_BVC, JIT_BVS, JIT_BCC, JIT_BCS, JIT_BNE, JIT_BEQ,
+}Jit_kind;
+
+typedef enum {
+	MODE_NONE, MODE_ACC, MODE_IMM, MODE_ZP0, MODE_ZPX, MODE_ZPY, MODE_ABS,
+	MODE_ABX, MODE_ABY, MODE_IND, MODE_IZX, MODE_IZY, MODE_REL,
+}Jit_mode;
+
+typedef struct {
+	uint8_t kind;
+	uint8_t mode;
+}Jit_opcode;
+
+//the official opcodes, anything missing (including brk and rti) ends the block
+static const Jit_opcode opcodes[256] = {
+	[0x69] = {JIT_ADC, MODE_IMM}, [0x65] = {JIT_ADC, MODE_ZP0}, [0x75] = {JIT_ADC, MODE_ZPX}, [0x6D] = {JIT_ADC, MODE_ABS},
+	[0x7D] = {JIT_ADC, MODE_ABX}, [0x79] = {JIT_ADC, MODE_ABY}, [0x61] = {JIT_ADC, MODE_IZX}, [0x71] = {JIT_ADC, MODE_IZY},
+	[0x29] = {JIT_AND, MODE_IMM}, [0x25] = {JIT_AND, MODE_ZP0}, [0x35] = {JIT_AND, MODE_ZPX}, [0x2D] = {JIT_AND, MODE_ABS},
+	[0x3D] = {JIT_AND, MODE_ABX}, [0x39] = {JIT_AND, MODE_ABY}, [0x21] = {JIT_AND, MODE_IZX}, [0x31] = {JIT_AND, MODE_IZY},
+	[0x0A] = {JIT_ASL, MODE_ACC}, [0x06] = {JIT_ASL, MODE_ZP0}, [0x16] = {JIT_ASL, MODE_ZPX}, [0x0E] = {JIT_ASL, MODE_ABS},
+	[0x1E] = {JIT_ASL, MODE_ABX},
+	[0x24] = {JIT_BIT, MODE_ZP0}, [0x2C] = {JIT_BIT, MODE_ABS},
+	[0x10] = {JIT_BPL, MODE_REL}, [0x30] = {JIT_BMI, MODE_REL}, [0x50] = {JIT_BVC, MODE_REL}, [0x70] = {JIT_BVS, MODE_REL},
+	[0x90] = {JIT_BCC, MODE_REL}, [0xB0] = {JIT_BCS, MODE_REL}, [0xD0] = {JIT_BNE, MODE_REL}, [0xF0] = {JIT_BEQ, MODE_REL},
+	[0x18] = {JIT_CLC, MODE_NONE}, [0xD8] = {JIT_CLD, MODE_NONE}, [0x58] = {JIT_CLI, MODE_NONE}, [0xB8] = {JIT_CLV, MODE_NONE},
+	[0x38] = {JIT_SEC, MODE_NONE}, [0xF8] = {JIT_SED, MODE_NONE}, [0x78] = {JIT_SEI, MODE_NONE},
+	[0xC9] = {JIT_CMP, MODE_IMM}, [0xC5] = {JIT_CMP, MODE_ZP0}, [0xD5] = {JIT_CMP, MODE_ZPX}, [0xCD] = {JIT_CMP, MODE_ABS},
+	[0xDD] = {JIT_CMP, MODE_ABX}, [0xD9] = {JIT_CMP, MODE_ABY}, [0xC1] = {JIT_CMP, MODE_IZX}, [0xD1] = {JIT_CMP, MODE_IZY},
+	[0xE0] = {JIT_CPX, MODE_IMM}, [0xE4] = {JIT_CPX, MODE_ZP0}, [0xEC] = {JIT_CPX, MODE_ABS},
+	[0xC0] = {JIT_CPY, MODE_IMM}, [0xC4] = {JIT_CPY, MODE_ZP0}, [0xCC] = {JIT_CPY, MODE_ABS},
+	[0xC6] = {JIT_DEC, MODE_ZP0}, [0xD6] = {JIT_DEC, MODE_ZPX}, [0xCE] = {JIT_DEC, MODE_ABS}, [0xDE] = {JIT_DEC, MODE_ABX},
+	[0xCA] = {JIT_DEX, MODE_NONE}, [0x88] = {JIT_DEY, MODE_NONE},
+	[0x49] = {JIT_EOR, MODE_IMM}, [0x45] = {JIT_EOR, MODE_ZP0}, [0x55] = {JIT_EOR, MODE_ZPX}, [0x4D] = {JIT_EOR, MODE_ABS},
+	[0x5D] = {JIT_EOR, MODE_ABX}, [0x59] = {JIT_EOR, MODE_ABY}, [0x41] = {JIT_EOR, MODE_IZX}, [0x51] = {JIT_EOR, MODE_IZY},
+	[0xE6] = {JIT_INC, MODE_ZP0}, [0xF6] = {JIT_INC, MODE_ZPX}, [0xEE] = {JIT_INC, MODE_ABS}, [0xFE] = {JIT_INC, MODE_ABX},
+	[0xE8] = {JIT_INX, MODE_NONE}, [0xC8] = {JIT_INY, MODE_NONE},
+	[0x4C] = {JIT_JMP, MODE_ABS}, [0x6C] = {JIT_JMP, MODE_IND}, [0x20] = {JIT_JSR, MODE_ABS},
+	[0xA9] = {JIT_LDA, MODE_IMM}, [0xA5] = {JIT_LDA, MODE_ZP0}, [0xB5] = {JIT_LDA, MODE_ZPX}, [0xAD] = {JIT_LDA, MODE_ABS},
+	[0xBD] = {JIT_LDA, MODE_ABX}, [0xB9] = {JIT_LDA, MODE_ABY}, [0xA1] = {JIT_LDA, MODE_IZX}, [0xB1] = {JIT_LDA, MODE_IZY},
+	[0xA2] = {JIT_LDX, MODE_IMM}, [0xA6] = {JIT_LDX, MODE_ZP0}, [0xB6] = {JIT_LDX, MODE_ZPY}, [0xAE] = {JIT_LDX, MODE_ABS},
+	[0xBE] = {JIT_LDX, MODE_ABY},
+	[0xA0] = {JIT_LDY, MODE_IMM}, [0xA4] = {JIT_LDY, MODE_ZP0}, [0xB4] = {JIT_LDY, MODE_ZPX}, [0xAC] = {JIT_LDY, MODE_ABS},
+	[0xBC] = {JIT_LDY, MODE_ABX},
+	[0x4A] = {JIT_LSR, MODE_ACC}, [0x46] = {JIT_LSR, MODE_ZP0}, [0x56] = {JIT_LSR, MODE_ZPX}, [0x4E] = {JIT_LSR, MODE_ABS},
+	[0x5E] = {JIT_LSR, MODE_ABX},
+	[0xEA] = {JIT_NOP, MODE_NONE},
+	[0x09] = {JIT_ORA, MODE_IMM}, [0x05] = {JIT_ORA, MODE_ZP0}, [0x15] = {JIT_ORA, MODE_ZPX}, [0x0D] = {JIT_ORA, MODE_ABS},
+	[0x1D] = {JIT_ORA, MODE_ABX}, [0x19] = {JIT_ORA, MODE_ABY}, [0x01] = {JIT_ORA, MODE_IZX}, [0x11] = {JIT_ORA, MODE_IZY},
+	[0x48] = {JIT_PHA, MODE_NONE}, [0x08] = {JIT_PHP, MODE_NONE}, [0x68] = {JIT_PLA, MODE_NONE}, [0x28] = {JIT_PLP, MODE_NONE},
+	[0x2A] = {JIT_ROL, MODE_ACC}, [0x26] = {JIT_ROL, MODE_ZP0}, [0x36] = {JIT_ROL, MODE_ZPX}, [0x2E] = {JIT_ROL, MODE_ABS},
+	[0x3E] = {JIT_ROL, MODE_ABX},
+	[0x6A] = {JIT_ROR, MODE_ACC}, [0x66] = {JIT_ROR, MODE_ZP0}, [0x76] = {JIT_ROR, MODE_ZPX}, [0x6E] = {JIT_ROR, MODE_ABS},
+	[0x7E] = {JIT_ROR, MODE_ABX},
+	[0x60] = {JIT_RTS, MODE_NONE},
+	[0xE9] = {JIT_SBC, MODE_IMM}, [0xE5] = {JIT_SBC, MODE_ZP0}, [0xF5] = {JIT_SBC, MODE_ZPX}, [0xED] = {JIT_SBC, MODE_ABS},
+	[0xFD] = {JIT_SBC, MODE_ABX}, [0xF9] = {JIT_SBC, MODE_ABY}, [0xE1] = {JIT_SBC, MODE_IZX}, [0xF1] = {JIT_SBC, MODE_IZY},
+	[0x85] = {JIT_STA, MODE_ZP0}, [0x95] = {JIT_STA, MODE_ZPX}, [0x8D] = {JIT_STA, MODE_ABS}, [0x9D] = {JIT_STA, MODE_ABX},
+	[0x99] = {JIT_STA, MODE_ABY}, [0x81] = {JIT_STA, MODE_IZX}, [0x91] = {JIT_STA, MODE_IZY},
+	[0x86] = {JIT_STX, MODE_ZP0}, [0x96] = {JIT_STX, MODE_ZPY}, [0x8E] = {JIT_STX, MODE_ABS},
+	[0x84] = {JIT_STY, MODE_ZP0}, [0x94] = {JIT_STY, MODE_ZPX}, [0x8C] = {JIT_STY, MODE_ABS},
+	[0xAA] = {JIT_TAX, MODE_NONE}, [0xA8] = {JIT_TAY, MODE_NONE}, [0xBA] = {JIT_TSX, MODE_NONE}, [0x8A] = {JIT_TXA, MODE_NONE},
+	[0x9A] = {JIT_TXS, MODE_NONE}, [0x98] = {JIT_TYA, MODE_NONE},
+};
+
+typedef struct {
+	uint16_t pc;
+	uint16_t operand; //address, pointer, immediate or branch target
+	uint8_t kind;
+	uint8_t mode;
+	uint8_t length;
+	uint8_t cycles; //base cycles, the same (transposed) ones the interpreter uses
+	uint8_t value; //rom byte for reads of a fixed rom address
+	uint16_t jump_target; //JMP ($xxxx) through a pointer in rom
+}Jit_op;
+
+//the interpreter handlers that return 1, only they take the extra cycle when an indexed address crosses a page
+static bool takes_page_cycle(Jit_kind kind)
+{
+	return kind == JIT_ADC || kind == JIT_SBC || kind == JIT_AND || kind == JIT_ORA || kind == JIT_EOR
+		|| kind == JIT_CMP || kind == JIT_LDA || kind == JIT_LDX || kind == JIT_LDY;
+}
+
+static bool is_store(Jit_kind kind)
+{
+	return kind == JIT_STA || kind == JIT_STX || kind == JIT_STY;
+}
+
+static bool is_read_modify_write(Jit_kind kind)
+{
+	return kind == JIT_INC || kind == JIT_DEC || kind == JIT_ASL || kind == JIT_LSR || kind == JIT_ROL || kind == JIT_ROR;
+}
+
+static bool is_branch(Jit_kind kind)
+{
+	return kind >= JIT_BPL && kind <= JIT_BEQ;
+}
+
+//code and operands are only ever taken from rom so they cannot change until a bank switch flushes everything
+static bool rom_byte(uint16_t addr, uint8_t* value)
+{
+	const uint8_t* window = cartridge_prg_window(addr);
+	if (!window) return false;
+	*value = window[addr & 0x1FFF];
+	return true;
+}
+
+static int instruction_length(Jit_mode mode)
+{
+	switch (mode)
+	{
+	case MODE_NONE: case MODE_ACC: return 1;
+	case MODE_ABS: case MODE_ABX: case MODE_ABY: case MODE_IND: return 3;
+	default: return 2;
+	}
+}
+
+//returns false for anything that has to stay with the interpreter
+static bool decode_op(uint16_t pc, Jit_op* op)
+{
+	uint8_t opcode;
+	if (pc < 0x8000 || !rom_byte(pc, &opcode)) return false;
+	Jit_opcode description = opcodes[opcode];
+	if (description.kind == JIT_UNSUPPORTED) return false;
+
+	op->pc = pc;
+	op->kind = description.kind;
+	op->mode = description.mode;
+	op->length = (uint8_t)instruction_length(description.mode);
+	op->cycles = cpu6502_opcode_cycles(opcode);
+	if ((uint32_t)pc + op->length - 1 > 0xFFFF) return false;
+
+	uint8_t low = 0, high = 0;
+	if (op->length > 1 && !rom_byte((uint16_t)(pc + 1), &low)) return false;
+	if (op->length > 2 && !rom_byte((uint16_t)(pc + 2), &high)) return false;
+	op->operand = (uint16_t)(low | (high << 8));
+
+	if (op->mode == MODE_REL)
+	{
+		uint16_t next = (uint16_t)(pc + 2);
+		op->operand = (uint16_t)(next + (int8_t)low);
+	}
+
+	//a fixed address has to be plain ram or (for reads) rom, the interpreter keeps everything else on its real cycle
+	if (op->mode == MODE_ABS && op->kind != JIT_JMP && op->kind != JIT_JSR)
+	{
+		if (op->operand < 0x2000) return true;
+		if (op->operand < 0x8000 || is_store(op->kind) || is_read_modify_write(op->kind)) return false;
+		return rom_byte(op->operand, &op->value);
+	}
+
+	if (op->mode == MODE_IND && op->operand >= 0x2000)
+	{
+		//the pointer's high byte comes from the start of the page when the low byte is at its end
+		uint16_t high_addr = (op->operand & 0x00FF) == 0x00FF ? op->operand & 0xFF00 : (uint16_t)(op->operand + 1);
+		uint8_t target_low, target_high;
+		if (!rom_byte(op->operand, &target_low) || !rom_byte(high_addr, &target_high)) return false;
+		op->jump_target = (uint16_t)(target_low | (target_high << 8));
+	}
+	return true;
+}
+
+static bool ends_block(const Jit_op* op)
+{
+	return is_branch(op->kind) || op->kind == JIT_JMP || op->kind == JIT_JSR || op->kind == JIT_RTS;
+}
+
+/*
+ x86-64 encoding, only the handful of forms the blocks need.
+ all the 6502 state is in registers that calls would preserve in both the windows and system v conventions
+ so a block is the same on either, only the register the context arrives in differs
+*/
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define REG_A R12
+#define REG_X R13
+#define REG_Y R14
+#define REG_NZ R15 //n and z as the value they came from, z is bits 0-15 all clear (some results are 9 bits)
+#define REG_P RBP //status with whatever n and z were before they became lazy
+#define REG_CONTEXT RBX
+
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+enum { SHIFT_SHL = 4, SHIFT_SHR = 5 };
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5 };
+
+#define CONTEXT(field) ((int32_t)offsetof(Jit_context, field))
+
+typedef struct {
+	uint16_t pc;
+	uint32_t cycles;
+	uint32_t instructions;
+	bool nz_lazy;
+	int label;
+}Jit_side_exit;
+
+typedef struct {
+	uint8_t* code;
+	uint32_t size;
+	uint32_t capacity;
+	bool overflow;
+
+	int label_count;
+	uint32_t labels[JIT_MAX_LABELS];
+	int fixup_count;
+	struct {
+		uint32_t at;
+		int label;
+	}fixups[JIT_MAX_FIXUPS];
+
+	//state at the instruction being compiled
+	bool nz_lazy;
+	uint32_t cycles; //base cycles of the instructions before this one
+	uint32_t instructions;
+	int side_exit; //label of this instruction's side exit, -1 until something needs it
+	int epilogue;
+	int side_exit_count;
+	Jit_side_exit side_exits[JIT_MAX_INSTRUCTIONS];
+}Emitter;
+
+static void emit8(Emitter* e, uint8_t value)
+{
+	if (e->size >= e->capacity) {
+		e->overflow = true;
+		return;
+	}
+	e->code[e->size++] = value;
+}
+
+static void emit32(Emitter* e, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) emit8(e, (uint8_t)(value >> (i * 8)));
+}
+
+//byte register forms need a rex to get spl-dil instead of ah-bh, so they always have one
+static void emit_rex(Emitter* e, bool wide, int reg, int index, int base, bool force)
+{
+	uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+	if (rex != 0x40 || force) emit8(e, rex);
+}
+
+static void emit_modrm_reg(Emitter* e, int reg, int rm)
+{
+	emit8(e, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+//[base + index * scale + disp32], index -1 for none
+static void emit_modrm_mem(Emitter* e, int reg, int base, int index, int scale, int32_t disp)
+{
+	if (index < 0 && (base & 7) != RSP)
+	{
+		emit8(e, (uint8_t)(0x80 | (reg & 7) << 3 | (base & 7)));
+	}
+	else
+	{
+		uint8_t scale_bits = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+		emit8(e, (uint8_t)(0x84 | (reg & 7) << 3));
+		emit8(e, (uint8_t)(scale_bits << 6 | (index < 0 ? RSP : index & 7) << 3 | (base & 7)));
+	}
+	emit32(e, (uint32_t)disp);
+}
+
+static void mov_ri(Emitter* e, int reg, uint32_t value)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, (uint8_t)(0xB8 + (reg & 7)));
+	emit32(e, value);
+}
+
+//two register forms of mov (0x89), add, or, and, sub, xor, cmp and test, dst is the r/m operand
+static void op_rr(Emitter* e, uint8_t opcode, int dst, int src)
+{
+	emit_rex(e, false, src, 0, dst, false);
+	emit8(e, opcode);
+	emit_modrm_reg(e, src, dst);
+}
+
+#define MOV_RR(e, dst, src) op_rr(e, 0x89, dst, src)
+#define ADD_RR(e, dst, src) op_rr(e, 0x01, dst, src)
+#define OR_RR(e, dst, src) op_rr(e, 0x09, dst, src)
+#define AND_RR(e, dst, src) op_rr(e, 0x21, dst, src)
+#define SUB_RR(e, dst, src) op_rr(e, 0x29, dst, src)
+#define XOR_RR(e, dst, src) op_rr(e, 0x31, dst, src)
+#define CMP_RR(e, dst, src) op_rr(e, 0x39, dst, src)
+
+static void alu_ri(Emitter* e, int operation, int reg, uint32_t value)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, 0x81);
+	emit_modrm_reg(e, operation, reg);
+	emit32(e, value);
+}
+
+static void test_ri(Emitter* e, int reg, uint32_t value)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, 0xF7);
+	emit_modrm_reg(e, 0, reg);
+	emit32(e, value);
+}
+
+static void shift_ri(Emitter* e, int operation, int reg, uint8_t count)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, 0xC1);
+	emit_modrm_reg(e, operation, reg);
+	emit8(e, count);
+}
+
+//movzx dst, byte [base + index + disp]
+static void load8(Emitter* e, int dst, int base, int index, int32_t disp)
+{
+	emit_rex(e, false, dst, index < 0 ? 0 : index, base, false);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit_modrm_mem(e, dst, base, index, 1, disp);
+}
+
+//mov byte [base + index + disp], src
+static void store8(Emitter* e, int src, int base, int index, int32_t disp)
+{
+	emit_rex(e, false, src, index < 0 ? 0 : index, base, true);
+	emit8(e, 0x88);
+	emit_modrm_mem(e, src, base, index, 1, disp);
+}
+
+static void load32(Emitter* e, int dst, int base, int32_t disp)
+{
+	emit_rex(e, false, dst, 0, base, false);
+	emit8(e, 0x8B);
+	emit_modrm_mem(e, dst, base, -1, 1, disp);
+}
+
+static void store32(Emitter* e, int src, int base, int32_t disp)
+{
+	emit_rex(e, false, src, 0, base, false);
+	emit8(e, 0x89);
+	emit_modrm_mem(e, src, base, -1, 1, disp);
+}
+
+static void load64(Emitter* e, int dst, int base, int index, int scale, int32_t disp)
+{
+	emit_rex(e, true, dst, index < 0 ? 0 : index, base, false);
+	emit8(e, 0x8B);
+	emit_modrm_mem(e, dst, base, index, scale, disp);
+}
+
+static void add_mi(Emitter* e, int base, int32_t disp, uint32_t value)
+{
+	emit_rex(e, false, 0, 0, base, false);
+	emit8(e, 0x81);
+	emit_modrm_mem(e, ALU_ADD, base, -1, 1, disp);
+	emit32(e, value);
+}
+
+static void add_mr(Emitter* e, int base, int32_t disp, int src)
+{
+	emit_rex(e, false, src, 0, base, false);
+	emit8(e, 0x01);
+	emit_modrm_mem(e, src, base, -1, 1, disp);
+}
+
+static void test_mi8(Emitter* e, int base, int32_t disp, uint8_t value)
+{
+	emit_rex(e, false, 0, 0, base, false);
+	emit8(e, 0xF6);
+	emit_modrm_mem(e, 0, base, -1, 1, disp);
+	emit8(e, value);
+}
+
+//dst = (cc ? 1 : 0)
+static void setcc(Emitter* e, uint8_t cc, int dst)
+{
+	emit_rex(e, false, 0, 0, dst, true);
+	emit8(e, 0x0F);
+	emit8(e, (uint8_t)(0x90 + cc));
+	emit_modrm_reg(e, 0, dst);
+	emit_rex(e, false, dst, 0, dst, true);
+	emit8(e, 0x0F);
+	emit8(e, 0xB6);
+	emit_modrm_reg(e, dst, dst);
+}
+
+static void bt_rr(Emitter* e, int reg, int bit)
+{
+	emit_rex(e, false, bit, 0, reg, false);
+	emit8(e, 0x0F);
+	emit8(e, 0xA3);
+	emit_modrm_reg(e, bit, reg);
+}
+
+static void test64_rr(Emitter* e, int reg)
+{
+	emit_rex(e, true, reg, 0, reg, false);
+	emit8(e, 0x85);
+	emit_modrm_reg(e, reg, reg);
+}
+
+static void push(Emitter* e, int reg)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, (uint8_t)(0x50 + (reg & 7)));
+}
+
+static void pop(Emitter* e, int reg)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit8(e, (uint8_t)(0x58 + (reg & 7)));
+}
+
+static int new_label(Emitter* e)
+{
+	if (e->label_count >= JIT_MAX_LABELS) {
+		e->overflow = true;
+		return 0;
+	}
+	e->labels[e->label_count] = UINT32_MAX;
+	return e->label_count++;
+}
+
+static void bind(Emitter* e, int label)
+{
+	e->labels[label] = e->size;
+}
+
+static void add_fixup(Emitter* e, int label)
+{
+	if (e->fixup_count >= JIT_MAX_FIXUPS) {
+		e->overflow = true;
+		return;
+	}
+	e->fixups[e->fixup_count].at = e->size;
+	e->fixups[e->fixup_count].label = label;
+	e->fixup_count++;
+	emit32(e, 0);
+}
+
+static void jcc(Emitter* e, uint8_t cc, int label)
+{
+	emit8(e, 0x0F);
+	emit8(e, (uint8_t)(0x80 + cc));
+	add_fixup(e, label);
+}
+
+static void jmp(Emitter* e, int label)
+{
+	emit8(e, 0xE9);
+	add_fixup(e, label);
+}
+
+static void resolve_fixups(Emitter* e)
+{
+	for (int i = 0; i < e->fixup_count && !e->overflow; i++)
+	{
+		uint32_t at = e->fixups[i].at;
+		int32_t relative = (int32_t)(e->labels[e->fixups[i].label] - (at + 4));
+		memcpy(e->code + at, &relative, 4);
+	}
+}
+
+//writes the real n and z into the status register
+static void materialise_nz(Emitter* e)
+{
+	int not_zero = new_label(e);
+	alu_ri(e, ALU_AND, REG_P, ~0x82u);
+	MOV_RR(e, RAX, REG_NZ);
+	alu_ri(e, ALU_AND, RAX, 0x80);
+	OR_RR(e, REG_P, RAX);
+	test_ri(e, REG_NZ, 0xFFFF);
+	jcc(e, CC_NE, not_zero);
+	alu_ri(e, ALU_OR, REG_P, 0x02);
+	bind(e, not_zero);
+}
+
+//pc_in_ecx for targets only known at run time
+static void emit_exit(Emitter* e, bool pc_in_ecx, uint16_t pc, uint32_t cycles, uint32_t instructions, bool nz_lazy, bool side_exit)
+{
+	if (nz_lazy) materialise_nz(e);
+	if (!pc_in_ecx) mov_ri(e, RCX, pc);
+	store32(e, RCX, REG_CONTEXT, CONTEXT(pc));
+	if (cycles) add_mi(e, REG_CONTEXT, CONTEXT(cycles), cycles);
+	add_mi(e, REG_CONTEXT, CONTEXT(instructions), instructions);
+	if (side_exit)
+	{
+		mov_ri(e, RAX, 1);
+		store32(e, RAX, REG_CONTEXT, CONTEXT(side_exit));
+	}
+	jmp(e, e->epilogue);
+}
+
+//leaves the block before the current instruction has changed anything
+static int side_exit(Emitter* e, const Jit_op* op)
+{
+	if (e->side_exit >= 0) return e->side_exit;
+	if (e->side_exit_count >= JIT_MAX_INSTRUCTIONS) {
+		e->overflow = true;
+		return 0;
+	}
+
+	Jit_side_exit* exit = &e->side_exits[e->side_exit_count++];
+	exit->pc = op->pc;
+	exit->cycles = e->cycles;
+	exit->instructions = e->instructions;
+	exit->nz_lazy = e->nz_lazy;
+	exit->label = new_label(e);
+	e->side_exit = exit->label;
+	return exit->label;
+}
+
+//eax = byte at the address in ecx if it is ram or rom, anything else leaves the block
+static void emit_dynamic_read(Emitter* e, const Jit_op* op)
+{
+	int not_ram = new_label(e);
+	int done = new_label(e);
+
+	alu_ri(e, ALU_CMP, RCX, 0x2000);
+	jcc(e, CC_AE, not_ram);
+	load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+	MOV_RR(e, RDX, RCX);
+	alu_ri(e, ALU_AND, RDX, 0x07FF);
+	load8(e, RAX, RAX, RDX, 0);
+	jmp(e, done);
+
+	bind(e, not_ram);
+	alu_ri(e, ALU_CMP, RCX, 0x8000);
+	jcc(e, CC_B, side_exit(e, op));
+	MOV_RR(e, RDX, RCX);
+	shift_ri(e, SHIFT_SHR, RDX, 13);
+	alu_ri(e, ALU_AND, RDX, 3);
+	load64(e, RAX, REG_CONTEXT, RDX, 8, CONTEXT(prg));
+	test64_rr(e, RAX);
+	jcc(e, CC_E, side_exit(e, op));
+	MOV_RR(e, RDX, RCX);
+	alu_ri(e, ALU_AND, RDX, 0x1FFF);
+	load8(e, RAX, RAX, RDX, 0);
+	bind(e, done);
+}
+
+//ecx = the 16 bit pointer at zero page (base + index)
+static void emit_zero_page_pointer(Emitter* e, uint8_t base, int index)
+{
+	load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+	if (index >= 0)
+	{
+		MOV_RR(e, RDX, index);
+		alu_ri(e, ALU_ADD, RDX, base);
+		alu_ri(e, ALU_AND, RDX, 0xFF);
+		load8(e, RCX, RAX, RDX, 0);
+		alu_ri(e, ALU_ADD, RDX, 1);
+		alu_ri(e, ALU_AND, RDX, 0xFF);
+		load8(e, RDX, RAX, RDX, 0);
+	}
+	else
+	{
+		load8(e, RCX, RAX, -1, base);
+		load8(e, RDX, RAX, -1, (uint8_t)(base + 1));
+	}
+	shift_ri(e, SHIFT_SHL, RDX, 8);
+	OR_RR(e, RCX, RDX);
+}
+
+//eax = the operand of a reading instruction, including the extra cycle for a page crossing
+static void emit_read(Emitter* e, const Jit_op* op)
+{
+	bool page_cycle = takes_page_cycle(op->kind);
+	switch (op->mode)
+	{
+	case MODE_ACC:
+		MOV_RR(e, RAX, REG_A);
+		return;
+	case MODE_IMM:
+		mov_ri(e, RAX, op->operand & 0xFF);
+		return;
+	case MODE_ZP0:
+		load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		load8(e, RAX, RAX, -1, op->operand & 0xFF);
+		return;
+	case MODE_ZPX:
+	case MODE_ZPY:
+		MOV_RR(e, RCX, op->mode == MODE_ZPX ? REG_X : REG_Y);
+		alu_ri(e, ALU_ADD, RCX, op->operand & 0xFF);
+		alu_ri(e, ALU_AND, RCX, 0xFF);
+		load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		load8(e, RAX, RAX, RCX, 0);
+		return;
+	case MODE_ABS:
+		if (op->operand >= 0x8000)
+		{
+			mov_ri(e, RAX, op->value);
+			return;
+		}
+		load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		load8(e, RAX, RAX, -1, op->operand & 0x07FF);
+		return;
+	case MODE_ABX:
+	case MODE_ABY:
+	{
+		int index = op->mode == MODE_ABX ? REG_X : REG_Y;
+		mov_ri(e, RCX, op->operand);
+		ADD_RR(e, RCX, index);
+		if (page_cycle)
+		{
+			//crossed when the index reaches the end of the base address's page
+			alu_ri(e, ALU_CMP, index, 0x100 - (op->operand & 0xFF));
+			setcc(e, CC_AE, R8);
+		}
+		alu_ri(e, ALU_AND, RCX, 0xFFFF);
+		break;
+	}
+	case MODE_IZX:
+		emit_zero_page_pointer(e, op->operand & 0xFF, REG_X);
+		break;
+	case MODE_IZY:
+		emit_zero_page_pointer(e, op->operand & 0xFF, -1);
+		MOV_RR(e, RDX, RCX);
+		ADD_RR(e, RCX, REG_Y);
+		if (page_cycle)
+		{
+			MOV_RR(e, R8, RCX);
+			XOR_RR(e, R8, RDX);
+			shift_ri(e, SHIFT_SHR, R8, 8);
+			test_ri(e, R8, 0xFFFFFFFF);
+			setcc(e, CC_NE, R8);
+		}
+		alu_ri(e, ALU_AND, RCX, 0xFFFF);
+		break;
+	default:
+		return;
+	}
+
+	emit_dynamic_read(e, op);
+	if (page_cycle && op->mode != MODE_IZX) add_mr(e, REG_CONTEXT, CONTEXT(cycles), R8);
+}
+
+/*
+ ecx = offset into ram of the operand of a store or read-modify-write.
+ anything outside ram, or ram the interpreter has decoded code in, leaves the block
+*/
+static void emit_ram_address(Emitter* e, const Jit_op* op)
+{
+	switch (op->mode)
+	{
+	case MODE_ZP0:
+		mov_ri(e, RCX, op->operand & 0xFF);
+		break;
+	case MODE_ZPX:
+	case MODE_ZPY:
+		MOV_RR(e, RCX, op->mode == MODE_ZPX ? REG_X : REG_Y);
+		alu_ri(e, ALU_ADD, RCX, op->operand & 0xFF);
+		alu_ri(e, ALU_AND, RCX, 0xFF);
+		break;
+	case MODE_ABS:
+		mov_ri(e, RCX, op->operand & 0x07FF);
+		break;
+	case MODE_ABX:
+	case MODE_ABY:
+	case MODE_IZX:
+	case MODE_IZY:
+		if (op->mode == MODE_ABX || op->mode == MODE_ABY)
+		{
+			mov_ri(e, RCX, op->operand);
+			ADD_RR(e, RCX, op->mode == MODE_ABX ? REG_X : REG_Y);
+		}
+		else
+		{
+			emit_zero_page_pointer(e, op->operand & 0xFF, op->mode == MODE_IZX ? REG_X : -1);
+			if (op->mode == MODE_IZY) ADD_RR(e, RCX, REG_Y);
+		}
+		alu_ri(e, ALU_AND, RCX, 0xFFFF);
+		alu_ri(e, ALU_CMP, RCX, 0x2000);
+		jcc(e, CC_AE, side_exit(e, op));
+		alu_ri(e, ALU_AND, RCX, 0x07FF);
+		break;
+	default:
+		break;
+	}
+
+	MOV_RR(e, RDX, RCX);
+	shift_ri(e, SHIFT_SHR, RDX, 8);
+	load32(e, RAX, REG_CONTEXT, CONTEXT(ram_code_pages));
+	bt_rr(e, RAX, RDX);
+	jcc(e, CC_B, side_exit(e, op));
+}
+
+//the stack is always ram page 1, a push checks it does not hold decoded code before anything changes
+static void emit_stack_check(Emitter* e, const Jit_op* op)
+{
+	test_mi8(e, REG_CONTEXT, CONTEXT(ram_code_pages), 0x02);
+	jcc(e, CC_NE, side_exit(e, op));
+}
+
+static void emit_push(Emitter* e, int value)
+{
+	load32(e, RCX, REG_CONTEXT, CONTEXT(sp));
+	load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+	store8(e, value, RAX, RCX, 0x100);
+	alu_ri(e, ALU_SUB, RCX, 1);
+	alu_ri(e, ALU_AND, RCX, 0xFF);
+	store32(e, RCX, REG_CONTEXT, CONTEXT(sp));
+}
+
+//eax = pulled byte
+static void emit_pull(Emitter* e)
+{
+	load32(e, RCX, REG_CONTEXT, CONTEXT(sp));
+	alu_ri(e, ALU_ADD, RCX, 1);
+	alu_ri(e, ALU_AND, RCX, 0xFF);
+	store32(e, RCX, REG_CONTEXT, CONTEXT(sp));
+	load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+	load8(e, RAX, RAX, RCX, 0x100);
+}
+
+static void set_nz(Emitter* e, int reg)
+{
+	MOV_RR(e, REG_NZ, reg);
+	e->nz_lazy = true;
+}
+
+//carry = bit of eax that was shifted out, eax is clobbered
+static void set_carry_from(Emitter* e, int bit)
+{
+	if (bit) shift_ri(e, SHIFT_SHR, RAX, (uint8_t)bit);
+	alu_ri(e, ALU_AND, RAX, 1);
+	alu_ri(e, ALU_AND, REG_P, ~0x01u);
+	OR_RR(e, REG_P, RAX);
+}
+
+/*
+ every operation does exactly what its handler in 6502.c does, flags included,
+ so where a handler differs from a real 6502 this differs the same way
+*/
+static void emit_read_modify_write(Emitter* e, const Jit_op* op)
+{
+	bool accumulator = op->mode == MODE_ACC;
+	if (!accumulator)
+	{
+		emit_ram_address(e, op);
+		load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		load8(e, RAX, RAX, RCX, 0);
+	}
+	else
+	{
+		MOV_RR(e, RAX, REG_A);
+	}
+
+	//r9 = the (up to 9 bit) result
+	MOV_RR(e, R9, RAX);
+	switch (op->kind)
+	{
+	case JIT_INC:
+		alu_ri(e, ALU_ADD, R9, 1);
+		break;
+	case JIT_DEC:
+		alu_ri(e, ALU_SUB, R9, 1);
+		alu_ri(e, ALU_AND, R9, 0xFFFF);
+		break;
+	case JIT_ASL:
+		shift_ri(e, SHIFT_SHL, R9, 1);
+		set_carry_from(e, 7);
+		break;
+	case JIT_LSR:
+		shift_ri(e, SHIFT_SHR, R9, 1);
+		set_carry_from(e, 0);
+		break;
+	case JIT_ROL:
+		shift_ri(e, SHIFT_SHL, R9, 1);
+		MOV_RR(e, RDX, REG_P);
+		alu_ri(e, ALU_AND, RDX, 1);
+		OR_RR(e, R9, RDX);
+		set_carry_from(e, 7);
+		break;
+	case JIT_ROR:
+		shift_ri(e, SHIFT_SHR, R9, 1);
+		MOV_RR(e, RDX, REG_P);
+		alu_ri(e, ALU_AND, RDX, 1);
+		shift_ri(e, SHIFT_SHL, RDX, 7);
+		OR_RR(e, R9, RDX);
+		set_carry_from(e, 0);
+		break;
+	default:
+		break;
+	}
+	set_nz(e, R9);
+
+	if (accumulator)
+	{
+		MOV_RR(e, REG_A, R9);
+		alu_ri(e, ALU_AND, REG_A, 0xFF);
+	}
+	else
+	{
+		load64(e, RDX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		store8(e, R9, RDX, RCX, 0);
+	}
+}
+
+static void emit_compare(Emitter* e, int reg)
+{
+	alu_ri(e, ALU_AND, REG_P, ~0x01u);
+	CMP_RR(e, reg, RAX);
+	setcc(e, CC_AE, RDX);
+	OR_RR(e, REG_P, RDX);
+	MOV_RR(e, RCX, reg);
+	SUB_RR(e, RCX, RAX);
+	alu_ri(e, ALU_AND, RCX, 0xFF);
+	set_nz(e, RCX);
+}
+
+//eax = operand, ecx = a + operand (inverted for sbc) + carry, v from (result ^ a) & (result ^ operand)
+static void emit_add(Emitter* e, bool subtract)
+{
+	MOV_RR(e, RDX, REG_P);
+	alu_ri(e, ALU_AND, RDX, 1);
+	MOV_RR(e, RCX, RAX);
+	if (subtract) alu_ri(e, ALU_XOR, RCX, 0xFF);
+	ADD_RR(e, RCX, REG_A);
+	ADD_RR(e, RCX, RDX);
+
+	MOV_RR(e, RDX, RCX);
+	XOR_RR(e, RDX, REG_A);
+	MOV_RR(e, R8, RAX);
+	if (subtract) alu_ri(e, ALU_XOR, R8, 0xFFFFFFFF);
+	XOR_RR(e, R8, RCX);
+	AND_RR(e, RDX, R8);
+	alu_ri(e, ALU_AND, RDX, 0x80);
+	shift_ri(e, SHIFT_SHR, RDX, 1);
+	alu_ri(e, ALU_AND, REG_P, ~0x41u);
+	OR_RR(e, REG_P, RDX);
+
+	//the sbc handler passes carry through a uint8_t that drops it, so sbc always clears carry
+	if (!subtract)
+	{
+		MOV_RR(e, RDX, RCX);
+		shift_ri(e, SHIFT_SHR, RDX, 8);
+		OR_RR(e, REG_P, RDX);
+	}
+
+	alu_ri(e, ALU_AND, RCX, 0xFF);
+	MOV_RR(e, REG_A, RCX);
+	set_nz(e, RCX);
+}
+
+static void emit_branch(Emitter* e, const Jit_op* op)
+{
+	uint32_t flag;
+	bool taken_when_set;
+	switch (op->kind)
+	{
+	case JIT_BPL: flag = 0x80; taken_when_set = false; break;
+	case JIT_BMI: flag = 0x80; taken_when_set = true; break;
+	case JIT_BVC: flag = 0x40; taken_when_set = false; break;
+	case JIT_BVS: flag = 0x40; taken_when_set = true; break;
+	case JIT_BCC: flag = 0x01; taken_when_set = false; break;
+	case JIT_BCS: flag = 0x01; taken_when_set = true; break;
+	case JIT_BNE: flag = 0x02; taken_when_set = false; break;
+	default: flag = 0x02; taken_when_set = true; break;
+	}
+
+	int taken = new_label(e);
+	if (flag == 0x02 && e->nz_lazy)
+	{
+		//z is set when the low 16 bits are clear
+		test_ri(e, REG_NZ, 0xFFFF);
+		jcc(e, taken_when_set ? CC_E : CC_NE, taken);
+	}
+	else
+	{
+		test_ri(e, flag == 0x80 && e->nz_lazy ? REG_NZ : REG_P, flag);
+		jcc(e, taken_when_set ? CC_NE : CC_E, taken);
+	}
+
+	uint16_t next = (uint16_t)(op->pc + 2);
+	uint32_t cycles = e->cycles + op->cycles;
+	uint32_t taken_cycles = cycles + 1 + ((op->operand & 0xFF00) != (next & 0xFF00) ? 1 : 0);
+	emit_exit(e, false, next, cycles, e->instructions + 1, e->nz_lazy, false);
+	bind(e, taken);
+	emit_exit(e, false, op->operand, taken_cycles, e->instructions + 1, e->nz_lazy, false);
+}
+
+//returns true if the instruction ended the block with its own exits
+static bool emit_op(Emitter* e, const Jit_op* op)
+{
+	switch (op->kind)
+	{
+	case JIT_LDA: emit_read(e, op); MOV_RR(e, REG_A, RAX); set_nz(e, REG_A); break;
+	case JIT_LDX: emit_read(e, op); MOV_RR(e, REG_X, RAX); set_nz(e, REG_X); break;
+	case JIT_LDY: emit_read(e, op); MOV_RR(e, REG_Y, RAX); set_nz(e, REG_Y); break;
+	case JIT_STA:
+	case JIT_STX:
+	case JIT_STY:
+		emit_ram_address(e, op);
+		load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+		store8(e, op->kind == JIT_STA ? REG_A : op->kind == JIT_STX ? REG_X : REG_Y, RAX, RCX, 0);
+		break;
+	case JIT_ADC: emit_read(e, op); emit_add(e, false); break;
+	case JIT_SBC: emit_read(e, op); emit_add(e, true); break;
+	case JIT_AND: emit_read(e, op); AND_RR(e, REG_A, RAX); set_nz(e, REG_A); break;
+	case JIT_ORA: emit_read(e, op); OR_RR(e, REG_A, RAX); set_nz(e, REG_A); break;
+	case JIT_EOR: emit_read(e, op); XOR_RR(e, REG_A, RAX); set_nz(e, REG_A); break;
+	case JIT_CMP: emit_read(e, op); emit_compare(e, REG_A); break;
+	case JIT_CPX: emit_read(e, op); emit_compare(e, REG_X); break;
+	case JIT_CPY: emit_read(e, op); emit_compare(e, REG_Y); break;
+	case JIT_BIT:
+		//n and z both come from a & operand, so does v
+		emit_read(e, op);
+		AND_RR(e, RAX, REG_A);
+		set_nz(e, RAX);
+		alu_ri(e, ALU_AND, RAX, 0x40);
+		alu_ri(e, ALU_AND, REG_P, ~0x40u);
+		OR_RR(e, REG_P, RAX);
+		break;
+	case JIT_INC: case JIT_DEC: case JIT_ASL: case JIT_LSR: case JIT_ROL: case JIT_ROR:
+		emit_read_modify_write(e, op);
+		break;
+	case JIT_INX: case JIT_DEX: case JIT_INY: case JIT_DEY:
+	{
+		int reg = op->kind == JIT_INX || op->kind == JIT_DEX ? REG_X : REG_Y;
+		alu_ri(e, op->kind == JIT_INX || op->kind == JIT_INY ? ALU_ADD : ALU_SUB, reg, 1);
+		alu_ri(e, ALU_AND, reg, 0xFF);
+		set_nz(e, reg);
+		break;
+	}
+	case JIT_TAX: MOV_RR(e, REG_X, REG_A); set_nz(e, REG_X); break;
+	case JIT_TAY: MOV_RR(e, REG_Y, REG_A); set_nz(e, REG_Y); break;
+	case JIT_TXA: MOV_RR(e, REG_A, REG_X); set_nz(e, REG_A); break;
+	case JIT_TYA: MOV_RR(e, REG_A, REG_Y); set_nz(e, REG_A); break;
+	case JIT_TSX: load32(e, REG_X, REG_CONTEXT, CONTEXT(sp)); set_nz(e, REG_X); break;
+	case JIT_TXS: store32(e, REG_X, REG_CONTEXT, CONTEXT(sp)); set_nz(e, REG_X); break;
+	case JIT_CLC: alu_ri(e, ALU_AND, REG_P, ~0x01u); break;
+	case JIT_SEC: alu_ri(e, ALU_OR, REG_P, 0x01); break;
+	case JIT_CLI: alu_ri(e, ALU_AND, REG_P, ~0x04u); break;
+	case JIT_SEI: alu_ri(e, ALU_OR, REG_P, 0x04); break;
+	case JIT_CLD: alu_ri(e, ALU_AND, REG_P, ~0x08u); break;
+	case JIT_SED: alu_ri(e, ALU_OR, REG_P, 0x08); break;
+	case JIT_CLV: alu_ri(e, ALU_AND, REG_P, ~0x40u); break;
+	case JIT_NOP: break;
+	case JIT_PHA:
+		emit_stack_check(e, op);
+		emit_push(e, REG_A);
+		break;
+	case JIT_PHP:
+		//pushed with break and unused set, then both are cleared
+		emit_stack_check(e, op);
+		if (e->nz_lazy) materialise_nz(e);
+		e->nz_lazy = false;
+		MOV_RR(e, R9, REG_P);
+		alu_ri(e, ALU_OR, R9, 0x30);
+		emit_push(e, R9);
+		alu_ri(e, ALU_AND, REG_P, ~0x30u);
+		break;
+	case JIT_PLA:
+		emit_pull(e);
+		MOV_RR(e, REG_A, RAX);
+		set_nz(e, REG_A);
+		break;
+	case JIT_PLP:
+		emit_pull(e);
+		alu_ri(e, ALU_OR, RAX, 0x20);
+		MOV_RR(e, REG_P, RAX);
+		e->nz_lazy = false;
+		break;
+	case JIT_JMP:
+		if (op->mode == MODE_ABS)
+		{
+			emit_exit(e, false, op->operand, e->cycles + op->cycles, e->instructions + 1, e->nz_lazy, false);
+		}
+		else if (op->operand >= 0x8000)
+		{
+			emit_exit(e, false, op->jump_target, e->cycles + op->cycles, e->instructions + 1, e->nz_lazy, false);
+		}
+		else
+		{
+			//pointer in ram, with the same page wrap bug as the interpreter
+			uint16_t high = (op->operand & 0x00FF) == 0x00FF ? op->operand & 0xFF00 : (uint16_t)(op->operand + 1);
+			load64(e, RAX, REG_CONTEXT, -1, 1, CONTEXT(ram));
+			load8(e, RCX, RAX, -1, op->operand & 0x07FF);
+			load8(e, RDX, RAX, -1, high & 0x07FF);
+			shift_ri(e, SHIFT_SHL, RDX, 8);
+			OR_RR(e, RCX, RDX);
+			emit_exit(e, true, 0, e->cycles + op->cycles, e->instructions + 1, e->nz_lazy, false);
+		}
+		return true;
+	case JIT_JSR:
+	{
+		uint16_t return_address = (uint16_t)(op->pc + 2);
+		emit_stack_check(e, op);
+		mov_ri(e, R9, return_address >> 8);
+		emit_push(e, R9);
+		mov_ri(e, R9, return_address & 0xFF);
+		emit_push(e, R9);
+		emit_exit(e, false, op->operand, e->cycles + op->cycles, e->instructions + 1, e->nz_lazy, false);
+		return true;
+	}
+	case JIT_RTS:
+		emit_pull(e);
+		MOV_RR(e, R9, RAX);
+		emit_pull(e);
+		shift_ri(e, SHIFT_SHL, RAX, 8);
+		OR_RR(e, R9, RAX);
+		MOV_RR(e, RCX, R9);
+		alu_ri(e, ALU_ADD, RCX, 1);
+		alu_ri(e, ALU_AND, RCX, 0xFFFF);
+		emit_exit(e, true, 0, e->cycles + op->cycles, e->instructions + 1, e->nz_lazy, false);
+		return true;
+	default:
+		if (is_branch(op->kind))
+		{
+			emit_branch(e, op);
+			return true;
+		}
+		break;
+	}
+	return false;
+}
+
+static void emit_prologue(Emitter* e)
+{
+	push(e, RBX); push(e, RBP); push(e, R12); push(e, R13); push(e, R14); push(e, R15);
+	//mov rbx, first argument
+#ifdef _WIN32
+	emit_rex(e, true, RCX, 0, RBX, false);
+	emit8(e, 0x89);
+	emit_modrm_reg(e, RCX, RBX);
+#else
+	emit_rex(e, true, RDI, 0, RBX, false);
+	emit8(e, 0x89);
+	emit_modrm_reg(e, RDI, RBX);
+#endif
+	load32(e, REG_A, REG_CONTEXT, CONTEXT(a));
+	load32(e, REG_X, REG_CONTEXT, CONTEXT(x));
+	load32(e, REG_Y, REG_CONTEXT, CONTEXT(y));
+	load32(e, REG_P, REG_CONTEXT, CONTEXT(status));
+}
+
+static void emit_epilogue(Emitter* e)
+{
+	bind(e, e->epilogue);
+	store32(e, REG_A, REG_CONTEXT, CONTEXT(a));
+	store32(e, REG_X, REG_CONTEXT, CONTEXT(x));
+	store32(e, REG_Y, REG_CONTEXT, CONTEXT(y));
+	store32(e, REG_P, REG_CONTEXT, CONTEXT(status));
+	pop(e, R15); pop(e, R14); pop(e, R13); pop(e, R12); pop(e, RBP); pop(e, RBX);
+	emit8(e, 0xC3);
+}
+
+/*
+ the shapes of loop the interpreter counts down without running (a jump to itself, or a read and a branch back to it),
+ compiling them would only run every iteration
+*/
+static bool is_idle_loop(const Jit_op* ops, int count, uint16_t start)
+{
+	if (ops[0].kind == JIT_JMP && ops[0].mode == MODE_ABS && ops[0].operand == start) return true;
+	if (count < 2 || !is_branch(ops[1].kind) || ops[1].operand != start) return false;
+
+	Jit_kind kind = ops[0].kind;
+	bool reads = kind == JIT_LDA || kind == JIT_LDX || kind == JIT_LDY || kind == JIT_BIT
+		|| kind == JIT_CMP || kind == JIT_CPX || kind == JIT_CPY;
+	return reads && (ops[0].mode == MODE_ZP0 || ops[0].mode == MODE_ABS);
+}
+
+//the emitter is big so it is kept out of the stack
+static Emitter emitter;
+
+static void compile_block(Jit_block* block)
+{
+	Jit_op ops[JIT_MAX_INSTRUCTIONS];
+	int count = 0;
+	uint32_t max_cycles = 0;
+	uint16_t pc = block->pc;
+
+	while (count < JIT_MAX_INSTRUCTIONS && decode_op(pc, &ops[count]))
+	{
+		const Jit_op* op = &ops[count++];
+		max_cycles += op->cycles;
+		if (takes_page_cycle(op->kind) && (op->mode == MODE_ABX || op->mode == MODE_ABY || op->mode == MODE_IZY)) max_cycles++;
+		if (is_branch(op->kind)) max_cycles += 2;
+		pc = (uint16_t)(pc + op->length);
+		if (ends_block(op)) break;
+	}
+
+	block->code = NULL;
+	block->max_cycles = (uint16_t)max_cycles;
+	if (count == 0 || is_idle_loop(ops, count, block->pc)) return;
+
+	Emitter* e = &emitter;
+	e->code = code_memory + code_used;
+	e->size = 0;
+	e->capacity = JIT_MAX_BLOCK_CODE;
+	e->overflow = false;
+	e->label_count = 0;
+	e->fixup_count = 0;
+	e->side_exit_count = 0;
+	e->nz_lazy = false;
+	e->cycles = 0;
+	e->instructions = 0;
+	e->epilogue = new_label(e);
+
+	emit_prologue(e);
+
+	bool exited = false;
+	for (int i = 0; i < count && !exited; i++)
+	{
+		e->side_exit = -1;
+		exited = emit_op(e, &ops[i]);
+		e->cycles += ops[i].cycles;
+		e->instructions++;
+	}
+
+	//ran out of instructions it could compile, the interpreter carries on from the next one
+	if (!exited) emit_exit(e, false, pc, e->cycles, e->instructions, e->nz_lazy, false);
+
+	for (int i = 0; i < e->side_exit_count; i++)
+	{
+		Jit_side_exit* exit = &e->side_exits[i];
+		bind(e, exit->label);
+		emit_exit(e, false, exit->pc, exit->cycles, exit->instructions, exit->nz_lazy, true);
+	}
+
+	emit_epilogue(e);
+	resolve_fixups(e);
+
+	if (e->overflow)
+	{
+		log_warn("jit block at 0x%04X did not fit, it is left to the interpreter", block->pc);
+		return;
+	}
+
+	block->code = (Jit_code)(void*)e->code;
+	code_used += (e->size + 15) & ~15u;
+	stats.blocks_compiled++;
+}
+
+static Jit_block* find_block(uint16_t pc)
+{
+	uint16_t bank = cartridge_prg_bank(pc);
+	Jit_block* block = &blocks[(pc ^ (pc >> 12) ^ (bank << 4)) & (JIT_BLOCK_COUNT - 1)];
+	if (block->valid && block->pc == pc && block->bank == bank) return block;
+
+	//only code that keeps being reached is worth compiling
+	if (++heat[pc & 0x7FFF] < JIT_HOT_THRESHOLD) return NULL;
+	heat[pc & 0x7FFF] = 0;
+
+	if (JIT_CODE_SIZE - code_used < JIT_MAX_BLOCK_CODE) cpu_jit_flush();
+	block->valid = true;
+	block->pc = pc;
+	block->bank = bank;
+	compile_block(block);
+	return block;
+}
+
+bool cpu_jit_available()
+{
+	if (!initialised)
+	{
+		initialised = true;
+		code_memory = platform_alloc_executable(JIT_CODE_SIZE);
+		if (!code_memory) log_warn("could not allocate executable memory, the jit is unavailable");
+	}
+	return code_memory != NULL;
+}
+
+void cpu_jit_flush()
+{
+	memset(blocks, 0, sizeof(blocks));
+	memset(heat, 0, sizeof(heat));
+	code_used = 0;
+	generation = cartridge_prg_generation();
+	stats.flushes++;
+}
+
+uint32_t cpu_jit_run(Cpu6502_Regs* regs, uint32_t budget, uint8_t ram_code_pages, uint32_t* instructions)
+{
+	*instructions = 0;
+	if (!cpu_jit_available()) return 0;
+	if (generation != cartridge_prg_generation()) cpu_jit_flush();
+
+	Jit_context context = {
+		.ram = get_ram_buffer(),
+		.a = regs->a, .x = regs->x, .y = regs->y, .status = regs->status, .sp = regs->sp, .pc = regs->pc,
+		.ram_code_pages = ram_code_pages,
+	};
+	for (int i = 0; i < 4; i++) context.prg[i] = cartridge_prg_window((uint16_t)(0x8000 + i * 0x2000));
+
+	while (context.pc >= 0x8000 && !context.side_exit)
+	{
+		Jit_block* block = find_block((uint16_t)context.pc);
+		if (!block || !block->code || context.cycles + block->max_cycles > budget) break;
+		block->code(&context);
+		stats.blocks_run++;
+	}
+
+	if (context.side_exit) stats.side_exits++;
+	stats.instructions += context.instructions;
+
+	regs->a = (uint8_t)context.a;
+	regs->x = (uint8_t)context.x;
+	regs->y = (uint8_t)context.y;
+	regs->sp = (uint8_t)context.sp;
+	regs->status = (uint8_t)context.status;
+	regs->pc = (uint16_t)context.pc;
+	*instructions = context.instructions;
+	return context.cycles;
+}
+
+#else
+
+bool cpu_jit_available()
+{
+	return false;
+}
+
+void cpu_jit_flush()
+{
+}
+
+uint32_t cpu_jit_run(Cpu6502_Regs* regs, uint32_t budget, uint8_t ram_code_pages, uint32_t* instructions)
+{
+	(void)regs; (void)budget; (void)ram_code_pages;
+	*instructions = 0;
+	return 0;
+}
+
+#endif
+
+Cpu_jit_stats cpu_jit_get_stats()
+{
+	return stats;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "6502.h"
+
+/*
+ experimental recompiler that turns hot straight line 6502 code in prg rom into x86-64, opt in with --jit
+ or from the emulation menu. a compiled block only ever touches ram and rom so it can run ahead of the ppu,
+ any other access leaves the block before that instruction and the interpreter does it on its real cycle.
+ a, x, y and the status live in host registers with n and z kept as the last result until something reads them.
+ builds for anything other than x86-64 have the interface but never compile anything.
+*/
+
+typedef struct {
+	uint64_t blocks_compiled;
+	uint64_t blocks_run;
+	uint64_t instructions;
+	uint64_t side_exits; //blocks left early for an access that had to go through the bus
+	uint64_t flushes;
+}Cpu_jit_stats;
+
+//false on builds that are not x86-64 or when the host would not give out executable memory
+bool cpu_jit_available();
+
+/*
+ runs compiled blocks starting at regs->pc until one would go past budget cpu cycles or leaves rom.
+ writes to ram pages set in ram_code_pages leave the block so the interpreter's decoded blocks see them.
+ returns the cycles the blocks took, 0 if nothing ran, and how many instructions that was
+*/
+uint32_t cpu_jit_run(Cpu6502_Regs* regs, uint32_t budget, uint8_t ram_code_pages, uint32_t* instructions);
+
+void cpu_jit_flush();
+Cpu_jit_stats cpu_jit_get_stats();
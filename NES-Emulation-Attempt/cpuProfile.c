@@ -0,0 +1,284 @@
+#include "cpuProfile.h"
+#include "nes.h"
+#include "ppu.h"
+#include "cartridge.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SHADOW_DEPTH 64
+#define MAX_SAMPLE_DEPTH 32 //deeper stacks keep their outermost frames
+#define PROFILE_TABLE_SIZE 16384 //distinct stacks, has to be a power of two
+#define MAX_LABEL 48
+
+//a frame is the called address with the kind of call in the upper bits
+#define FRAME_ID(target, kind) ((uint32_t)(target) | ((uint32_t)(kind) << 16))
+#define FRAME_TARGET(id) ((uint16_t)((id) & 0xFFFF))
+#define FRAME_KIND(id) ((Profile_call_kind)((id) >> 16))
+
+typedef struct {
+	uint32_t id;
+	uint8_t caller_sp; //sp before the call pushed anything, the frame is gone once sp is back up to it
+}Shadow_frame;
+
+typedef struct {
+	uint32_t hash;
+	uint32_t count; //0 means the slot is free
+	uint16_t pc;
+	uint8_t depth;
+	uint32_t frames[MAX_SAMPLE_DEPTH];
+}Profile_stack;
+
+typedef struct {
+	uint16_t addr;
+	char name[MAX_LABEL];
+}Symbol;
+
+bool cpu_profile_active = false;
+
+static Shadow_frame shadow[MAX_SHADOW_DEPTH];
+static int shadow_depth = 0;
+static uint32_t shadow_overflows = 0;
+
+static Profile_stack* stacks = NULL;
+static uint32_t sample_interval = CPU_PROFILE_DEFAULT_INTERVAL;
+static uint64_t next_sample_cycle = 0;
+static uint64_t sample_count = 0;
+static uint64_t dropped_samples = 0;
+
+static Symbol* symbols = NULL;
+static int symbol_count = 0;
+
+int start_cpu_profile(uint32_t interval)
+{
+#ifndef CPU_PROFILE
+	(void)interval;
+	log_warn("cpu profiling was not compiled in, define CPU_PROFILE");
+	return -1;
+#else
+	if (!stacks) stacks = malloc(sizeof(Profile_stack) * PROFILE_TABLE_SIZE);
+	if (!stacks) {
+		log_critical("Failed to allocate the cpu profile");
+		return -1;
+	}
+	memset(stacks, 0, sizeof(Profile_stack) * PROFILE_TABLE_SIZE);
+
+	sample_interval = interval ? interval : CPU_PROFILE_DEFAULT_INTERVAL;
+	next_sample_cycle = get_cpu_cycle_count() + sample_interval;
+	sample_count = 0;
+	dropped_samples = 0;
+	shadow_depth = 0;
+	shadow_overflows = 0;
+	cpu_profile_active = true;
+	return 0;
+#endif
+}
+
+void profile_call(uint16_t target, uint8_t caller_sp, Profile_call_kind kind)
+{
+	//the frame is lost but the sp check still unwinds whatever is under it correctly
+	if (shadow_depth == MAX_SHADOW_DEPTH) {
+		shadow_overflows++;
+		return;
+	}
+	shadow[shadow_depth].id = FRAME_ID(target, kind);
+	shadow[shadow_depth].caller_sp = caller_sp;
+	shadow_depth++;
+}
+
+void profile_return(uint8_t sp)
+{
+	while (shadow_depth > 0 && shadow[shadow_depth - 1].caller_sp <= sp) shadow_depth--;
+}
+
+static uint32_t hash_sample(const uint32_t* frames, int depth, uint16_t pc)
+{
+	uint32_t hash = 2166136261u ^ pc;
+	for (int i = 0; i < depth; i++) hash = (hash ^ frames[i]) * 16777619u;
+	return hash;
+}
+
+static void record_sample(uint16_t pc, uint32_t weight)
+{
+	int depth = shadow_depth < MAX_SAMPLE_DEPTH ? shadow_depth : MAX_SAMPLE_DEPTH;
+	uint32_t frames[MAX_SAMPLE_DEPTH];
+	for (int i = 0; i < depth; i++) frames[i] = shadow[i].id;
+
+	uint32_t hash = hash_sample(frames, depth, pc);
+	for (uint32_t probe = 0; probe < PROFILE_TABLE_SIZE; probe++)
+	{
+		Profile_stack* stack = &stacks[(hash + probe) & (PROFILE_TABLE_SIZE - 1)];
+		if (stack->count == 0)
+		{
+			stack->hash = hash;
+			stack->pc = pc;
+			stack->depth = (uint8_t)depth;
+			memcpy(stack->frames, frames, depth * sizeof(uint32_t));
+			stack->count = weight;
+			return;
+		}
+		if (stack->hash == hash && stack->pc == pc && stack->depth == depth &&
+			memcmp(stack->frames, frames, depth * sizeof(uint32_t)) == 0)
+		{
+			stack->count += weight;
+			return;
+		}
+	}
+	dropped_samples += weight;
+}
+
+//called before every instruction, an instruction that runs past several sample points takes all of them
+void profile_instruction(uint16_t pc)
+{
+	uint64_t cycle = get_cpu_cycle_count();
+	if (cycle < next_sample_cycle) return;
+
+	uint32_t weight = (uint32_t)((cycle - next_sample_cycle) / sample_interval) + 1;
+	next_sample_cycle += (uint64_t)weight * sample_interval;
+	sample_count += weight;
+	record_sample(pc, weight);
+}
+
+static int compare_symbols(const void* a, const void* b)
+{
+	return (int)((const Symbol*)a)->addr - (int)((const Symbol*)b)->addr;
+}
+
+static void load_symbols(const char* path)
+{
+	free(symbols);
+	symbols = NULL;
+	symbol_count = 0;
+	if (!path) return;
+
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		log_warn("could not open symbol file %s", path);
+		return;
+	}
+
+	int capacity = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		unsigned int addr;
+		char name[MAX_LABEL];
+		bool parsed = line[0] == '$'
+			? sscanf(line, "$%x#%47[^#\r\n]", &addr, name) == 2
+			: sscanf(line, "%x %47s", &addr, name) == 2;
+		if (!parsed || addr > 0xFFFF) continue;
+
+		if (symbol_count == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 256;
+			Symbol* grown = realloc(symbols, capacity * sizeof(Symbol));
+			if (!grown) break;
+			symbols = grown;
+		}
+		symbols[symbol_count].addr = (uint16_t)addr;
+		strcpy(symbols[symbol_count].name, name);
+		//folded stacks use ; and spaces as separators
+		for (char* c = symbols[symbol_count].name; *c; c++) if (*c == ';' || *c == ' ') *c = '_';
+		symbol_count++;
+	}
+	fclose(file);
+
+	qsort(symbols, symbol_count, sizeof(Symbol), compare_symbols);
+}
+
+//nearest symbol at or below addr, NULL if there is none
+static const Symbol* find_symbol(uint16_t addr)
+{
+	int lower = 0;
+	int higher = symbol_count - 1;
+	const Symbol* best = NULL;
+	while (lower <= higher)
+	{
+		int middle = lower + (higher - lower) / 2;
+		if (symbols[middle].addr <= addr) {
+			best = &symbols[middle];
+			lower = middle + 1;
+		}
+		else {
+			higher = middle - 1;
+		}
+	}
+	return best;
+}
+
+static void write_frame(FILE* file, uint32_t id)
+{
+	static const char* kinds[] = { "", "NMI ", "BRK " };
+	uint16_t target = FRAME_TARGET(id);
+	const Symbol* symbol = find_symbol(target);
+	if (symbol && symbol->addr == target) fprintf(file, ";%s%s", kinds[FRAME_KIND(id)], symbol->name);
+	else fprintf(file, ";%s$%04X", kinds[FRAME_KIND(id)], target);
+}
+
+static void write_pc(FILE* file, uint16_t pc)
+{
+	const Symbol* symbol = find_symbol(pc);
+	if (!symbol) fprintf(file, ";$%04X", pc);
+	else if (symbol->addr == pc) fprintf(file, ";%s", symbol->name);
+	else fprintf(file, ";%s+%u", symbol->name, pc - symbol->addr);
+}
+
+int stop_cpu_profile(const char* path, const char* symbol_path)
+{
+	if (!cpu_profile_active) return -1;
+	cpu_profile_active = false;
+
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		log_warn("could not write cpu profile %s", path);
+		return -1;
+	}
+
+	load_symbols(symbol_path);
+	uint32_t distinct = 0;
+	for (int i = 0; i < PROFILE_TABLE_SIZE; i++)
+	{
+		const Profile_stack* stack = &stacks[i];
+		if (stack->count == 0) continue;
+
+		fputs("nes", file);
+		for (int f = 0; f < stack->depth; f++) write_frame(file, stack->frames[f]);
+		write_pc(file, stack->pc);
+		fprintf(file, " %u\n", stack->count);
+		distinct++;
+	}
+	if (dropped_samples) fprintf(file, "nes;[too many distinct stacks] %llu\n", (unsigned long long)dropped_samples);
+	fclose(file);
+
+	log_info("cpu profile: %llu samples every %u cycles, %u distinct stacks written to %s",
+		(unsigned long long)sample_count, sample_interval, distinct, path);
+	if (shadow_overflows) log_warn("cpu profile: %u calls nested deeper than %d were not tracked", shadow_overflows, MAX_SHADOW_DEPTH);
+	return 0;
+}
+
+int profile_rom(const char* rom_path, const char* out_path, uint32_t frames, uint32_t interval, const char* symbol_path)
+{
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		log_warn("could not load %s", rom_path);
+		return -1;
+	}
+
+	reset_nes();
+	set_emulator_running(true);
+	int result = start_cpu_profile(interval);
+	if (result == 0)
+	{
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			while (!is_frame_complete()) nes_clock();
+			reset_frame_complete();
+		}
+		result = stop_cpu_profile(out_path, symbol_path);
+	}
+
+	set_emulator_running(false);
+	remove_cartridge();
+	deinitalise_nes();
+	return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ sampling profiler for the 6502 program itself.
+ a shadow call stack is kept from JSR, NMI and BRK entry and unwound on RTS/RTI by comparing stack pointers,
+ so jump tables done with a pushed address and RTS don't confuse it. every interval cpu cycles the stack
+ and current pc are sampled and identical stacks are merged, the result is written as folded stacks
+ ("nes;$C000;NMI $C085;$C1F0 42") which flamegraph.pl, speedscope and friends read directly.
+ the hooks in 6502.c only exist when CPU_PROFILE is defined.
+
+ symbol files give frames names, either FCEUX .nl lines ("$C085#NMI_Handler#comment")
+ or plain "C085 NMI_Handler" lines. the sampled pc is shown as the nearest label below it plus an offset.
+*/
+
+#define CPU_PROFILE_DEFAULT_INTERVAL 256
+
+typedef enum {
+	PROFILE_CALL_JSR,
+	PROFILE_CALL_NMI,
+	PROFILE_CALL_BRK,
+}Profile_call_kind;
+
+//only read by the cpu, set through start_cpu_profile/stop_cpu_profile
+extern bool cpu_profile_active;
+
+/*
+ starts sampling every interval cpu cycles (0 picks the default), emulation thread only
+ returns -1 if profiling was compiled out or OOM
+*/
+int start_cpu_profile(uint32_t interval);
+
+/*
+ stops sampling and writes the folded stacks to path, symbol_path can be NULL
+ returns -1 if the output could not be written
+*/
+int stop_cpu_profile(const char* path, const char* symbol_path);
+
+//hooks for the cpu, only called while cpu_profile_active
+void profile_instruction(uint16_t pc);
+void profile_call(uint16_t target, uint8_t caller_sp, Profile_call_kind kind);
+void profile_return(uint8_t sp);
+
+/*
+ runs a rom headless for frames frames and profiles all of it
+ returns -1 if the rom could not be loaded or the output written
+*/
+int profile_rom(const char* rom_path, const char* out_path, uint32_t frames, uint32_t interval, const char* symbol_path);
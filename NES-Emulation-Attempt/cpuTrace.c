@@ -0,0 +1,268 @@
+#include "cpuTrace.h"
+#include "6502.h"
+#include "logger.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ a streamed trace is buffered in a ring of blocks, the cpu fills one while a writer thread
+ saves the others so the emulation thread never waits on the disk unless it gets a whole ring ahead
+*/
+#define TRACE_STREAM_BLOCK (1 << 16)
+#define TRACE_STREAM_BLOCKS 4
+#define TRACE_DEFAULT_RING_RECORDS (1 << 20)
+
+bool cpu_trace_active = false;
+
+static Trace_record* trace_ring = NULL;
+static uint32_t ring_size = 0;
+static uint64_t trace_count = 0;
+static FILE* trace_file = NULL;
+
+static Platform_thread* writer_thread = NULL;
+static volatile int32_t blocks_filled = 0;
+static volatile int32_t blocks_written = 0;
+static volatile int32_t writer_stop = 0;
+
+#ifdef CPU_TRACE
+static uint32_t round_up_pow2(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result < value && result < 0x80000000u) result <<= 1;
+	return result;
+}
+#endif
+
+static int write_header(FILE* file)
+{
+	Trace_file_header header = { .version = CPU_TRACE_VERSION, .record_size = sizeof(Trace_record) };
+	memcpy(header.magic, CPU_TRACE_MAGIC, sizeof(header.magic));
+	return fwrite(&header, sizeof(header), 1, file) == 1 ? 0 : -1;
+}
+
+static void write_records(const Trace_record* records, size_t count)
+{
+	if (fwrite(records, sizeof(Trace_record), count, trace_file) != count) {
+		log_warn("failed writing cpu trace, the trace will be incomplete");
+	}
+}
+
+#ifdef CPU_TRACE
+static int trace_writer_main(void* arg)
+{
+	(void)arg;
+	for (;;)
+	{
+		int32_t written = platform_atomic_load(&blocks_written);
+		if (written < platform_atomic_load(&blocks_filled))
+		{
+			write_records(&trace_ring[(written % TRACE_STREAM_BLOCKS) * TRACE_STREAM_BLOCK], TRACE_STREAM_BLOCK);
+			platform_atomic_store(&blocks_written, written + 1);
+		}
+		else if (platform_atomic_load(&writer_stop))
+		{
+			return 0;
+		}
+		else
+		{
+			platform_sleep_ms(1);
+		}
+	}
+}
+#endif
+
+//called when the cpu is about to start a new block, waits only if the writer is a whole ring behind
+static void hand_off_block()
+{
+	int32_t filled = (int32_t)(trace_count / TRACE_STREAM_BLOCK);
+	platform_atomic_store(&blocks_filled, filled);
+	while (filled - platform_atomic_load(&blocks_written) >= TRACE_STREAM_BLOCKS) platform_sleep_ms(1);
+}
+
+static void finish_stream()
+{
+	int32_t full_blocks = (int32_t)(trace_count / TRACE_STREAM_BLOCK);
+	platform_atomic_store(&blocks_filled, full_blocks);
+	platform_atomic_store(&writer_stop, 1);
+	platform_thread_join(writer_thread);
+	writer_thread = NULL;
+
+	//the writer only saves whole blocks, the last partial one is written here
+	size_t tail = (size_t)(trace_count - (uint64_t)full_blocks * TRACE_STREAM_BLOCK);
+	if (tail) write_records(&trace_ring[(full_blocks % TRACE_STREAM_BLOCKS) * TRACE_STREAM_BLOCK], tail);
+}
+
+int start_cpu_trace(const char* path, uint32_t ring_records)
+{
+#ifndef CPU_TRACE
+	(void)path; (void)ring_records;
+	log_warn("cpu tracing was compiled out, define CPU_TRACE to use it");
+	return -1;
+#else
+	if (cpu_trace_active) stop_cpu_trace(NULL);
+
+	if (path) ring_records = TRACE_STREAM_BLOCK * TRACE_STREAM_BLOCKS;
+	else if (ring_records == 0) ring_records = TRACE_DEFAULT_RING_RECORDS;
+	ring_size = round_up_pow2(ring_records);
+
+	trace_ring = malloc(sizeof(Trace_record) * ring_size);
+	if (!trace_ring) {
+		log_critical("Failed to allocate cpu trace ring of %u records", ring_size);
+		return -1;
+	}
+
+	if (path)
+	{
+		trace_file = fopen(path, "wb");
+		if (!trace_file || write_header(trace_file) == -1) {
+			log_warn("could not create cpu trace %s", path);
+			if (trace_file) fclose(trace_file);
+			trace_file = NULL;
+			free(trace_ring);
+			trace_ring = NULL;
+			return -1;
+		}
+	}
+
+	trace_count = 0;
+	if (trace_file)
+	{
+		blocks_filled = 0;
+		blocks_written = 0;
+		writer_stop = 0;
+		writer_thread = platform_thread_create(trace_writer_main, NULL);
+		if (!writer_thread) {
+			log_critical("Failed to create cpu trace writer thread");
+			fclose(trace_file);
+			trace_file = NULL;
+			free(trace_ring);
+			trace_ring = NULL;
+			return -1;
+		}
+	}
+
+	cpu_trace_active = true;
+	log_info("cpu trace started %s", path ? path : "(ring)");
+	return 0;
+#endif
+}
+
+static int save_ring(const char* save_path)
+{
+	FILE* file = fopen(save_path, "wb");
+	if (!file) {
+		log_warn("could not create cpu trace %s", save_path);
+		return -1;
+	}
+
+	int result = write_header(file);
+	uint64_t first = trace_count > ring_size ? trace_count - ring_size : 0;
+	for (uint64_t i = first; i < trace_count && result == 0; i++)
+	{
+		if (fwrite(&trace_ring[i & (ring_size - 1)], sizeof(Trace_record), 1, file) != 1) result = -1;
+	}
+
+	fclose(file);
+	if (result == -1) log_warn("failed writing cpu trace %s", save_path);
+	return result;
+}
+
+int stop_cpu_trace(const char* save_path)
+{
+	if (!trace_ring) return 0;
+
+	cpu_trace_active = false;
+	int result = 0;
+	if (trace_file)
+	{
+		finish_stream();
+		fclose(trace_file);
+		trace_file = NULL;
+	}
+	else if (save_path)
+	{
+		result = save_ring(save_path);
+	}
+
+	log_info("cpu trace stopped after %llu instructions", (unsigned long long)trace_count);
+	free(trace_ring);
+	trace_ring = NULL;
+	return result;
+}
+
+uint64_t cpu_trace_count()
+{
+	return trace_count;
+}
+
+Trace_record* cpu_trace_next()
+{
+	if (trace_file && (trace_count & (TRACE_STREAM_BLOCK - 1)) == 0 && trace_count != 0) hand_off_block();
+	return &trace_ring[trace_count++ & (ring_size - 1)];
+}
+
+void format_trace_record(const Trace_record* r, char* out, int size)
+{
+	Debug_instructions di;
+	disassemble_instruction(r->pc, r->bytes, &di);
+
+	char bytes[12];
+	switch (di.numberOfBytes)
+	{
+	case 1: snprintf(bytes, sizeof(bytes), "%02X", r->bytes[0]); break;
+	case 2: snprintf(bytes, sizeof(bytes), "%02X %02X", r->bytes[0], r->bytes[1]); break;
+	default: snprintf(bytes, sizeof(bytes), "%02X %02X %02X", r->bytes[0], r->bytes[1], r->bytes[2]); break;
+	}
+
+	snprintf(out, size, "%04X  %-8s  %-31ls A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%llu",
+		r->pc, bytes, di.mneumonics, r->a, r->x, r->y, r->p, r->sp, r->scanline, r->dot, (unsigned long long)r->cycle);
+}
+
+bool is_cpu_trace_header(const Trace_file_header* header)
+{
+	return memcmp(header->magic, CPU_TRACE_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == CPU_TRACE_VERSION && header->record_size == sizeof(Trace_record);
+}
+
+int decode_cpu_trace(const char* in_path, const char* out_path)
+{
+	FILE* in = fopen(in_path, "rb");
+	if (!in) {
+		log_warn("could not open cpu trace %s", in_path);
+		return -1;
+	}
+
+	Trace_file_header header;
+	if (fread(&header, sizeof(header), 1, in) != 1 || !is_cpu_trace_header(&header))
+	{
+		log_warn("%s is not a version %d cpu trace", in_path, CPU_TRACE_VERSION);
+		fclose(in);
+		return -1;
+	}
+
+	FILE* out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		log_warn("could not create %s", out_path);
+		fclose(in);
+		return -1;
+	}
+
+	//decoding is done in blocks, traces can be far bigger than memory
+	static Trace_record block[4096];
+	size_t count;
+	while ((count = fread(block, sizeof(Trace_record), 4096, in)) > 0)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			char line[128];
+			format_trace_record(&block[i], line, sizeof(line));
+			fprintf(out, "%s\n", line);
+		}
+	}
+
+	fclose(in);
+	if (out != stdout) fclose(out);
+	return 0;
+}
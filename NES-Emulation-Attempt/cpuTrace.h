@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ binary execution trace, one fixed size record per instruction written as the opcode is fetched
+ so the registers are the state before the instruction runs (same as a nestest log line).
+ the hook in cpu_6502_clock only exists when CPU_TRACE is defined, without it tracing costs nothing.
+
+ records either go to a file in large blocks (streamed) or into a ring that keeps only the most recent ones,
+ text is only produced offline by decode_cpu_trace.
+*/
+
+#define CPU_TRACE_MAGIC "NESTRACE"
+#define CPU_TRACE_VERSION 2
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+}Trace_file_header;
+
+typedef struct {
+	uint64_t cycle; //cpu cycles since reset
+	uint16_t pc;
+	uint8_t bytes[3]; //opcode then operands, unused operand bytes are 0
+	uint8_t a, x, y, sp, p;
+	int16_t scanline;
+	uint16_t dot;
+	uint16_t addr; //effective address the addressing mode produced, only meaningful if the instruction accesses memory
+}Trace_record;
+
+//only read by the cpu, set through start_cpu_trace/stop_cpu_trace
+extern bool cpu_trace_active;
+
+/*
+ starts recording, emulation thread only.
+ with a path the trace is streamed to that file, with NULL the last ring_records instructions are kept in memory
+ and can be written out by stop_cpu_trace. ring_records is rounded up to a power of two, 0 picks a default
+ returns -1 if tracing was compiled out, the file could not be created or OOM
+*/
+int start_cpu_trace(const char* path, uint32_t ring_records);
+
+/*
+ stops recording and closes a streamed trace, for a ring trace save_path (can be NULL) receives what was kept
+ returns -1 if the ring could not be saved
+*/
+int stop_cpu_trace(const char* save_path);
+
+//instructions recorded since start_cpu_trace
+uint64_t cpu_trace_count();
+
+//hands the cpu the next record to fill in, only called while cpu_trace_active
+Trace_record* cpu_trace_next();
+
+/*
+ formats one record as a nestest style line without a newline
+*/
+void format_trace_record(const Trace_record* record, char* out, int size);
+
+/*
+ checks the header at the start of a trace file
+ returns false if it is not a trace this build can read
+*/
+bool is_cpu_trace_header(const Trace_file_header* header);
+
+/*
+ renders a binary trace as nestest style text, out_path NULL writes to stdout
+ returns -1 if the input is missing or is not a trace
+*/
+int decode_cpu_trace(const char* in_path, const char* out_path);
@@ -2,9 +2,10 @@
 #include "cartridge.h"
 #include "ppu.h"
 #include "ram.h"  
+#include "controller.h"
 
 // Initialize the array with a constant size and assign the pointer later  
-Bus_device** cpu_bus_devices[3];
+Bus_device** cpu_bus_devices[4];
 Bus_device** ppu_bus_devices[3];
 
 Bus_device** get_cpu_device_registry(int* count)  
@@ -12,6 +13,7 @@ Bus_device** get_cpu_device_registry(int* count)
     cpu_bus_devices[0] = get_ram_device();
     cpu_bus_devices[1] = get_cartridge_device();
     cpu_bus_devices[2] = get_ppu_bus_device();
+    cpu_bus_devices[3] = get_controller_device();
 
     if (count) {  
         *count = sizeof(cpu_bus_devices)/sizeof(Bus_device*);
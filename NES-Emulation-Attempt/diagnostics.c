@@ -0,0 +1,103 @@
+#include "diagnostics.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define DIAGNOSTIC_TABLE_SIZE 256 //must be a power of 2
+#define DIAGNOSTIC_TEXT_SIZE 128
+#define DIAGNOSTIC_SUMMARY_INTERVAL 1.0
+
+typedef struct {
+	const char* fmt; //NULL for an empty slot
+	uint32_t key;
+	Log_level level;
+	uint64_t total;
+	uint64_t window; //hits since the last summary, the first hit is not counted as it was logged in full
+	char text[DIAGNOSTIC_TEXT_SIZE]; //the first message, repeated in the summaries
+}Diagnostic;
+
+static Diagnostic table[DIAGNOSTIC_TABLE_SIZE];
+static int used_slots = 0;
+static uint64_t untracked = 0; //hits that found the table full
+static double window_start = 0.0;
+
+static Diagnostic* find_slot(const char* fmt, uint32_t key)
+{
+	uint32_t hash = (uint32_t)((uintptr_t)fmt >> 3) ^ (key * 2654435761u);
+	for (int probe = 0; probe < DIAGNOSTIC_TABLE_SIZE; probe++)
+	{
+		Diagnostic* slot = &table[(hash + probe) & (DIAGNOSTIC_TABLE_SIZE - 1)];
+		if (!slot->fmt || (slot->fmt == fmt && slot->key == key)) return slot;
+	}
+	return NULL;
+}
+
+void diagnostic__(Log_level level, uint32_t key, const char* fmt, ...)
+{
+	Diagnostic* slot = find_slot(fmt, key);
+	if (slot && slot->fmt)
+	{
+		slot->total++;
+		slot->window++;
+		return;
+	}
+
+	//the table is kept under 3/4 full so probing stays short, anything new after that is only counted
+	if (!slot || used_slots >= DIAGNOSTIC_TABLE_SIZE * 3 / 4)
+	{
+		untracked++;
+		return;
+	}
+
+	if (window_start == 0.0) window_start = platform_now_seconds();
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+	va_end(args);
+
+	slot->fmt = fmt;
+	slot->key = key;
+	slot->level = level;
+	slot->total = 1;
+	slot->window = 0;
+	used_slots++;
+
+	log__(level, "%s", slot->text);
+}
+
+void diagnostics_tick()
+{
+	if (used_slots == 0) return;
+
+	double now = platform_now_seconds();
+	double elapsed = now - window_start;
+	if (elapsed < DIAGNOSTIC_SUMMARY_INTERVAL) return;
+
+	for (int i = 0; i < DIAGNOSTIC_TABLE_SIZE; i++)
+	{
+		Diagnostic* slot = &table[i];
+		if (!slot->fmt || slot->window == 0) continue;
+		log__(slot->level, "%s x %llu in the last %.1fs", slot->text, (unsigned long long)slot->window, elapsed);
+		slot->window = 0;
+	}
+	window_start = now;
+}
+
+void diagnostics_summary()
+{
+	for (int i = 0; i < DIAGNOSTIC_TABLE_SIZE; i++)
+	{
+		Diagnostic* slot = &table[i];
+		if (slot->fmt && slot->total > 1)
+			log__(slot->level, "%s x %llu in total", slot->text, (unsigned long long)slot->total);
+	}
+	if (untracked) log_warn("%llu more diagnostics were not tracked as too many different ones happened", (unsigned long long)untracked);
+
+	memset(table, 0, sizeof(table));
+	used_slots = 0;
+	untracked = 0;
+	window_start = 0.0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include "logger.h"
+
+/*
+ rate limited warnings for things that can happen on every bus access (unmapped addresses, unimplemented mappers).
+ each call site and key (usually the address) is logged the first time it happens, after that it is only counted
+ and diagnostics_tick writes one summary line a second for everything that kept happening:
+  [WARN] Attempted read at address 0x4017 on CPU bus, but there is no device defaulted to 0x00 x 120000 in the last 1.0s
+ fmt has to be a string literal, the pointer is what tells call sites apart.
+ only the emulation thread may use these.
+*/
+
+#define diag_warn(key, fmt, ...) diagnostic__(LOG_WARN, key, fmt, ##__VA_ARGS__)
+#define diag_critical(key, fmt, ...) diagnostic__(LOG_CRITICAL, key, fmt, ##__VA_ARGS__)
+
+void diagnostic__(Log_level level, uint32_t key, const char* fmt, ...);
+
+//writes the per second summaries if a second has passed, called once a frame
+void diagnostics_tick();
+
+//writes the totals of everything that happened more than once and starts counting from scratch
+void diagnostics_summary();
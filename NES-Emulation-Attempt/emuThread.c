@@ -0,0 +1,421 @@
+#include "emuThread.h"
+#include "nes.h"
+#include "ppu.h"
+#include "6502.h"
+#include "cartridge.h"
+#include "ram.h"
+#include "frameBuffer.h"
+#include "breakpoints.h"
+#include "cpuTrace.h"
+#include "cpuProfile.h"
+#include "timeline.h"
+#include "diagnostics.h"
+#include "platform.h"
+#include "logger.h"
+#include <string.h>
+
+#define COMMAND_QUEUE_SIZE 16
+#define MAX_ROM_PATH 260
+
+#define EMULATION_FPS 60.0
+#define FRAME_TIME (1.0 / EMULATION_FPS)
+
+//how often the achieved speed is recalculated
+#define SPEED_SAMPLE_TIME 0.5
+
+typedef struct {
+	Emu_command_type type;
+	int value; //only used by EMU_CMD_SET_SPEED and EMU_CMD_START_TIMELINE
+	char path[MAX_ROM_PATH]; //only used by EMU_CMD_LOAD_ROM, EMU_CMD_START_TRACE, EMU_CMD_STOP_PROFILE and EMU_CMD_START_TIMELINE
+}Emu_command;
+
+/*
+ single producer (ui) single consumer (emulation) ring,
+ head is only written by the producer and tail only by the consumer so no locking is needed
+*/
+static Emu_command command_queue[COMMAND_QUEUE_SIZE];
+static volatile int32_t queue_head = 0;
+static volatile int32_t queue_tail = 0;
+
+static volatile int32_t pending_events = 0;
+
+static Platform_thread* emulation_thread = NULL;
+
+static int speed_multiplier = 1; //owned by the emulation thread
+static double last_publish_time = 0.0;
+
+static volatile int32_t measured_fps_x100 = 0;
+static int speed_sample_frames = 0;
+static double speed_sample_start = 0.0;
+
+static Frame_time_histogram emulation_times;
+
+/*
+ published_state is only written by the emulation thread when it stops, state_sequence is odd while it is
+ being written so a ui read that overlaps a write sees the sequence change and copies it again
+*/
+static Emu_state published_state;
+static volatile int32_t state_sequence = 0;
+
+static bool push_command(const Emu_command* command)
+{
+	int32_t head = platform_atomic_load(&queue_head);
+	int32_t tail = platform_atomic_load(&queue_tail);
+	if (head - tail >= COMMAND_QUEUE_SIZE) {
+		log_warn("emulation command queue is full, dropped command %d", command->type);
+		return false;
+	}
+
+	command_queue[head % COMMAND_QUEUE_SIZE] = *command;
+	platform_atomic_store(&queue_head, head + 1);
+	return true;
+}
+
+static bool pop_command(Emu_command* command)
+{
+	int32_t tail = platform_atomic_load(&queue_tail);
+	if (tail == platform_atomic_load(&queue_head)) return false;
+
+	*command = command_queue[tail % COMMAND_QUEUE_SIZE];
+	platform_atomic_store(&queue_tail, tail + 1);
+	return true;
+}
+
+static void raise_event(Emu_event event)
+{
+	platform_atomic_or(&pending_events, event);
+}
+
+static void publish_state()
+{
+	//disassembling is the slow part so it is done before a reader can be made to wait
+	Cpu6502_Regs regs = cpu6502_get_regs();
+	Debug_instructions* disassembly = reset_debug_instructions(regs.pc);
+
+	int32_t sequence = platform_atomic_load(&state_sequence);
+	platform_atomic_store(&state_sequence, sequence + 1);
+	published_state.cpu = regs;
+	published_state.ppu = ppu_get_regs();
+	memcpy(published_state.disassembly, disassembly, sizeof(published_state.disassembly));
+	memcpy(published_state.ram, get_ram_buffer(), sizeof(published_state.ram));
+	for (int i = 0; i < 4; i++) memcpy(published_state.nametables[i], get_nametable_buffer(i), sizeof(published_state.nametables[i]));
+	platform_atomic_store(&state_sequence, sequence + 2);
+}
+
+//emulation has stopped, the frame and registers the debugger shows are published before the ui is told
+static void report_stop(Emu_event event)
+{
+	publish_frame(true);
+	publish_state();
+	raise_event(event);
+}
+
+bool post_emulation_command(Emu_command_type type)
+{
+	Emu_command command = { .type = type };
+	return push_command(&command);
+}
+
+bool post_load_rom_command(const char* path)
+{
+	Emu_command command = { .type = EMU_CMD_LOAD_ROM };
+	if (strlen(path) >= MAX_ROM_PATH) {
+		log_warn("rom path %s is too long", path);
+		return false;
+	}
+	strcpy(command.path, path);
+	return push_command(&command);
+}
+
+bool post_start_trace_command(const char* path)
+{
+	Emu_command command = { .type = EMU_CMD_START_TRACE };
+	if (strlen(path) >= MAX_ROM_PATH) {
+		log_warn("trace path %s is too long", path);
+		return false;
+	}
+	strcpy(command.path, path);
+	return push_command(&command);
+}
+
+bool post_stop_profile_command(const char* path)
+{
+	Emu_command command = { .type = EMU_CMD_STOP_PROFILE };
+	if (strlen(path) >= MAX_ROM_PATH) {
+		log_warn("profile path %s is too long", path);
+		return false;
+	}
+	strcpy(command.path, path);
+	return push_command(&command);
+}
+
+bool post_start_timeline_command(const char* path, int frames)
+{
+	Emu_command command = { .type = EMU_CMD_START_TIMELINE, .value = frames };
+	if (strlen(path) >= MAX_ROM_PATH) {
+		log_warn("timeline path %s is too long", path);
+		return false;
+	}
+	strcpy(command.path, path);
+	return push_command(&command);
+}
+
+bool post_speed_command(int multiplier)
+{
+	if (multiplier < 0) return false;
+	Emu_command command = { .type = EMU_CMD_SET_SPEED, .value = multiplier };
+	return push_command(&command);
+}
+
+double get_emulation_fps()
+{
+	return platform_atomic_load(&measured_fps_x100) / 100.0;
+}
+
+const Frame_time_histogram* get_emulation_frame_times()
+{
+	return &emulation_times;
+}
+
+int take_emulation_events()
+{
+	return platform_atomic_exchange(&pending_events, 0);
+}
+
+void get_emulation_state(Emu_state* state)
+{
+	int32_t sequence;
+	do {
+		sequence = platform_atomic_load(&state_sequence);
+		*state = published_state;
+	} while ((sequence & 1) || sequence != platform_atomic_load(&state_sequence));
+}
+
+void emulation_break()
+{
+	set_emulator_running(false);
+	report_stop(EMU_EVENT_BREAK);
+}
+
+/*
+ at real time every frame is shown, when running faster the presenter still only shows TARGET_FPS
+ so only frames that land after a full presenter interval get composed and published
+*/
+static bool frame_will_be_presented()
+{
+	if (speed_multiplier == 1) return true;
+	return platform_now_seconds() - last_publish_time >= FRAME_TIME;
+}
+
+static void sample_emulation_speed()
+{
+	speed_sample_frames++;
+	double now = platform_now_seconds();
+	double elapsed = now - speed_sample_start;
+	if (elapsed >= SPEED_SAMPLE_TIME)
+	{
+		platform_atomic_store(&measured_fps_x100, (int32_t)(speed_sample_frames / elapsed * 100.0));
+		speed_sample_frames = 0;
+		speed_sample_start = now;
+	}
+}
+
+/*
+ the cpu executes a whole instruction on its first cycle so a breakpoint is seen with the previous
+ instruction's cycles still counting down, those are finished here so emulation stops on an instruction boundary
+*/
+static void stop_at_breakpoint()
+{
+	while (get_cycles() != 0) nes_clock();
+	breakpoint_triggered = false;
+	emulation_break();
+}
+
+static void run_frame()
+{
+	uint64_t start = platform_now_ns();
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_EMULATE_BEGIN, 0, 0);
+	bool presented = frame_will_be_presented();
+	ppu_set_pixel_composition(presented);
+
+	while (!is_frame_complete())
+	{
+		nes_clock();
+		if (breakpoint_triggered)
+		{
+			stop_at_breakpoint();
+			if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_EMULATE_END, 0, 0);
+			return;
+		}
+	}
+
+	reset_frame_complete();
+	frame_time_record(&emulation_times, platform_now_ns() - start);
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_EMULATE_END, 0, 0);
+	sample_emulation_speed();
+	diagnostics_tick();
+	if (presented)
+	{
+		publish_frame(false);
+		last_publish_time = platform_now_seconds();
+	}
+}
+
+static void step_instruction()
+{
+	//stepping is for looking at the frame being drawn so it always has to be composed
+	ppu_set_pixel_composition(true);
+	wait_till_cpu_cycle();
+	nes_clock();
+	while (get_cycles() != 0) nes_clock();
+
+	//stepping onto a breakpoint is not a reason to stop the next run
+	breakpoint_triggered = false;
+}
+
+//returns true when the thread should exit
+static bool handle_command(const Emu_command* command)
+{
+	switch (command->type)
+	{
+	case EMU_CMD_RUN:
+		set_emulator_running(true);
+		break;
+	case EMU_CMD_PAUSE:
+		set_emulator_running(false);
+		report_stop(EMU_EVENT_STOPPED);
+		break;
+	case EMU_CMD_STEP:
+		if (is_emulator_running()) break;
+		step_instruction();
+		report_stop(EMU_EVENT_STOPPED);
+		break;
+	case EMU_CMD_RESET:
+		reset_nes();
+		report_stop(EMU_EVENT_STOPPED);
+		break;
+	case EMU_CMD_LOAD_ROM:
+		set_emulator_running(false);
+		remove_cartridge();
+		if (insert_cartridge(command->path) == -1) {
+			raise_event(EMU_EVENT_ROM_FAILED);
+			break;
+		}
+		reset_nes();
+		report_stop(EMU_EVENT_STOPPED);
+		break;
+	case EMU_CMD_SET_SPEED:
+		speed_multiplier = command->value;
+		log_info("emulation speed set to %dx", speed_multiplier);
+		break;
+	case EMU_CMD_START_TRACE:
+		start_cpu_trace(command->path, 0);
+		break;
+	case EMU_CMD_STOP_TRACE:
+		stop_cpu_trace(NULL);
+		break;
+	case EMU_CMD_START_PROFILE:
+		start_cpu_profile(0);
+		break;
+	case EMU_CMD_STOP_PROFILE:
+		stop_cpu_profile(command->path, NULL);
+		break;
+	case EMU_CMD_START_TIMELINE:
+		start_timeline(command->path, (uint32_t)command->value);
+		break;
+	case EMU_CMD_STOP_TIMELINE:
+		stop_timeline();
+		break;
+	case EMU_CMD_ENABLE_JIT:
+		cpu6502_set_jit(true);
+		break;
+	case EMU_CMD_DISABLE_JIT:
+		cpu6502_set_jit(false);
+		break;
+	case EMU_CMD_QUIT:
+		//a streamed trace still has its last block buffered, a timeline its closing brackets
+		stop_cpu_trace(NULL);
+		stop_timeline();
+		return true;
+	}
+	return false;
+}
+
+/*
+ sleeps until the next frame is due, the last couple of milliseconds are spun
+ as sleep is not precise enough on its own
+*/
+static void wait_for_next_frame(double* next_frame_time)
+{
+	if (speed_multiplier == EMU_SPEED_UNCAPPED) return;
+
+	*next_frame_time += FRAME_TIME / speed_multiplier;
+	double now = platform_now_seconds();
+
+	//fell too far behind (slow host or a long pause) so don't try to catch up with a burst of frames
+	if (now - *next_frame_time > FRAME_TIME * 4)
+	{
+		*next_frame_time = now;
+		return;
+	}
+
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_WAIT_BEGIN, 0, 0);
+	while (*next_frame_time - now > 0.002)
+	{
+		platform_sleep_ms(1);
+		now = platform_now_seconds();
+	}
+	while (now < *next_frame_time) now = platform_now_seconds();
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_WAIT_END, 0, 0);
+}
+
+static int emulation_thread_main(void* arg)
+{
+	(void)arg;
+	double next_frame_time = platform_now_seconds();
+
+	for (;;)
+	{
+		Emu_command command;
+		while (pop_command(&command))
+		{
+			if (handle_command(&command)) return 0;
+		}
+
+		if (!is_emulator_running())
+		{
+			platform_sleep_ms(1);
+			next_frame_time = platform_now_seconds();
+			speed_sample_start = next_frame_time;
+			speed_sample_frames = 0;
+			continue;
+		}
+
+		run_frame();
+		wait_for_next_frame(&next_frame_time);
+	}
+}
+
+bool start_emulation_thread()
+{
+	set_emulator_running(false);
+	publish_frame(true);
+	publish_state();
+
+	emulation_thread = platform_thread_create(emulation_thread_main, NULL);
+	if (!emulation_thread) {
+		log_critical("Failed to create emulation thread");
+		return false;
+	}
+	return true;
+}
+
+void stop_emulation_thread()
+{
+	if (!emulation_thread) return;
+
+	//the queue can only be full if the thread is stuck, keep trying rather than leak it
+	while (!post_emulation_command(EMU_CMD_QUIT)) platform_sleep_ms(1);
+	platform_thread_join(emulation_thread);
+	emulation_thread = NULL;
+}
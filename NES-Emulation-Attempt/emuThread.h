@@ -0,0 +1,117 @@
+#pragma once
+#include <stdbool.h>
+#include "frameTimes.h"
+#include "6502.h"
+#include "ppu.h"
+
+/*
+ the emulation core runs on its own thread, the ui never touches the nes directly while it is running.
+ instead it posts commands which the emulation thread drains between frames (or while paused),
+ and the emulation thread reports back through a set of event flags the ui polls.
+*/
+
+typedef enum {
+	EMU_CMD_RUN,
+	EMU_CMD_PAUSE,
+	EMU_CMD_STEP,
+	EMU_CMD_RESET,
+	EMU_CMD_LOAD_ROM,
+	EMU_CMD_SET_SPEED,
+	EMU_CMD_START_TRACE,
+	EMU_CMD_STOP_TRACE,
+	EMU_CMD_START_PROFILE,
+	EMU_CMD_STOP_PROFILE,
+	EMU_CMD_START_TIMELINE,
+	EMU_CMD_STOP_TIMELINE,
+	EMU_CMD_ENABLE_JIT,
+	EMU_CMD_DISABLE_JIT,
+	EMU_CMD_QUIT,
+}Emu_command_type;
+
+//speed multiplier that disables frame pacing entirely
+#define EMU_SPEED_UNCAPPED 0
+
+typedef enum {
+	EMU_EVENT_STOPPED = (1 << 0), //emulation was paused or finished a step/reset, the debugger views can be refreshed
+	EMU_EVENT_BREAK = (1 << 1), //a breakpoint stopped emulation
+	EMU_EVENT_ROM_FAILED = (1 << 2), //the rom from EMU_CMD_LOAD_ROM could not be loaded
+}Emu_event;
+
+/*
+ starts the emulation thread paused
+ returns false if the thread could not be created
+*/
+bool start_emulation_thread();
+
+//posts EMU_CMD_QUIT and waits for the thread to exit
+void stop_emulation_thread();
+
+/*
+ queues a command for the emulation thread (ui thread only)
+ returns false if the queue is full
+*/
+bool post_emulation_command(Emu_command_type type);
+
+/*
+ queues EMU_CMD_LOAD_ROM, the path is copied so the caller can discard it
+ returns false if the queue is full or the path is too long
+*/
+bool post_load_rom_command(const char* path);
+
+/*
+ queues EMU_CMD_SET_SPEED, multiplier is how many times faster than real time to run or EMU_SPEED_UNCAPPED.
+ above 1x frames that will not be presented skip pixel composition entirely
+ returns false if the queue is full
+*/
+bool post_speed_command(int multiplier);
+
+/*
+ queues EMU_CMD_START_TRACE which streams a binary cpu trace to path until EMU_CMD_STOP_TRACE
+ returns false if the queue is full or the path is too long
+*/
+bool post_start_trace_command(const char* path);
+
+/*
+ queues EMU_CMD_STOP_PROFILE which writes the cpu profile started by EMU_CMD_START_PROFILE to path as folded stacks
+ returns false if the queue is full or the path is too long
+*/
+bool post_stop_profile_command(const char* path);
+
+/*
+ queues EMU_CMD_START_TIMELINE which records a chrome trace event timeline to path,
+ it stops by itself after frames emulated frames or on EMU_CMD_STOP_TIMELINE if frames is 0
+ returns false if the queue is full or the path is too long
+*/
+bool post_start_timeline_command(const char* path, int frames);
+
+//emulated frames per second measured over the last half second, 60 means real time
+double get_emulation_fps();
+
+/*
+ how long each emulated frame took to run (not counting waiting for the next one),
+ written by the emulation thread so a summary read from the ui can be a frame behind
+*/
+const Frame_time_histogram* get_emulation_frame_times();
+
+//returns every Emu_event raised since the last call and clears them
+int take_emulation_events();
+
+typedef struct {
+	Cpu6502_Regs cpu;
+	Ppu_Regs ppu;
+	Debug_instructions disassembly[DEBUG_INSTRUCTIONS]; //starting at cpu.pc
+	uint8_t ram[0x800];
+	uint8_t nametables[4][0x400];
+}Emu_state;
+
+/*
+ copies out everything the debugger views show as it was the last time emulation stopped
+ (EMU_EVENT_STOPPED or EMU_EVENT_BREAK), the ui never reads the live cores. while running it is the state from before the last run
+*/
+void get_emulation_state(Emu_state* state);
+
+/*
+ called from inside the emulation thread to stop at the current instruction,
+ the ui is told through EMU_EVENT_BREAK
+*/
+void emulation_break();
@@ -0,0 +1,65 @@
+#include "frameBuffer.h"
+#include "platform.h"
+#include <string.h>
+
+#define FRESH_FRAME 0x4
+#define INDEX_MASK 0x3
+
+static uint32_t buffers[3][FRAME_HEIGHT][FRAME_WIDTH];
+
+static int back_index = 0; //owned by the emulation thread
+static int front_index = 1; //owned by the presenter
+static volatile int32_t middle_index = 2; //shared, FRESH_FRAME is set when the presenter has not seen it yet
+
+void set_pixel(int x, int y, uint32_t colour)
+{
+	if (x >= 0 && y >= 0 && x < FRAME_WIDTH && y < FRAME_HEIGHT)
+	{
+		buffers[back_index][y][x] = 0xFF000000 | (colour & 0xFFFFFF);
+	}
+}
+
+void fill_row(int y, uint32_t colour)
+{
+	if (y < 0 || y >= FRAME_HEIGHT) return;
+	for (int x = 0; x < FRAME_WIDTH; x++)
+	{
+		buffers[back_index][y][x] = 0xFF000000 | (colour & 0xFFFFFF);
+	}
+}
+
+void clear_frame_buffers(uint32_t colour)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		for (int y = 0; y < FRAME_HEIGHT; y++)
+		{
+			for (int x = 0; x < FRAME_WIDTH; x++)
+			{
+				buffers[i][y][x] = colour;
+			}
+		}
+	}
+}
+
+void publish_frame(bool keep_contents)
+{
+	int published = back_index;
+	back_index = platform_atomic_exchange(&middle_index, published | FRESH_FRAME) & INDEX_MASK;
+
+	//the presenter may be reading the published buffer at the same time, that is fine as both sides only read it
+	if (keep_contents) memcpy(buffers[back_index], buffers[published], sizeof(buffers[0]));
+}
+
+bool acquire_latest_frame()
+{
+	if (!(platform_atomic_load(&middle_index) & FRESH_FRAME)) return false;
+
+	front_index = platform_atomic_exchange(&middle_index, front_index) & INDEX_MASK;
+	return true;
+}
+
+const uint32_t* get_front_buffer()
+{
+	return &buffers[front_index][0][0];
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FRAME_WIDTH 256
+#define FRAME_HEIGHT 240
+
+/*
+ the ppu renders into a back buffer owned by the emulation thread while the presenter reads from a front buffer
+ owned by the ui thread, a third buffer sits in the middle and is swapped atomically with either side.
+ neither side ever waits on the other, if the presenter falls behind older frames are simply overwritten.
+*/
+
+//writes a pixel into the back buffer, out of range pixels are ignored
+void set_pixel(int x, int y, uint32_t colour);
+
+//sets a whole row of the back buffer to one colour, out of range rows are ignored
+void fill_row(int y, uint32_t colour);
+
+//fills every buffer with one colour, only safe to call while the presenter is not running
+void clear_frame_buffers(uint32_t colour);
+
+/*
+ hands the back buffer over to the presenter (emulation thread only)
+ if keep_contents is set the new back buffer starts as a copy of the published one,
+ used when publishing a partially rendered frame (step or break) so the rest of the frame is not drawn over stale data
+*/
+void publish_frame(bool keep_contents);
+
+/*
+ swaps in the most recently published frame if there is one (presenter only)
+ returns true if the front buffer changed since the last call
+*/
+bool acquire_latest_frame();
+
+//the front buffer as FRAME_HEIGHT rows of FRAME_WIDTH pixels (presenter only)
+const uint32_t* get_front_buffer();
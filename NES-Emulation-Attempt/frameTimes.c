@@ -0,0 +1,69 @@
+#include "frameTimes.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SUB_BUCKETS (1 << FRAME_TIME_SUB_BUCKET_BITS)
+
+static int highest_bit(uint64_t value)
+{
+	int bit = 0;
+	while (value >>= 1) bit++;
+	return bit;
+}
+
+//values below SUB_BUCKETS get a bucket each, above that each power of two is split into SUB_BUCKETS
+static int bucket_for(uint64_t ns)
+{
+	if (ns < SUB_BUCKETS) return (int)ns;
+	int top = highest_bit(ns);
+	int sub = (int)(ns >> (top - FRAME_TIME_SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	return ((top - FRAME_TIME_SUB_BUCKET_BITS + 1) << FRAME_TIME_SUB_BUCKET_BITS) + sub;
+}
+
+static uint64_t bucket_middle(int bucket)
+{
+	if (bucket < SUB_BUCKETS) return (uint64_t)bucket;
+	int shift = (bucket >> FRAME_TIME_SUB_BUCKET_BITS) - 1;
+	uint64_t lowest = (uint64_t)(SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+	return lowest + ((1ull << shift) >> 1);
+}
+
+void frame_time_record(Frame_time_histogram* histogram, uint64_t ns)
+{
+	histogram->buckets[bucket_for(ns)]++;
+	histogram->count++;
+	histogram->total_ns += ns;
+	if (ns > histogram->max_ns) histogram->max_ns = ns;
+}
+
+void frame_time_reset(Frame_time_histogram* histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+uint64_t frame_time_percentile(const Frame_time_histogram* histogram, double percentile)
+{
+	if (histogram->count == 0) return 0;
+	if (percentile >= 100.0) return histogram->max_ns;
+
+	uint64_t rank = (uint64_t)(histogram->count * percentile / 100.0);
+	uint64_t seen = 0;
+	for (int i = 0; i < FRAME_TIME_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen > rank)
+		{
+			//the middle of the top bucket can be past the real max
+			uint64_t middle = bucket_middle(i);
+			return middle < histogram->max_ns ? middle : histogram->max_ns;
+		}
+	}
+	return histogram->max_ns;
+}
+
+void format_frame_times(const Frame_time_histogram* histogram, char* out, int size)
+{
+	snprintf(out, size, "p50 %.2f p95 %.2f p99 %.2f max %.2f ms",
+		frame_time_percentile(histogram, 50.0) / 1e6, frame_time_percentile(histogram, 95.0) / 1e6,
+		frame_time_percentile(histogram, 99.0) / 1e6, histogram->max_ns / 1e6);
+}
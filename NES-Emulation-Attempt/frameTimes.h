@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ frame time histogram, an average fps hides stutter where percentiles don't.
+ buckets are logarithmic with 16 per power of two so any percentile is within about 3% of the real value,
+ recording is a few shifts and adds so it can run every frame on any thread (one writer per histogram).
+*/
+
+#define FRAME_TIME_SUB_BUCKET_BITS 4
+#define FRAME_TIME_BUCKETS ((64 - FRAME_TIME_SUB_BUCKET_BITS) << FRAME_TIME_SUB_BUCKET_BITS)
+
+typedef struct {
+	uint32_t buckets[FRAME_TIME_BUCKETS];
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+}Frame_time_histogram;
+
+void frame_time_record(Frame_time_histogram* histogram, uint64_t ns);
+
+void frame_time_reset(Frame_time_histogram* histogram);
+
+//percentile is 0 to 100, returns the middle of the bucket it lands in (the exact max for 100) or 0 if empty
+uint64_t frame_time_percentile(const Frame_time_histogram* histogram, double percentile);
+
+//writes "p50 16.67 p95 16.90 p99 17.80 max 24.10 ms" to out
+void format_frame_times(const Frame_time_histogram* histogram, char* out, int size);
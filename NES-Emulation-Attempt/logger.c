@@ -1,12 +1,310 @@
 #include "logger.h"
 #include "app.h"
-#include <Windows.h>
+#include "platform.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
 
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+/*
+ logging is asynchronous once log_initialise has run. a caller only copies the format pointer and its raw arguments
+ (strings are copied as they may not outlive the call) into a ring owned by its thread, a writer thread does the
+ formatting and writes whole batches to the console and log file. format strings have to be literals, which they
+ all are through the log_ macros.
+ a full ring drops the message and counts it, the writer reports how many were lost.
+ the headless tools never call log_initialise so they keep writing synchronously in order with their printf output.
+*/
+
+#define LOG_MAX_THREADS 8
+#define LOG_RING_SIZE 512 //records per thread, must be a power of 2
+#define LOG_MAX_ARGS 12
+#define LOG_TEXT_SIZE 128 //string arguments are copied into here, longer ones are cut short
+#define LOG_LINE_SIZE 2048
+#define LOG_BATCH_SIZE (64 * 1024)
+
+typedef union {
+	int64_t i;
+	uint64_t u;
+	double d;
+	const void* p;
+	uint32_t text; //offset of a copied string in the record's text
+}Log_arg;
+
+typedef struct {
+	const char* fmt;
+	uint64_t time; //only for merging the threads back into order
+	uint8_t level;
+	uint8_t arg_count;
+	uint16_t text_used;
+	Log_arg args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];
+}Log_record;
+
+typedef struct {
+	volatile int32_t owned;
+	volatile int32_t head; //written by the owning thread
+	volatile int32_t tail; //written by the writer thread
+	volatile int32_t dropped; //written by the owning thread
+	int32_t reported_dropped; //writer thread only
+	Log_record records[LOG_RING_SIZE];
+}Log_ring;
+
+static Log_ring rings[LOG_MAX_THREADS];
+
+//any threads past LOG_MAX_THREADS share this ring and take turns with a spin lock
+static Log_ring shared_ring;
+static volatile int32_t shared_lock = 0;
+
+static PLATFORM_THREAD_LOCAL Log_ring* thread_ring = NULL;
+
+static Platform_thread* writer_thread = NULL;
+static volatile int32_t writer_running = 0;
+
 FILE* log_file = NULL;
-FILE* console = NULL;
-HANDLE hConsole;
+
+static Log_level minimum_level = LOG_INFO;
+
+typedef enum {
+	ARG_NONE,
+	ARG_INT,
+	ARG_UINT,
+	ARG_CHAR,
+	ARG_DOUBLE,
+	ARG_POINTER,
+	ARG_STRING,
+}Arg_kind;
+
+typedef enum {
+	LENGTH_NONE,
+	LENGTH_HH,
+	LENGTH_H,
+	LENGTH_L,
+	LENGTH_LL,
+	LENGTH_Z,
+	LENGTH_J,
+	LENGTH_T,
+	LENGTH_BIG_L,
+}Arg_length;
+
+typedef struct {
+	Arg_kind kind;
+	Arg_length length;
+	int stars; //* widths and precisions, each takes an int argument before the value
+	const char* start; //first character after the %
+	const char* flags_end; //end of the flags, width and precision
+	const char* end; //the conversion character
+}Format_spec;
+
+//p is just past a %, stops on the conversion character
+static const char* parse_spec(const char* p, Format_spec* spec)
+{
+	spec->kind = ARG_NONE;
+	spec->length = LENGTH_NONE;
+	spec->stars = 0;
+	spec->start = p;
+
+	while (*p && strchr("-+ #0", *p)) p++;
+	if (*p == '*') { spec->stars++; p++; }
+	while (*p >= '0' && *p <= '9') p++;
+	if (*p == '.')
+	{
+		p++;
+		if (*p == '*') { spec->stars++; p++; }
+		while (*p >= '0' && *p <= '9') p++;
+	}
+	spec->flags_end = p;
+
+	switch (*p)
+	{
+	case 'h': p++; spec->length = LENGTH_H; if (*p == 'h') { p++; spec->length = LENGTH_HH; } break;
+	case 'l': p++; spec->length = LENGTH_L; if (*p == 'l') { p++; spec->length = LENGTH_LL; } break;
+	case 'z': p++; spec->length = LENGTH_Z; break;
+	case 'j': p++; spec->length = LENGTH_J; break;
+	case 't': p++; spec->length = LENGTH_T; break;
+	case 'L': p++; spec->length = LENGTH_BIG_L; break;
+	}
+
+	switch (*p)
+	{
+	case 'd': case 'i': spec->kind = ARG_INT; break;
+	case 'u': case 'x': case 'X': case 'o': spec->kind = ARG_UINT; break;
+	case 'c': spec->kind = ARG_CHAR; break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': spec->kind = ARG_DOUBLE; break;
+	case 'p': spec->kind = ARG_POINTER; break;
+	case 's': spec->kind = ARG_STRING; break;
+	}
+	spec->end = *p ? p : p - 1;
+	return spec->end;
+}
+
+static int64_t read_int(va_list* args, Arg_length length)
+{
+	switch (length)
+	{
+	case LENGTH_HH: return (signed char)va_arg(*args, int);
+	case LENGTH_H: return (short)va_arg(*args, int);
+	case LENGTH_L: return va_arg(*args, long);
+	case LENGTH_LL: return va_arg(*args, long long);
+	case LENGTH_Z: return (int64_t)va_arg(*args, size_t);
+	case LENGTH_J: return va_arg(*args, intmax_t);
+	case LENGTH_T: return va_arg(*args, ptrdiff_t);
+	default: return va_arg(*args, int);
+	}
+}
+
+static uint64_t read_uint(va_list* args, Arg_length length)
+{
+	switch (length)
+	{
+	case LENGTH_HH: return (unsigned char)va_arg(*args, unsigned int);
+	case LENGTH_H: return (unsigned short)va_arg(*args, unsigned int);
+	case LENGTH_L: return va_arg(*args, unsigned long);
+	case LENGTH_LL: return va_arg(*args, unsigned long long);
+	case LENGTH_Z: return va_arg(*args, size_t);
+	case LENGTH_J: return va_arg(*args, uintmax_t);
+	case LENGTH_T: return (uint64_t)va_arg(*args, ptrdiff_t);
+	default: return va_arg(*args, unsigned int);
+	}
+}
+
+//copies the raw arguments, nothing is formatted here
+static void capture_record(Log_record* record, Log_level level, const char* fmt, va_list* args)
+{
+	record->fmt = fmt;
+	record->time = platform_now_ns();
+	record->level = (uint8_t)level;
+	record->arg_count = 0;
+	record->text_used = 0;
+
+	for (const char* p = fmt; *p; p++)
+	{
+		if (*p != '%') continue;
+		if (p[1] == '%') { p++; continue; }
+
+		Format_spec spec;
+		p = parse_spec(p + 1, &spec);
+		if (spec.kind == ARG_NONE) continue;
+		if (record->arg_count + spec.stars + 1 > LOG_MAX_ARGS) return;
+
+		for (int i = 0; i < spec.stars; i++) record->args[record->arg_count++].i = va_arg(*args, int);
+
+		Log_arg* arg = &record->args[record->arg_count++];
+		switch (spec.kind)
+		{
+		case ARG_INT: arg->i = read_int(args, spec.length); break;
+		case ARG_UINT: arg->u = read_uint(args, spec.length); break;
+		case ARG_CHAR: arg->i = va_arg(*args, int); break;
+		case ARG_DOUBLE: arg->d = spec.length == LENGTH_BIG_L ? (double)va_arg(*args, long double) : va_arg(*args, double); break;
+		case ARG_POINTER: arg->p = va_arg(*args, void*); break;
+		case ARG_STRING:
+		{
+			const char* text = va_arg(*args, const char*);
+			if (!text) text = "(null)";
+			//once the text is full every later string points at the last terminator
+			if (record->text_used >= LOG_TEXT_SIZE) {
+				arg->text = LOG_TEXT_SIZE - 1;
+				break;
+			}
+			int space = LOG_TEXT_SIZE - record->text_used - 1;
+			int len = (int)strlen(text);
+			if (len > space) len = space;
+
+			arg->text = record->text_used;
+			memcpy(record->text + record->text_used, text, len);
+			record->text[record->text_used + len] = '\0';
+			record->text_used += (uint16_t)(len + 1);
+			break;
+		}
+		default: break;
+		}
+	}
+}
+
+/*
+ formats a record one conversion at a time, each is rebuilt with its * replaced by the captured values
+ and the integer length widened to ll to match how it was stored
+*/
+static int format_record(const Log_record* record, char* out, int size)
+{
+	int used = 0;
+	int next_arg = 0;
+
+	for (const char* p = record->fmt; *p && used < size - 1; p++)
+	{
+		if (*p != '%') { out[used++] = *p; continue; }
+		if (p[1] == '%') { out[used++] = '%'; p++; continue; }
+
+		Format_spec spec;
+		const char* percent = p;
+		p = parse_spec(p + 1, &spec);
+		if (spec.kind == ARG_NONE || next_arg + spec.stars + 1 > record->arg_count)
+		{
+			//ran out of captured arguments, the conversion is printed as it was written
+			int len = (int)(p - percent) + 1;
+			if (len > size - 1 - used) len = size - 1 - used;
+			memcpy(out + used, percent, len);
+			used += len;
+			continue;
+		}
+
+		char spec_text[64];
+		int spec_len = 0;
+		spec_text[spec_len++] = '%';
+		for (const char* c = spec.start; c < spec.flags_end && spec_len < 40; c++)
+		{
+			if (*c == '*') spec_len += snprintf(spec_text + spec_len, sizeof(spec_text) - spec_len, "%d", (int)record->args[next_arg++].i);
+			else spec_text[spec_len++] = *c;
+		}
+		if (spec.kind == ARG_INT || spec.kind == ARG_UINT) { spec_text[spec_len++] = 'l'; spec_text[spec_len++] = 'l'; }
+		spec_text[spec_len++] = *spec.end;
+		spec_text[spec_len] = '\0';
+
+		const Log_arg* arg = &record->args[next_arg++];
+		int written = 0;
+		switch (spec.kind)
+		{
+		case ARG_INT: written = snprintf(out + used, size - used, spec_text, (long long)arg->i); break;
+		case ARG_UINT: written = snprintf(out + used, size - used, spec_text, (unsigned long long)arg->u); break;
+		case ARG_CHAR: written = snprintf(out + used, size - used, spec_text, (int)arg->i); break;
+		case ARG_DOUBLE: written = snprintf(out + used, size - used, spec_text, arg->d); break;
+		case ARG_POINTER: written = snprintf(out + used, size - used, spec_text, arg->p); break;
+		case ARG_STRING: written = snprintf(out + used, size - used, spec_text, record->text + arg->text); break;
+		default: break;
+		}
+		if (written > 0) used += written < size - used ? written : size - 1 - used;
+	}
+
+	out[used] = '\0';
+	return used;
+}
+
+static const char* level_text(Log_level level)
+{
+	switch (level) {
+	case LOG_INFO:     return "[INFO]";
+	case LOG_DEBUG:    return "[DEBUG]";
+	case LOG_WARN:     return "[WARN]";
+	case LOG_CRITICAL: return "[CRITICAL]";
+	default:           return "[INFO]";
+	}
+}
+
+#ifdef _WIN32
+static HANDLE hConsole;
+static FILE* console = NULL;
 
 #define C_BLACK   0
 #define C_RED     FOREGROUND_RED
@@ -33,82 +331,273 @@ static BOOL WINAPI console_ctrl_handler(DWORD ctrl_type)
 	}
 }
 
+static void open_console()
+{
+	AllocConsole();
+	SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
+
+	freopen_s(&console, "CONIN$", "r", stdin);
+	freopen_s(&console, "CONOUT$", "w", stdout);
+	freopen_s(&console, "CONOUT$", "w", stderr);
+
+	// Optional: nicer title
+	SetConsoleTitleA("NES Emulator Log");
+	hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+}
+
+static void close_console()
+{
+	if (console) {
+		fclose(console);
+		console = NULL;
+	}
+}
+
+static void write_console(Log_level level, const char* text, size_t len)
+{
+	WORD colour;
+	switch (level) {
+	case LOG_DEBUG:    colour = C_GREEN;  break;
+	case LOG_WARN:     colour = C_YELLOW; break;
+	case LOG_CRITICAL: colour = C_RED;    break;
+	default:           colour = C_WHITE;  break;
+	}
+
+	if (colour != C_WHITE) SetConsoleTextAttribute(hConsole, colour);
+	fwrite(text, 1, len, stdout);
+	fflush(stdout);
+	if (colour != C_WHITE) SetConsoleTextAttribute(hConsole, C_WHITE);
+}
+
+static int make_log_directory()
+{
+	return _mkdir("log");
+}
+
+static void local_time(const time_t* t, struct tm* out)
+{
+	localtime_s(out, t);
+}
+#else
+static void open_console() {}
+static void close_console() {}
+
+static void write_console(Log_level level, const char* text, size_t len)
+{
+	const char* colour = NULL;
+	switch (level) {
+	case LOG_DEBUG:    colour = "\x1b[32m"; break;
+	case LOG_WARN:     colour = "\x1b[33m"; break;
+	case LOG_CRITICAL: colour = "\x1b[31m"; break;
+	default: break;
+	}
+
+	if (colour && !isatty(fileno(stdout))) colour = NULL;
+	if (colour) fputs(colour, stdout);
+	fwrite(text, 1, len, stdout);
+	if (colour) fputs("\x1b[0m", stdout);
+	fflush(stdout);
+}
+
+static int make_log_directory()
+{
+	return mkdir("log", 0755);
+}
+
+static void local_time(const time_t* t, struct tm* out)
+{
+	localtime_r(t, out);
+}
+#endif
+
+/*
+ takes records from every ring oldest first until they are empty or the batch is full,
+ the console gets one write per run of lines with the same colour and the file one write per batch
+*/
+static bool drain_rings()
+{
+	static char batch[LOG_BATCH_SIZE];
+	int used = 0;
+	int run_start = 0;
+	Log_level run_level = LOG_INFO;
+	bool found = false;
+
+	Log_ring* all[LOG_MAX_THREADS + 1];
+	int32_t heads[LOG_MAX_THREADS + 1];
+	for (int i = 0; i < LOG_MAX_THREADS; i++) all[i] = &rings[i];
+	all[LOG_MAX_THREADS] = &shared_ring;
+	for (int i = 0; i <= LOG_MAX_THREADS; i++) heads[i] = platform_atomic_load(&all[i]->head);
+
+	for (;;)
+	{
+		Log_ring* oldest = NULL;
+		for (int i = 0; i <= LOG_MAX_THREADS; i++)
+		{
+			Log_ring* ring = all[i];
+			if (ring->tail == heads[i]) continue;
+			if (!oldest || ring->records[ring->tail & (LOG_RING_SIZE - 1)].time < oldest->records[oldest->tail & (LOG_RING_SIZE - 1)].time)
+				oldest = ring;
+		}
+		if (!oldest || used > LOG_BATCH_SIZE - LOG_LINE_SIZE - 64) break;
+
+		const Log_record* record = &oldest->records[oldest->tail & (LOG_RING_SIZE - 1)];
+		Log_level level = (Log_level)record->level;
+		if (level != run_level && used > run_start)
+		{
+			write_console(run_level, batch + run_start, used - run_start);
+			run_start = used;
+		}
+		run_level = level;
+
+		used += snprintf(batch + used, LOG_BATCH_SIZE - used, "%s ", level_text(level));
+		used += format_record(record, batch + used, LOG_LINE_SIZE);
+		batch[used++] = '\n';
+		platform_atomic_store(&oldest->tail, oldest->tail + 1);
+		found = true;
+	}
+
+	//losing messages is worth knowing about, the count goes after whatever did make it
+	for (int i = 0; i <= LOG_MAX_THREADS; i++)
+	{
+		int32_t dropped = platform_atomic_load(&all[i]->dropped);
+		if (dropped == all[i]->reported_dropped) continue;
+		if (run_level != LOG_WARN && used > run_start)
+		{
+			write_console(run_level, batch + run_start, used - run_start);
+			run_start = used;
+		}
+		run_level = LOG_WARN;
+		used += snprintf(batch + used, LOG_BATCH_SIZE - used, "[WARN] log ring full, dropped %d messages\n", dropped - all[i]->reported_dropped);
+		all[i]->reported_dropped = dropped;
+		found = true;
+	}
+
+	if (used > run_start) write_console(run_level, batch + run_start, used - run_start);
+	if (log_file && used > 0)
+	{
+		fwrite(batch, 1, used, log_file);
+		fflush(log_file);
+	}
+	return found;
+}
+
+static int log_writer_main(void* arg)
+{
+	(void)arg;
+	while (platform_atomic_load(&writer_running))
+	{
+		if (!drain_rings()) platform_sleep_ms(1);
+	}
+	while (drain_rings());
+	return 0;
+}
+
+static Log_ring* claim_ring()
+{
+	for (int i = 0; i < LOG_MAX_THREADS; i++)
+	{
+		if (platform_atomic_exchange(&rings[i].owned, 1) == 0) return &rings[i];
+	}
+	return &shared_ring;
+}
+
+static void push_record(Log_level level, const char* fmt, va_list* args)
+{
+	if (!thread_ring) thread_ring = claim_ring();
+	Log_ring* ring = thread_ring;
+
+	bool shared = ring == &shared_ring;
+	if (shared) while (platform_atomic_exchange(&shared_lock, 1) != 0);
+
+	int32_t head = ring->head;
+	if (head - platform_atomic_load(&ring->tail) >= LOG_RING_SIZE) platform_atomic_store(&ring->dropped, ring->dropped + 1);
+	else
+	{
+		capture_record(&ring->records[head & (LOG_RING_SIZE - 1)], level, fmt, args);
+		platform_atomic_store(&ring->head, head + 1);
+	}
+
+	if (shared) platform_atomic_store(&shared_lock, 0);
+}
+
 int log_initialise()
 {
 	//ensure that log folder exists
-	if (_mkdir("log") != 0 && errno != EEXIST) return -1;
+	if (make_log_directory() != 0 && errno != EEXIST) return -1;
 
 	//create new log file
 	time_t t = time(NULL);
 	struct tm currentDate;
-	localtime_s(&currentDate,&t);
+	local_time(&t, &currentDate);
 	char fileName[256];
 
 	snprintf(fileName, sizeof(fileName),"log/%04d-%02d-%02d-%02d-%02d-log.txt",
 		currentDate.tm_year+1900, currentDate.tm_mon+1, currentDate.tm_mday,
 		currentDate.tm_hour, currentDate.tm_min);
 
-	fopen_s(&log_file,fileName, "wb+");
+	log_file = fopen(fileName, "wb+");
 
 	if (!log_file) return -1;
 
-	AllocConsole();
-	SetConsoleCtrlHandler(console_ctrl_handler ,TRUE);
+	open_console();
 
-	freopen_s(&console, "CONIN$", "r", stdin);
-	freopen_s(&console, "CONOUT$", "w", stdout);
-	freopen_s(&console, "CONOUT$", "w", stderr);
+	platform_atomic_store(&writer_running, 1);
+	writer_thread = platform_thread_create(log_writer_main, NULL);
+	if (!writer_thread) platform_atomic_store(&writer_running, 0);
 
-	// Optional: nicer title
-	SetConsoleTitleA("NES Emulator Log");
-	hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+	//early exits from WinMain skip deinitialise_app, this still gets the last messages out
+	static bool exit_registered = false;
+	if (!exit_registered) {
+		atexit(log_deinialise);
+		exit_registered = true;
+	}
 
 	log_info("Logger initialised");
 
 	return 0;
 }
 
-static void set_colour(WORD colour)
-{
-	SetConsoleTextAttribute(hConsole, colour);
-}
-
 void log_deinialise()
 {
+	if (writer_thread) {
+		platform_atomic_store(&writer_running, 0);
+		platform_thread_join(writer_thread);
+		writer_thread = NULL;
+	}
 	if (log_file){
 		fclose(log_file);
 		log_file = NULL;
 	}
-	if (console){
-		fclose(console);
-		console = NULL;
-	}
+	close_console();
+}
+
+void log_set_level(Log_level minimum)
+{
+	minimum_level = minimum;
 }
 
 void log__(Log_level level, const char* fmt, ...)
 {
-	const char* level_text;
-	WORD colour;
-	switch (level) {
-	case LOG_INFO:     level_text = "[INFO]";     colour = C_WHITE;  break;
-	case LOG_DEBUG:    level_text = "[DEBUG]";    colour = C_GREEN;  break;
-	case LOG_WARN:     level_text = "[WARN]";     colour = C_YELLOW; break;
-	case LOG_CRITICAL: level_text = "[CRITICAL]"; colour = C_RED;    break;
-	default:           level_text = "[INFO]";     colour = C_WHITE;  break;
-	}
+	if (level < minimum_level) return;
 
 	va_list args;
 	va_start(args, fmt);
 
-	char buf[2048];
-	vsnprintf(buf, sizeof(buf), fmt, args);
-	char buf2[2048];
-	snprintf(buf2, sizeof(buf2), "%s %s\n", level_text, buf);
+	if (platform_atomic_load(&writer_running))
+	{
+		push_record(level, fmt, &args);
+		va_end(args);
+		return;
+	}
 
-	set_colour(colour);
-	fputs(buf2, stdout);
-	set_colour(C_WHITE);
+	char buf[LOG_LINE_SIZE];
+	int len = snprintf(buf, sizeof(buf), "%s ", level_text(level));
+	len += vsnprintf(buf + len, sizeof(buf) - len - 1, fmt, args);
+	if (len > (int)sizeof(buf) - 2) len = sizeof(buf) - 2;
+	buf[len++] = '\n';
+	buf[len] = '\0';
 
-	if (log_file)fputs(buf2, log_file);
+	write_console(level, buf, len);
+	if (log_file) fputs(buf, log_file);
 	va_end(args);
 }
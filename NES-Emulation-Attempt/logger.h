@@ -11,6 +11,9 @@ int log_initialise();
 void log_deinialise();
 void log__(Log_level level, const char* fmt, ...);
 
+//messages below minimum are dropped, the headless tools use this to keep their output readable
+void log_set_level(Log_level minimum);
+
 #define log_info(fmt, ...) log__(LOG_INFO, fmt, ##__VA_ARGS__)
 #ifdef _DEBUG
     #define log_debug(fmt, ...) log__(LOG_DEBUG, fmt, ##__VA_ARGS__)
@@ -1,11 +1,137 @@
 #include <windows.h>
 #include <stdio.h>
 #include "app.h"
+#include "cpuTrace.h"
+#include "traceIndex.h"
+#include "nestest.h"
+#include "regress.h"
+#include "perfCounters.h"
+#include "cpuProfile.h"
+#include "timeline.h"
+#include "bench.h"
+#include "6502.h"
+#include "nes.h"
+
+//the x64 build is a windows subsystem app, tools print to the console they were started from
+static void attach_console()
+{
+	if (!AttachConsole(ATTACH_PARENT_PROCESS)) return;
+	FILE* f;
+	freopen_s(&f, "CONOUT$", "w", stdout);
+	freopen_s(&f, "CONOUT$", "w", stderr);
+}
+
+static bool has_flag(int argc, char** argv, const char* flag)
+{
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], flag) == 0) return true;
+	}
+	return false;
+}
+
+static int run_regression_tool(int argc, char** argv)
+{
+	bool update = has_flag(argc, argv, "--update");
+	if (strcmp(argv[1], "--regress-rom") == 0) return run_regression_rom(argv[2], update);
+
+	int jobs = 0;
+	for (int i = 3; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--jobs") == 0) jobs = atoi(argv[i + 1]);
+	}
+	return run_regression_suite(argv[2], update, jobs) == 0 ? 0 : 1;
+}
+
+static int run_perf_tool(int argc, char** argv)
+{
+	uint32_t frames = 3600;
+	uint32_t interval = 60;
+	const char* out_path = NULL;
+	for (int i = 3; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0) frames = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--every") == 0) interval = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--out") == 0) out_path = argv[i + 1];
+	}
+	Perf_format format = has_flag(argc, argv, "--json") ? PERF_FORMAT_JSON : PERF_FORMAT_CSV;
+	return run_perf_capture(argv[2], frames, interval, format, out_path, has_flag(argc, argv, "--host-counters"));
+}
+
+static int run_profile_tool(int argc, char** argv)
+{
+	uint32_t frames = 3600;
+	uint32_t interval = 0;
+	const char* symbols = NULL;
+	for (int i = 4; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--frames") == 0) frames = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--interval") == 0) interval = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--symbols") == 0) symbols = argv[i + 1];
+	}
+	return profile_rom(argv[2], argv[3], frames, interval, symbols);
+}
+
+static int run_bench_tool(int argc, char** argv)
+{
+	Bench_options options = { .warmup = 1, .reps = 5, .threshold = 10.0 };
+	for (int i = 3; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--warmup") == 0) options.warmup = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--reps") == 0) options.reps = (uint32_t)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--threshold") == 0) options.threshold = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--filter") == 0) options.filter = argv[i + 1];
+		else if (strcmp(argv[i], "--baseline") == 0) options.baseline_path = argv[i + 1];
+		else if (strcmp(argv[i], "--save") == 0) options.save_path = argv[i + 1];
+	}
+	return run_benchmarks(argv[2], &options);
+}
+
+static int run_tool(int argc, char** argv)
+{
+	attach_console();
+
+	//any tool that runs roms can run them through the recompiler or the accurate cores, the regression suite passes both on to each rom
+	if (has_flag(argc, argv, "--jit")) cpu6502_set_jit(true);
+	if (has_flag(argc, argv, "--accurate")) nes_select_profile(NES_PROFILE_ACCURATE);
+
+	//regression runs have their own exit codes, the suite reads them from each rom's process
+	if (strncmp(argv[1], "--regress", 9) == 0)
+		return run_regression_tool(argc, argv);
+
+	int result = -1;
+	if (strcmp(argv[1], "--decode-trace") == 0)
+		result = decode_cpu_trace(argv[2], argc >= 4 ? argv[3] : NULL);
+	else if (strcmp(argv[1], "--index-trace") == 0)
+		result = build_trace_index(argv[2]);
+	else if (strcmp(argv[1], "--query-trace") == 0)
+		result = query_cpu_trace(argv[2], argc - 3, argv + 3);
+	else if (strcmp(argv[1], "--profile") == 0 && argc >= 4)
+		result = run_profile_tool(argc, argv);
+	else if (strcmp(argv[1], "--timeline") == 0 && argc >= 4)
+		result = timeline_rom(argv[2], argv[3], argc >= 6 && strcmp(argv[4], "--frames") == 0 ? (uint32_t)atoi(argv[5]) : 1);
+	else if (strcmp(argv[1], "--bench") == 0)
+		result = run_bench_tool(argc, argv);
+	else if (strcmp(argv[1], "--perf") == 0)
+		result = run_perf_tool(argc, argv);
+	else if (strcmp(argv[1], "--nestest") == 0 || strcmp(argv[1], "--nestest-regs") == 0)
+		result = run_nestest(argv[2], argc >= 4 ? argv[3] : "nestest.nes", strcmp(argv[1], "--nestest") == 0);
+	else
+		fprintf(stderr, "unknown option %s\n", argv[1]);
+
+	return result == 0 ? 0 : 1;
+}
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd){
 
 	char romPath[MAX_PATH] = { 0 };
 
+	//offline tools share the exe, they run without creating any windows
+	if (__argc >= 3 && strncmp(__argv[1], "--", 2) == 0)
+	{
+		return run_tool(__argc, __argv);
+	}
+
 	if (lpCmdLine && lpCmdLine[0])
 	{
 		// Remove quotes if present
@@ -3,11 +3,30 @@
 #include "6502.h"
 #include "ppu.h"
 #include "logger.h"
+#include "diagnostics.h"
+#include "perfCounters.h"
+#include "platform.h"
 #include <stdint.h>
 #include <time.h>
 
 uint64_t SystemCounter = 0;
 
+static Nes_profile selected_profile = NES_PROFILE_FAST;
+
+static void nes_clock_fast();
+static void nes_clock_accurate();
+void (*nes_clock)() = nes_clock_fast;
+
+void nes_select_profile(Nes_profile profile)
+{
+	selected_profile = profile;
+}
+
+Nes_profile nes_get_profile()
+{
+	return selected_profile;
+}
+
 int initialise_nes()
 {
 	//create a registry of bus devices for the cpu bus
@@ -20,7 +39,7 @@ int initialise_nes()
 	}
 
 	if(lock_device_registry(cpu_bus) == -1) return -1;
-	initialize_6502_cpu(cpu_bus);
+	initialize_6502_cpu(cpu_bus, selected_profile);
 
 	//create registry of bus devices for the ppu bus
 	Bus* ppu_bus = get_bus(2);
@@ -32,7 +51,10 @@ int initialise_nes()
 	}
 
 	if (lock_device_registry(ppu_bus) == -1) return -1;
-	initialise_ppu(ppu_bus);	
+	initialise_ppu(ppu_bus, selected_profile);
+
+	nes_clock = selected_profile == NES_PROFILE_ACCURATE ? nes_clock_accurate : nes_clock_fast;
+	log_info("using the %s profile", selected_profile == NES_PROFILE_ACCURATE ? "accurate" : "fast");
 
 	return 0;
 }
@@ -47,10 +69,12 @@ void reset_nes()
 
 void deinitalise_nes()
 {
+	diagnostics_summary();
 	free_buses();
 }
 
-bool emulator_running = false;
+//written by the emulation thread, read by the ui
+volatile bool emulator_running = false;
 void set_emulator_running(bool run)
 {
 	emulator_running = run;
@@ -69,19 +93,111 @@ void wait_till_cpu_cycle()
 	}
 };
 
-void nes_clock(){
+uint64_t get_cpu_cycle_count()
+{
+	return SystemCounter / 3;
+}
 
+uint64_t get_master_clock_count()
+{
+	return SystemCounter;
+}
+
+#ifdef PERF_COUNTERS
+//same as nes_clock but timing the ppu and cpu, the interval is not a multiple of 3 so a third of the timed clocks include the cpu
+static void timed_nes_clock()
+{
+	double start = platform_now_seconds();
 	ppu_clock();
+	double ppu_done = platform_now_seconds();
 	if (SystemCounter % 3 == 0)
 	{
 		cpu_6502_clock();
 	}
+	perf_add_clock_time(ppu_done - start, platform_now_seconds() - ppu_done);
+}
+#endif
+
+static void service_nmi()
+{
+	nmi();
+	nmi_acknolodged();
+#ifdef PERF_COUNTERS
+	perf_count_nmi();
+#endif
+}
+
+/*
+ a cpu part way through a long count down (a skipped idle loop or a jit run) can't touch the ppu until it is done,
+ so with rendering off the ppu can be moved on to the end of it in one go
+*/
+#define BLANK_SKIP_MIN_CYCLES 16
+
+static bool blank_skip_refused = false; //the ppu could not skip, don't ask again until the count down is over
 
-	if (ppu_nmi())
+static void skip_blank_dots()
+{
+	int cpu_cycles = get_cycles();
+	if (cpu_cycles < BLANK_SKIP_MIN_CYCLES)
+	{
+		blank_skip_refused = false;
+		return;
+	}
+	if (blank_skip_refused) return;
+
+	//the cpu is clocked on every third master clock, it can't be clocked more times than it has cycles left
+	uint32_t first_cpu_clock = (uint32_t)((3 - SystemCounter % 3) % 3);
+	uint32_t dots = ppu_skip_blank_dots(first_cpu_clock + 3 * (uint32_t)cpu_cycles);
+	if (!dots) {
+		blank_skip_refused = true;
+		return;
+	}
+
+	uint32_t cpu_clocks = dots > first_cpu_clock ? (dots - first_cpu_clock - 1) / 3 + 1 : 0;
+	set_cycles(cpu_cycles - (int)cpu_clocks);
+	SystemCounter += dots;
+}
+
+static void nes_clock_fast(){
+
+	bool cpu_clock = SystemCounter % 3 == 0;
+
+#ifdef PERF_COUNTERS
+	if (SystemCounter % PERF_TIME_SAMPLE_INTERVAL == 0) timed_nes_clock();
+	else
+#endif
 	{
-		nmi();
-		nmi_acknolodged();
+		ppu_clock_fast();
+		if (cpu_clock)
+		{
+			cpu_6502_clock_fast();
+		}
 	}
+
+	if (ppu_nmi()) service_nmi();
 	
 	SystemCounter++;
+
+	//a count down can only start on a cpu clock
+	if (cpu_clock) skip_blank_dots();
+}
+
+//the nmi waits for the instruction in flight to finish instead of cutting its last cycles short
+static void nes_clock_accurate(){
+
+#ifdef PERF_COUNTERS
+	if (SystemCounter % PERF_TIME_SAMPLE_INTERVAL == 0) timed_nes_clock();
+	else
+#endif
+	{
+		ppu_clock_accurate();
+		if (SystemCounter % 3 == 0)
+		{
+			cpu_6502_clock_accurate();
+		}
+	}
+
+	if (ppu_nmi() && get_cycles() == 0) service_nmi();
+
+	SystemCounter++;
 }
\ No newline at end of file
@@ -1,5 +1,19 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+
+/*
+ the cpu and ppu are built twice from the same source, initialise_nes wires up the profile that was selected
+ and nothing checks it again while clocking
+*/
+typedef enum {
+	NES_PROFILE_FAST, //whole instructions on their first cycle, the background drawn a scanline at a time unless the cpu touches the ppu part way through one
+	NES_PROFILE_ACCURATE, //cpu accesses on their last cycle with the dummy reads and writes, the background drawn a dot at a time
+}Nes_profile;
+
+//only takes effect at the next initialise_nes
+void nes_select_profile(Nes_profile profile);
+Nes_profile nes_get_profile();
 
 int initialise_nes();
 void reset_nes();
@@ -7,4 +21,10 @@ void deinitalise_nes();
 void set_emulator_running(bool run);
 bool is_emulator_running();
 void wait_till_cpu_cycle();
-void nes_clock();
\ No newline at end of file
+extern void (*nes_clock)();
+
+//cpu cycles since the last reset
+uint64_t get_cpu_cycle_count();
+
+//master clocks since the last reset, the ppu draws one dot per master clock
+uint64_t get_master_clock_count();
\ No newline at end of file
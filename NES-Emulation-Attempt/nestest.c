@@ -0,0 +1,204 @@
+#include "nestest.h"
+#include "nes.h"
+#include "6502.h"
+#include "ppu.h"
+#include "bus.h"
+#include "cartridge.h"
+#include "cpuTrace.h"
+#include "frameTimes.h"
+#include "platform.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+
+//lines of both sides shown before a divergence
+#define CONTEXT_LINES 8
+
+//how long the throughput run lasts, roughly 10 seconds of nes time
+#define THROUGHPUT_FRAMES 600
+
+typedef struct {
+	uint16_t pc;
+	uint8_t a, x, y, p, sp;
+	uint64_t cycle;
+}Nestest_state;
+
+typedef struct {
+	char expected[CONTEXT_LINES][256];
+	Trace_record actual[CONTEXT_LINES];
+	int count;
+}Nestest_context;
+
+//pulls the fields out of a line like "C000  4C F5 C5  JMP $C5F5   A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7"
+static bool parse_log_line(const char* line, Nestest_state* state)
+{
+	unsigned int pc, a, x, y, p, sp;
+	unsigned long long cycle;
+	const char* regs = strstr(line, "A:");
+	const char* cyc = strstr(line, "CYC:");
+	if (!regs || !cyc) return false;
+
+	if (sscanf(line, "%4x", &pc) != 1) return false;
+	if (sscanf(regs, "A:%2x X:%2x Y:%2x P:%2x SP:%2x", &a, &x, &y, &p, &sp) != 5) return false;
+	if (sscanf(cyc, "CYC:%llu", &cycle) != 1) return false;
+
+	state->pc = (uint16_t)pc;
+	state->a = (uint8_t)a; state->x = (uint8_t)x; state->y = (uint8_t)y;
+	state->p = (uint8_t)p; state->sp = (uint8_t)sp;
+	state->cycle = cycle;
+	return true;
+}
+
+//snapshot of the emulator in trace form so the context can be printed like the log
+static void capture_state(Trace_record* r, uint64_t cycle)
+{
+	const Bus* bus = get_bus(1);
+	Cpu6502_Regs regs = cpu6502_get_regs();
+	memset(r, 0, sizeof(Trace_record));
+	r->pc = regs.pc;
+	for (int i = 0; i < 3; i++) r->bytes[i] = bus_read_underlying(bus, (uint16_t)(regs.pc + i));
+	r->a = regs.a; r->x = regs.x; r->y = regs.y; r->sp = regs.sp; r->p = regs.status;
+	r->scanline = (int16_t)ppu_get_scanline();
+	r->dot = (uint16_t)ppu_get_dot();
+	r->cycle = cycle;
+}
+
+static void print_divergence(const Nestest_context* context, int line_number, const char* field)
+{
+	char actual[128];
+	printf("nestest diverged at line %d (%s differs)\n", line_number, field);
+
+	int first = context->count > CONTEXT_LINES ? context->count - CONTEXT_LINES : 0;
+	for (int i = first; i < context->count; i++)
+	{
+		format_trace_record(&context->actual[i % CONTEXT_LINES], actual, sizeof(actual));
+		bool last = i == context->count - 1;
+		printf("%s expected %s", last ? ">" : " ", context->expected[i % CONTEXT_LINES]);
+		printf("%s actual   %s\n", last ? ">" : " ", actual);
+	}
+}
+
+static void step_instruction()
+{
+	wait_till_cpu_cycle();
+	nes_clock();
+	while (get_cycles() != 0) nes_clock();
+}
+
+static int compare_with_log(FILE* log, bool compare_cycles)
+{
+	Nestest_context context = { 0 };
+	char line[256];
+	int line_number = 0;
+	uint64_t cycle_offset = 0;
+
+	while (fgets(line, sizeof(line), log))
+	{
+		line_number++;
+		Nestest_state expected;
+		if (!parse_log_line(line, &expected)) {
+			log_warn("nestest log line %d is not in the expected format", line_number);
+			return -1;
+		}
+
+		//the cpu only runs on every third system clock, line up with it so the cycle count is exact
+		wait_till_cpu_cycle();
+
+		//the log starts part way through reset so the first line lines both counters up
+		if (line_number == 1) cycle_offset = expected.cycle - get_cpu_cycle_count();
+		uint64_t cycle = get_cpu_cycle_count() + cycle_offset;
+
+		int slot = context.count % CONTEXT_LINES;
+		snprintf(context.expected[slot], sizeof(context.expected[slot]), "%s", line);
+		if (!strchr(context.expected[slot], '\n')) strcat(context.expected[slot], "\n");
+		capture_state(&context.actual[slot], cycle);
+		context.count++;
+
+		const Trace_record* actual = &context.actual[slot];
+		const char* field = NULL;
+		if (actual->pc != expected.pc) field = "PC";
+		else if (actual->a != expected.a) field = "A";
+		else if (actual->x != expected.x) field = "X";
+		else if (actual->y != expected.y) field = "Y";
+		else if (actual->p != expected.p) field = "P";
+		else if (actual->sp != expected.sp) field = "SP";
+		else if (compare_cycles && cycle != expected.cycle) field = "CYC";
+
+		if (field) {
+			print_divergence(&context, line_number, field);
+			return 1;
+		}
+
+		step_instruction();
+	}
+
+	printf("nestest matched all %d lines\n", line_number);
+	return 0;
+}
+
+//big enough that it should not live on the stack
+static Frame_time_histogram throughput_times;
+
+static void measure_throughput()
+{
+	reset_nes();
+	set_emulator_running(true);
+	ppu_set_pixel_composition(true);
+
+	uint32_t first_instruction = cpu6502_get_instruction_count();
+	uint64_t first_cycle = get_cpu_cycle_count();
+	double start = platform_now_seconds();
+	frame_time_reset(&throughput_times);
+
+	for (int frame = 0; frame < THROUGHPUT_FRAMES; frame++)
+	{
+		uint64_t frame_start = platform_now_ns();
+		while (!is_frame_complete()) nes_clock();
+		reset_frame_complete();
+		frame_time_record(&throughput_times, platform_now_ns() - frame_start);
+	}
+
+	double elapsed = platform_now_seconds() - start;
+	set_emulator_running(false);
+
+	uint32_t instructions = cpu6502_get_instruction_count() - first_instruction;
+	uint64_t cycles = get_cpu_cycle_count() - first_cycle;
+	printf("throughput: %u instructions in %.3f s, %.2f M instructions/s, %.2f MHz emulated (%.1fx real time)\n",
+		instructions, elapsed, instructions / elapsed / 1e6, cycles / elapsed / 1e6, THROUGHPUT_FRAMES / 60.0 / elapsed);
+
+	char times[128];
+	format_frame_times(&throughput_times, times, sizeof(times));
+	printf("frame times: %s\n", times);
+}
+
+int run_nestest(const char* log_path, const char* rom_path, bool compare_cycles)
+{
+	FILE* log = fopen(log_path, "r");
+	if (!log) {
+		log_warn("could not open nestest log %s", log_path);
+		return -1;
+	}
+
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		log_warn("could not load %s", rom_path);
+		fclose(log);
+		return -1;
+	}
+
+	//automatic mode: start at $C000 with the state the log was captured from
+	reset_nes();
+	Cpu6502_Regs regs = cpu6502_get_regs();
+	regs.pc = 0xC000;
+	regs.status = 0x24;
+	regs.sp = 0xFD;
+	cpu6502_set_regs(regs);
+
+	int result = compare_with_log(log, compare_cycles);
+	fclose(log);
+
+	measure_throughput();
+
+	remove_cartridge();
+	deinitalise_nes();
+	return result;
+}
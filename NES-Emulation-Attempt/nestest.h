@@ -0,0 +1,14 @@
+#pragma once
+#include <stdbool.h>
+
+/*
+ headless nestest conformance and throughput check.
+ nestest is started in automatic mode at $C000 and every instruction's cpu state (PC A X Y P SP and cycle)
+ is compared with the matching line of the golden nestest.log, both sides are streamed so nothing is held in memory.
+ the log is not shipped with the repo, it is the standard one from the nestest release.
+ after the comparison the whole system is run uncapped to report instructions per second and emulated MHz.
+
+ compare_cycles can be turned off to check the registers alone while cycle timing is known to be off
+ returns 0 if every line of the log matched, 1 on the first divergence and -1 if the rom or log could not be used
+*/
+int run_nestest(const char* log_path, const char* rom_path, bool compare_cycles);
@@ -0,0 +1,294 @@
+#include "perfCounters.h"
+#include "nes.h"
+#include "ppu.h"
+#include "6502.h"
+#include "bus.h"
+#include "cartridge.h"
+#include "cpuJit.h"
+#include "frameBuffer.h"
+#include "frameTimes.h"
+#include "platform.h"
+#include "logger.h"
+#include <string.h>
+
+static uint64_t nmi_count = 0;
+static double sampled_ppu_seconds = 0.0;
+static double sampled_cpu_seconds = 0.0;
+//only ever written by the ui thread, a snapshot taken elsewhere can be a frame behind which is fine for stats
+static volatile double present_seconds = 0.0;
+
+static Platform_hw_counters* host_counters = NULL;
+
+static const char* host_counter_names[PLATFORM_HW_COUNTER_COUNT] = {
+	"host instructions", "host cycles", "branch misses", "l1d misses",
+};
+
+bool perf_counters_enabled()
+{
+#ifdef PERF_COUNTERS
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool perf_open_host_counters()
+{
+	if (!host_counters) host_counters = platform_hw_counters_open();
+	return host_counters != NULL;
+}
+
+void perf_close_host_counters()
+{
+	platform_hw_counters_close(host_counters);
+	host_counters = NULL;
+}
+
+void perf_count_nmi()
+{
+	nmi_count++;
+}
+
+/*
+ a dot takes about as long as reading the clock so every sample also measures one clock read,
+ the cheapest back to back read seen is taken off each sample to leave just the emulation
+*/
+static double clock_read_cost = -1.0;
+
+static void measure_clock_read_cost()
+{
+	clock_read_cost = 1.0;
+	for (int batch = 0; batch < 16; batch++)
+	{
+		double start = platform_now_seconds();
+		double end = start;
+		for (int i = 0; i < 256; i++) end = platform_now_seconds();
+		double cost = (end - start) / 256;
+		if (cost < clock_read_cost) clock_read_cost = cost;
+	}
+}
+
+void perf_add_clock_time(double ppu_seconds, double cpu_seconds)
+{
+	if (clock_read_cost < 0.0) measure_clock_read_cost();
+	sampled_ppu_seconds += ppu_seconds - clock_read_cost;
+	sampled_cpu_seconds += cpu_seconds - clock_read_cost;
+}
+
+void perf_add_present_time(double seconds)
+{
+	present_seconds += seconds;
+}
+
+static void add_bus_counts(Perf_counters* counters, uint8_t bus_number, const char* bus_name)
+{
+	Bus_access_count counts[PERF_MAX_DEVICES];
+	int count = bus_get_access_counts(get_bus(bus_number), counts, PERF_MAX_DEVICES - counters->device_count);
+	for (int i = 0; i < count; i++)
+	{
+		Perf_device_count* device = &counters->devices[counters->device_count++];
+		device->bus = bus_name;
+		device->name = counts[i].name ? counts[i].name : "?";
+		device->reads = counts[i].reads;
+		device->writes = counts[i].writes;
+	}
+}
+
+void perf_snapshot(Perf_counters* counters)
+{
+	memset(counters, 0, sizeof(*counters));
+	counters->frames = ppu_get_frame_count();
+	counters->cpu_instructions = cpu6502_get_instruction_count();
+	counters->cpu_cycles = get_cpu_cycle_count();
+	counters->ppu_dots = get_master_clock_count();
+	counters->nmis = nmi_count;
+	counters->idle_cycles = cpu6502_get_idle_cycles_skipped();
+	counters->cpu_seconds = sampled_cpu_seconds * PERF_TIME_SAMPLE_INTERVAL;
+	counters->ppu_seconds = sampled_ppu_seconds * PERF_TIME_SAMPLE_INTERVAL;
+	counters->present_seconds = present_seconds;
+	counters->wall_seconds = platform_now_seconds();
+	counters->host_enabled = host_counters != NULL;
+	if (host_counters) counters->host_valid = platform_hw_counters_read(host_counters, counters->host);
+	add_bus_counts(counters, 1, "cpu");
+	add_bus_counts(counters, 2, "ppu");
+}
+
+void perf_difference(const Perf_counters* now, const Perf_counters* before, Perf_counters* out)
+{
+	*out = *now;
+	out->frames -= before->frames;
+	//the instruction counter is 32 bits and wraps after about half an hour
+	out->cpu_instructions = (uint32_t)(now->cpu_instructions - before->cpu_instructions);
+	out->cpu_cycles -= before->cpu_cycles;
+	out->ppu_dots -= before->ppu_dots;
+	out->nmis -= before->nmis;
+	out->idle_cycles -= before->idle_cycles;
+	out->cpu_seconds -= before->cpu_seconds;
+	out->ppu_seconds -= before->ppu_seconds;
+	out->present_seconds -= before->present_seconds;
+	out->wall_seconds -= before->wall_seconds;
+	out->host_valid &= before->host_valid;
+	for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++) out->host[i] -= before->host[i];
+	for (int i = 0; i < out->device_count && i < before->device_count; i++)
+	{
+		out->devices[i].reads -= before->devices[i].reads;
+		out->devices[i].writes -= before->devices[i].writes;
+	}
+}
+
+void perf_write_csv_header(FILE* file, const Perf_counters* layout)
+{
+	fprintf(file, "frame,frames,instructions,cycles,dots,nmis,idle cycles");
+	for (int i = 0; i < layout->device_count; i++)
+	{
+		fprintf(file, ",%s %s reads,%s %s writes", layout->devices[i].bus, layout->devices[i].name,
+			layout->devices[i].bus, layout->devices[i].name);
+	}
+	fprintf(file, ",cpu ms,ppu ms,present ms,frame ms");
+	if (layout->host_enabled)
+	{
+		for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++) fprintf(file, ",%s", host_counter_names[i]);
+		fprintf(file, ",ipc");
+	}
+	fprintf(file, "\n");
+}
+
+void perf_write_line(FILE* file, Perf_format format, uint64_t frame, const Perf_counters* interval)
+{
+	double per_frame = interval->frames ? 1000.0 / interval->frames : 0.0;
+	unsigned long long counts[] = { frame, interval->frames, interval->cpu_instructions,
+		interval->cpu_cycles, interval->ppu_dots, interval->nmis, interval->idle_cycles };
+	double times[] = { interval->cpu_seconds * per_frame, interval->ppu_seconds * per_frame,
+		interval->present_seconds * per_frame, interval->wall_seconds * per_frame };
+	uint32_t ipc_counters = (1u << PLATFORM_HW_INSTRUCTIONS) | (1u << PLATFORM_HW_CYCLES);
+	double ipc = (interval->host_valid & ipc_counters) == ipc_counters && interval->host[PLATFORM_HW_CYCLES]
+		? (double)interval->host[PLATFORM_HW_INSTRUCTIONS] / interval->host[PLATFORM_HW_CYCLES] : 0.0;
+
+	if (format == PERF_FORMAT_CSV)
+	{
+		fprintf(file, "%llu,%llu,%llu,%llu,%llu,%llu,%llu", counts[0], counts[1], counts[2], counts[3], counts[4], counts[5], counts[6]);
+		for (int i = 0; i < interval->device_count; i++)
+		{
+			fprintf(file, ",%llu,%llu", (unsigned long long)interval->devices[i].reads, (unsigned long long)interval->devices[i].writes);
+		}
+		fprintf(file, ",%.4f,%.4f,%.4f,%.4f", times[0], times[1], times[2], times[3]);
+		if (interval->host_enabled)
+		{
+			//counters the host would not give us are left empty
+			for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++)
+			{
+				if (interval->host_valid & (1u << i)) fprintf(file, ",%.0f", interval->host[i] * per_frame / 1000.0);
+				else fprintf(file, ",");
+			}
+			if (ipc > 0.0) fprintf(file, ",%.3f", ipc);
+			else fprintf(file, ",");
+		}
+		fprintf(file, "\n");
+		return;
+	}
+
+	fprintf(file, "{\"frame\":%llu,\"frames\":%llu,\"instructions\":%llu,\"cycles\":%llu,\"dots\":%llu,\"nmis\":%llu,\"idle_cycles\":%llu,\"devices\":[",
+		counts[0], counts[1], counts[2], counts[3], counts[4], counts[5], counts[6]);
+	for (int i = 0; i < interval->device_count; i++)
+	{
+		fprintf(file, "%s{\"bus\":\"%s\",\"name\":\"%s\",\"reads\":%llu,\"writes\":%llu}", i ? "," : "",
+			interval->devices[i].bus, interval->devices[i].name,
+			(unsigned long long)interval->devices[i].reads, (unsigned long long)interval->devices[i].writes);
+	}
+	fprintf(file, "],\"ms_per_frame\":{\"cpu\":%.4f,\"ppu\":%.4f,\"present\":%.4f,\"total\":%.4f}",
+		times[0], times[1], times[2], times[3]);
+	if (interval->host_enabled)
+	{
+		fprintf(file, ",\"host_per_frame\":{");
+		bool first = true;
+		for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++)
+		{
+			if (!(interval->host_valid & (1u << i))) continue;
+			fprintf(file, "%s\"%s\":%.0f", first ? "" : ",", host_counter_names[i], interval->host[i] * per_frame / 1000.0);
+			first = false;
+		}
+		if (ipc > 0.0) fprintf(file, "%s\"ipc\":%.3f", first ? "" : ",", ipc);
+		fprintf(file, "}");
+	}
+	fprintf(file, "}\n");
+}
+
+static Frame_time_histogram capture_times;
+
+int run_perf_capture(const char* rom_path, uint32_t frames, uint32_t interval, Perf_format format, const char* out_path, bool use_host_counters)
+{
+	if (!perf_counters_enabled()) {
+		fprintf(stderr, "built without PERF_COUNTERS, only instruction, cycle, dot and frame counts are available\n");
+	}
+	if (interval == 0) interval = 60;
+
+	FILE* out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		log_warn("could not open %s", out_path);
+		return -1;
+	}
+
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		log_warn("could not load %s", rom_path);
+		if (out != stdout) fclose(out);
+		return -1;
+	}
+
+	reset_nes();
+	set_emulator_running(true);
+	ppu_set_pixel_composition(true);
+
+	if (use_host_counters && !perf_open_host_counters()) {
+		fprintf(stderr, "host hardware counters are unavailable (not linux, perf_event_paranoid or a container), reporting wall time only\n");
+	}
+
+	Perf_counters last, now, difference;
+	perf_snapshot(&last);
+	if (format == PERF_FORMAT_CSV) perf_write_csv_header(out, &last);
+
+	frame_time_reset(&capture_times);
+	for (uint32_t frame = 1; frame <= frames; frame++)
+	{
+		uint64_t frame_start = platform_now_ns();
+		while (!is_frame_complete()) nes_clock();
+		reset_frame_complete();
+
+		double start = platform_now_seconds();
+		publish_frame(false);
+		perf_add_present_time(platform_now_seconds() - start);
+		frame_time_record(&capture_times, platform_now_ns() - frame_start);
+
+		if (frame % interval == 0 || frame == frames)
+		{
+			perf_snapshot(&now);
+			perf_difference(&now, &last, &difference);
+			perf_write_line(out, format, frame, &difference);
+			last = now;
+		}
+	}
+
+	//the summary goes to stderr so stdout stays a clean csv/json stream
+	char times[128];
+	format_frame_times(&capture_times, times, sizeof(times));
+	fprintf(stderr, "%u frames, frame times %s\n", frames, times);
+	Cpu6502_block_stats blocks = cpu6502_get_block_stats();
+	uint64_t lookups = blocks.hits + blocks.misses;
+	fprintf(stderr, "block cache %llu hits %llu misses (%.1f%% hit rate), %llu invalidated, %llu instructions predecoded\n",
+		(unsigned long long)blocks.hits, (unsigned long long)blocks.misses, lookups ? blocks.hits * 100.0 / lookups : 0.0,
+		(unsigned long long)blocks.invalidations, (unsigned long long)blocks.instructions);
+	if (cpu6502_jit_enabled())
+	{
+		//bus access counts above only include what went through the interpreter
+		Cpu_jit_stats jit = cpu_jit_get_stats();
+		fprintf(stderr, "jit %llu blocks compiled, %llu runs, %llu instructions, %llu side exits, %llu flushes\n",
+			(unsigned long long)jit.blocks_compiled, (unsigned long long)jit.blocks_run, (unsigned long long)jit.instructions,
+			(unsigned long long)jit.side_exits, (unsigned long long)jit.flushes);
+	}
+
+	perf_close_host_counters();
+	set_emulator_running(false);
+	remove_cartridge();
+	deinitalise_nes();
+	if (out != stdout) fclose(out);
+	return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "platform.h"
+
+/*
+ performance counters for finding out where the time goes on real games.
+ instructions, cycles, dots and frames come from counters the emulator keeps anyway, the bus access counts,
+ nmis and the time split are only collected in builds with PERF_COUNTERS defined.
+ cpu and ppu time is sampled, one master clock in PERF_TIME_SAMPLE_INTERVAL is timed and scaled up
+ as reading the clock every dot would cost more than the dot itself.
+ every counter only goes up, per interval numbers are the difference of two snapshots.
+ host hardware counters (instructions, cycles, branch and l1d misses of the emulator itself) are optional
+ and only on linux, they show whether dispatch and branching are what limit emulation speed.
+*/
+
+#define PERF_TIME_SAMPLE_INTERVAL 16 //must not be a multiple of 3 or the cpu would always or never be timed
+#define PERF_MAX_DEVICES 16
+
+typedef struct {
+	const char* bus;
+	const char* name;
+	uint64_t reads;
+	uint64_t writes;
+}Perf_device_count;
+
+typedef struct {
+	uint64_t frames;
+	uint64_t cpu_instructions;
+	uint64_t cpu_cycles;
+	uint64_t ppu_dots;
+	uint64_t nmis;
+	uint64_t idle_cycles; //cpu cycles skipped in idle loops
+	double cpu_seconds;
+	double ppu_seconds;
+	double present_seconds;
+	double wall_seconds;
+	bool host_enabled; //perf_open_host_counters succeeded
+	uint32_t host_valid; //bit per Platform_hw_counter
+	uint64_t host[PLATFORM_HW_COUNTER_COUNT];
+	int device_count;
+	Perf_device_count devices[PERF_MAX_DEVICES];
+}Perf_counters;
+
+typedef enum {
+	PERF_FORMAT_CSV,
+	PERF_FORMAT_JSON,
+}Perf_format;
+
+bool perf_counters_enabled();
+
+/*
+ starts the host hardware counters for the calling thread, they are included in every snapshot after this
+ returns false if none are available (not linux, or blocked by perf_event_paranoid or a container)
+*/
+bool perf_open_host_counters();
+void perf_close_host_counters();
+
+void perf_snapshot(Perf_counters* counters);
+
+//out = now - before, both have to come from the same run
+void perf_difference(const Perf_counters* now, const Perf_counters* before, Perf_counters* out);
+
+//the csv columns depend on the devices so the header is made from a snapshot
+void perf_write_csv_header(FILE* file, const Perf_counters* layout);
+
+//one line per interval, times are written as milliseconds per frame
+void perf_write_line(FILE* file, Perf_format format, uint64_t frame, const Perf_counters* interval);
+
+//hooks for the PERF_COUNTERS build
+void perf_count_nmi();
+void perf_add_clock_time(double ppu_seconds, double cpu_seconds);
+void perf_add_present_time(double seconds); //called from the ui thread
+
+/*
+ runs a rom headless for frames frames writing a line every interval frames to out_path (stdout if NULL),
+ with no window presenting is publishing the frame to the front buffer.
+ use_host_counters adds ipc and misses per frame when the host allows it and falls back to wall time alone when not
+ returns -1 if the rom or output file could not be opened
+*/
+int run_perf_capture(const char* rom_path, uint32_t frames, uint32_t interval, Perf_format format, const char* out_path, bool use_host_counters);
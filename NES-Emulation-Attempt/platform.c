@@ -0,0 +1,586 @@
+#include "platform.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <timeapi.h>
+
+#pragma comment(lib, "winmm.lib")
+
+struct Platform_thread {
+	HANDLE handle;
+	platform_thread_fn fn;
+	void* arg;
+};
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+	Platform_thread* thread = (Platform_thread*)param;
+	return (DWORD)thread->fn(thread->arg);
+}
+
+Platform_thread* platform_thread_create(platform_thread_fn fn, void* arg)
+{
+	Platform_thread* thread = malloc(sizeof(Platform_thread));
+	if (!thread) return NULL;
+
+	thread->fn = fn;
+	thread->arg = arg;
+	thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+	if (!thread->handle) {
+		free(thread);
+		return NULL;
+	}
+
+	//Sleep(1) is closer to 15ms without this which makes frame pacing impossible
+	timeBeginPeriod(1);
+	return thread;
+}
+
+int platform_thread_join(Platform_thread* thread)
+{
+	DWORD result = 0;
+	WaitForSingleObject(thread->handle, INFINITE);
+	GetExitCodeThread(thread->handle, &result);
+	CloseHandle(thread->handle);
+	free(thread);
+	timeEndPeriod(1);
+	return (int)result;
+}
+
+void platform_sleep_ms(uint32_t ms)
+{
+	Sleep(ms);
+}
+
+double platform_now_seconds()
+{
+	static LARGE_INTEGER freq;
+	static int init = 0;
+
+	if (!init)
+	{
+		QueryPerformanceFrequency(&freq);
+		init = 1;
+	}
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return (double)t.QuadPart / (double)freq.QuadPart;
+}
+
+uint64_t platform_now_ns()
+{
+	static LARGE_INTEGER freq;
+	static int init = 0;
+
+	if (!init)
+	{
+		QueryPerformanceFrequency(&freq);
+		init = 1;
+	}
+
+	//split so the multiply can't overflow however long the machine has been up
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	uint64_t seconds = t.QuadPart / freq.QuadPart;
+	uint64_t remainder = t.QuadPart % freq.QuadPart;
+	return seconds * 1000000000ull + remainder * 1000000000ull / freq.QuadPart;
+}
+
+struct Platform_file_map {
+	HANDLE file;
+	HANDLE mapping;
+	void* view;
+};
+
+static void* map_handle(HANDLE file, uint64_t size, bool writable, Platform_file_map** map)
+{
+	HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+		(DWORD)(size >> 32), (DWORD)size, NULL);
+	if (!mapping) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	void* view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)size);
+	*map = view ? malloc(sizeof(Platform_file_map)) : NULL;
+	if (!*map) {
+		if (view) UnmapViewOfFile(view);
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return NULL;
+	}
+
+	(*map)->file = file;
+	(*map)->mapping = mapping;
+	(*map)->view = view;
+	return view;
+}
+
+const void* platform_map_file(const char* path, uint64_t* size, Platform_file_map** map)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	*size = (uint64_t)length.QuadPart;
+	return map_handle(file, *size, false, map);
+}
+
+void* platform_create_mapped_file(const char* path, uint64_t size, Platform_file_map** map)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+
+	//mapping a file bigger than it is grows it
+	return map_handle(file, size, true, map);
+}
+
+void platform_unmap_file(Platform_file_map* map)
+{
+	UnmapViewOfFile(map->view);
+	CloseHandle(map->mapping);
+	CloseHandle(map->file);
+	free(map);
+}
+
+struct Platform_process {
+	HANDLE handle;
+};
+
+Platform_process* platform_process_spawn(int argc, char** argv)
+{
+	//windows takes a single command line, every argument is quoted so paths with spaces survive
+	char command_line[4096];
+	int length = 0;
+	for (int i = 0; i < argc; i++)
+	{
+		int written = snprintf(command_line + length, sizeof(command_line) - length, "%s\"%s\"", i ? " " : "", argv[i]);
+		if (written < 0 || written >= (int)sizeof(command_line) - length) return NULL;
+		length += written;
+	}
+
+	STARTUPINFOA startup = { .cb = sizeof(STARTUPINFOA) };
+	PROCESS_INFORMATION info;
+	if (!CreateProcessA(argv[0], command_line, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &info)) return NULL;
+	CloseHandle(info.hThread);
+
+	Platform_process* process = malloc(sizeof(Platform_process));
+	if (!process) {
+		CloseHandle(info.hProcess);
+		return NULL;
+	}
+	process->handle = info.hProcess;
+	return process;
+}
+
+bool platform_process_poll(Platform_process* process, int* exit_code)
+{
+	if (WaitForSingleObject(process->handle, 0) != WAIT_OBJECT_0) return false;
+
+	DWORD code = 0;
+	GetExitCodeProcess(process->handle, &code);
+	CloseHandle(process->handle);
+	free(process);
+	*exit_code = (int)code;
+	return true;
+}
+
+int platform_executable_path(char* path, int size)
+{
+	DWORD length = GetModuleFileNameA(NULL, path, (DWORD)size);
+	return length == 0 || length >= (DWORD)size ? -1 : 0;
+}
+
+void* platform_alloc_executable(uint32_t size)
+{
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+}
+
+void platform_free_executable(void* memory, uint32_t size)
+{
+	(void)size;
+	VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+int platform_cpu_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+int platform_list_directory(const char* dir, void (*fn)(const char* name, void* context), void* context)
+{
+	char pattern[MAX_PATH];
+	snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA(pattern, &found);
+	if (find == INVALID_HANDLE_VALUE) return -1;
+
+	do {
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) fn(found.cFileName, context);
+	} while (FindNextFileA(find, &found));
+
+	FindClose(find);
+	return 0;
+}
+
+//reading the pmu needs a kernel driver on windows
+Platform_hw_counters* platform_hw_counters_open()
+{
+	return NULL;
+}
+
+uint32_t platform_hw_counters_read(Platform_hw_counters* counters, uint64_t values[PLATFORM_HW_COUNTER_COUNT])
+{
+	(void)counters; (void)values;
+	return 0;
+}
+
+void platform_hw_counters_close(Platform_hw_counters* counters)
+{
+	(void)counters;
+}
+
+int32_t platform_atomic_exchange(volatile int32_t* target, int32_t value)
+{
+	return InterlockedExchange((volatile LONG*)target, value);
+}
+
+int32_t platform_atomic_or(volatile int32_t* target, int32_t value)
+{
+	return InterlockedOr((volatile LONG*)target, value);
+}
+
+int32_t platform_atomic_load(volatile int32_t* target)
+{
+	return InterlockedCompareExchange((volatile LONG*)target, 0, 0);
+}
+
+void platform_atomic_store(volatile int32_t* target, int32_t value)
+{
+	InterlockedExchange((volatile LONG*)target, value);
+}
+
+#else
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+extern char** environ;
+
+struct Platform_thread {
+	pthread_t handle;
+	platform_thread_fn fn;
+	void* arg;
+	int result;
+};
+
+static void* thread_entry(void* param)
+{
+	Platform_thread* thread = (Platform_thread*)param;
+	thread->result = thread->fn(thread->arg);
+	return NULL;
+}
+
+Platform_thread* platform_thread_create(platform_thread_fn fn, void* arg)
+{
+	Platform_thread* thread = malloc(sizeof(Platform_thread));
+	if (!thread) return NULL;
+
+	thread->fn = fn;
+	thread->arg = arg;
+	thread->result = 0;
+	if (pthread_create(&thread->handle, NULL, thread_entry, thread) != 0) {
+		free(thread);
+		return NULL;
+	}
+	return thread;
+}
+
+int platform_thread_join(Platform_thread* thread)
+{
+	pthread_join(thread->handle, NULL);
+	int result = thread->result;
+	free(thread);
+	return result;
+}
+
+void platform_sleep_ms(uint32_t ms)
+{
+	struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+	nanosleep(&ts, NULL);
+}
+
+double platform_now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+uint64_t platform_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+struct Platform_file_map {
+	int fd;
+	void* view;
+	uint64_t size;
+};
+
+static void* map_fd(int fd, uint64_t size, bool writable, Platform_file_map** map)
+{
+	void* view = mmap(NULL, (size_t)size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	*map = view != MAP_FAILED ? malloc(sizeof(Platform_file_map)) : NULL;
+	if (!*map) {
+		if (view != MAP_FAILED) munmap(view, (size_t)size);
+		close(fd);
+		return NULL;
+	}
+
+	(*map)->fd = fd;
+	(*map)->view = view;
+	(*map)->size = size;
+	return view;
+}
+
+const void* platform_map_file(const char* path, uint64_t* size, Platform_file_map** map)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	*size = (uint64_t)st.st_size;
+	return map_fd(fd, *size, false, map);
+}
+
+void* platform_create_mapped_file(const char* path, uint64_t size, Platform_file_map** map)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return NULL;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return NULL;
+	}
+	return map_fd(fd, size, true, map);
+}
+
+void platform_unmap_file(Platform_file_map* map)
+{
+	munmap(map->view, (size_t)map->size);
+	close(map->fd);
+	free(map);
+}
+
+struct Platform_process {
+	pid_t pid;
+};
+
+Platform_process* platform_process_spawn(int argc, char** argv)
+{
+	char** args = malloc(sizeof(char*) * (argc + 1));
+	Platform_process* process = malloc(sizeof(Platform_process));
+	if (!args || !process) {
+		free(args);
+		free(process);
+		return NULL;
+	}
+
+	memcpy(args, argv, sizeof(char*) * argc);
+	args[argc] = NULL;
+	int result = posix_spawn(&process->pid, argv[0], NULL, NULL, args, environ);
+	free(args);
+	if (result != 0) {
+		free(process);
+		return NULL;
+	}
+	return process;
+}
+
+bool platform_process_poll(Platform_process* process, int* exit_code)
+{
+	int status = 0;
+	if (waitpid(process->pid, &status, WNOHANG) != process->pid) return false;
+
+	*exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	free(process);
+	return true;
+}
+
+int platform_executable_path(char* path, int size)
+{
+	ssize_t length = readlink("/proc/self/exe", path, (size_t)size);
+	if (length <= 0 || length >= size) return -1;
+	path[length] = '\0';
+	return 0;
+}
+
+void* platform_alloc_executable(uint32_t size)
+{
+	void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? NULL : memory;
+}
+
+void platform_free_executable(void* memory, uint32_t size)
+{
+	munmap(memory, size);
+}
+
+int platform_cpu_count()
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+int platform_list_directory(const char* dir, void (*fn)(const char* name, void* context), void* context)
+{
+	DIR* handle = opendir(dir);
+	if (!handle) return -1;
+
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != NULL)
+	{
+		char path[4096];
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) fn(entry->d_name, context);
+	}
+
+	closedir(handle);
+	return 0;
+}
+
+#ifdef __linux__
+struct Platform_hw_counters {
+	int fds[PLATFORM_HW_COUNTER_COUNT]; //-1 for counters the kernel or hypervisor would not give us
+};
+
+static int open_hw_counter(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	//user mode only, that is all perf_event_paranoid 2 allows and all the emulator cares about
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+Platform_hw_counters* platform_hw_counters_open()
+{
+	Platform_hw_counters* counters = malloc(sizeof(Platform_hw_counters));
+	if (!counters) return NULL;
+
+	counters->fds[PLATFORM_HW_INSTRUCTIONS] = open_hw_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	counters->fds[PLATFORM_HW_CYCLES] = open_hw_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	counters->fds[PLATFORM_HW_BRANCH_MISSES] = open_hw_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	counters->fds[PLATFORM_HW_L1D_MISSES] = open_hw_counter(PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+	bool any = false;
+	for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++) any |= counters->fds[i] != -1;
+	if (!any) {
+		free(counters);
+		return NULL;
+	}
+	return counters;
+}
+
+uint32_t platform_hw_counters_read(Platform_hw_counters* counters, uint64_t values[PLATFORM_HW_COUNTER_COUNT])
+{
+	uint32_t valid = 0;
+	for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++)
+	{
+		values[i] = 0;
+		uint64_t data[3]; //value, time enabled, time running
+		if (!counters || counters->fds[i] == -1 || read(counters->fds[i], data, sizeof(data)) != sizeof(data)) continue;
+		if (data[2] == 0) continue;
+
+		//the kernel multiplexes when there are more events than hardware counters, scale up to the whole time
+		values[i] = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+		valid |= 1u << i;
+	}
+	return valid;
+}
+
+void platform_hw_counters_close(Platform_hw_counters* counters)
+{
+	if (!counters) return;
+	for (int i = 0; i < PLATFORM_HW_COUNTER_COUNT; i++)
+	{
+		if (counters->fds[i] != -1) close(counters->fds[i]);
+	}
+	free(counters);
+}
+#else
+Platform_hw_counters* platform_hw_counters_open()
+{
+	return NULL;
+}
+
+uint32_t platform_hw_counters_read(Platform_hw_counters* counters, uint64_t values[PLATFORM_HW_COUNTER_COUNT])
+{
+	(void)counters; (void)values;
+	return 0;
+}
+
+void platform_hw_counters_close(Platform_hw_counters* counters)
+{
+	(void)counters;
+}
+#endif
+
+int32_t platform_atomic_exchange(volatile int32_t* target, int32_t value)
+{
+	return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+int32_t platform_atomic_or(volatile int32_t* target, int32_t value)
+{
+	return __atomic_fetch_or(target, value, __ATOMIC_SEQ_CST);
+}
+
+int32_t platform_atomic_load(volatile int32_t* target)
+{
+	return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+void platform_atomic_store(volatile int32_t* target, int32_t value)
+{
+	__atomic_store_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ thin wrapper over the host threading primitives so the emulation core does not have to include Windows.h directly.
+ the windows build uses the Win32 api, everything else falls back to pthreads and the gcc/clang atomic builtins.
+*/
+
+typedef struct Platform_thread Platform_thread;
+typedef int (*platform_thread_fn)(void* arg);
+
+/*
+ starts a new thread running fn(arg)
+ returns NULL if the thread could not be created
+*/
+Platform_thread* platform_thread_create(platform_thread_fn fn, void* arg);
+
+/*
+ blocks until the thread returns then frees the handle
+ returns the value the thread function returned
+*/
+int platform_thread_join(Platform_thread* thread);
+
+void platform_sleep_ms(uint32_t ms);
+
+/*
+ monotonic clock, both are from an arbitrary fixed point so only useful for measuring intervals.
+ the nanosecond one is exact integer ticks for anything that gets summed or bucketed
+*/
+double platform_now_seconds();
+uint64_t platform_now_ns();
+
+/*
+ whole file memory mapping, used by the tools that work on traces far bigger than memory
+ (the 32 bit build can only map files that fit in its address space)
+*/
+typedef struct Platform_file_map Platform_file_map;
+
+/*
+ maps an existing file read only, size receives its length
+ returns NULL if the file could not be opened or is empty
+*/
+const void* platform_map_file(const char* path, uint64_t* size, Platform_file_map** map);
+
+/*
+ creates (or truncates) a file of size bytes and maps it writable
+ returns NULL on failure
+*/
+void* platform_create_mapped_file(const char* path, uint64_t size, Platform_file_map** map);
+
+//unmaps and closes, anything written through a writable mapping ends up in the file
+void platform_unmap_file(Platform_file_map* map);
+
+/*
+ child processes, the emulator state is all global so running several roms at once means several processes
+*/
+typedef struct Platform_process Platform_process;
+
+/*
+ starts argv[0] with the given arguments
+ returns NULL if it could not be started
+*/
+Platform_process* platform_process_spawn(int argc, char** argv);
+
+/*
+ checks if the process has exited without blocking, when it has the handle is freed
+ returns true and sets exit_code once it has exited
+*/
+bool platform_process_poll(Platform_process* process, int* exit_code);
+
+//full path of the running exe, returns -1 if it does not fit
+int platform_executable_path(char* path, int size);
+
+int platform_cpu_count();
+
+/*
+ calls fn with the name (not the full path) of every regular file in dir
+ returns -1 if dir could not be opened
+*/
+int platform_list_directory(const char* dir, void (*fn)(const char* name, void* context), void* context);
+
+/*
+ host hardware performance counters through linux perf_event_open, for seeing ipc and misses per emulated frame.
+ every counter is optional as containers and vms often block some or all of them,
+ windows needs a kernel driver to read the pmu so it never has any
+*/
+typedef enum {
+	PLATFORM_HW_INSTRUCTIONS,
+	PLATFORM_HW_CYCLES,
+	PLATFORM_HW_BRANCH_MISSES,
+	PLATFORM_HW_L1D_MISSES,
+	PLATFORM_HW_COUNTER_COUNT,
+}Platform_hw_counter;
+
+typedef struct Platform_hw_counters Platform_hw_counters;
+
+/*
+ starts counting user mode events of the calling thread
+ returns NULL if none of the counters could be opened
+*/
+Platform_hw_counters* platform_hw_counters_open();
+
+/*
+ counts since open, scaled up if the kernel had to multiplex the counters
+ returns a mask with bit (1 << counter) set for each value that is valid
+*/
+uint32_t platform_hw_counters_read(Platform_hw_counters* counters, uint64_t values[PLATFORM_HW_COUNTER_COUNT]);
+
+void platform_hw_counters_close(Platform_hw_counters* counters);
+
+/*
+ memory that can be written and then run as code, for the recompiler
+ returns NULL if the host will not hand out writable executable memory
+*/
+void* platform_alloc_executable(uint32_t size);
+void platform_free_executable(void* memory, uint32_t size);
+
+//storage class for a variable with its own copy in every thread
+#ifdef _MSC_VER
+#define PLATFORM_THREAD_LOCAL __declspec(thread)
+#else
+#define PLATFORM_THREAD_LOCAL __thread
+#endif
+
+//all atomics are sequentially consistent and return the previous value
+int32_t platform_atomic_exchange(volatile int32_t* target, int32_t value);
+int32_t platform_atomic_or(volatile int32_t* target, int32_t value);
+int32_t platform_atomic_load(volatile int32_t* target);
+void platform_atomic_store(volatile int32_t* target, int32_t value);
@@ -1,7 +1,8 @@
 #include "ppu.h"
 #include "cartridge.h"
-#include "Graphics.h"
+#include "frameBuffer.h"
 #include "logger.h"
+#include "timeline.h"
 #include <stdint.h>
 
 static int scanline = 0;
@@ -9,6 +10,15 @@ static int cycles = 0;
 
 static bool frame_complete = false;
 static bool nmi = false;
+static bool compose_pixels = true;
+static uint64_t frame_count = 0;
+
+/*
+ the fast profile draws dots 1-256 of a line in one go once they are over. line_pending is set from dot 1 until then,
+ a register access part way through the line draws what it has had so far dot by dot and line_by_dots sends the rest the same way
+*/
+static bool line_pending = false;
+static bool line_by_dots = false;
 
 #define reverse_3byte_order(word) ((word&0xFF0000) >> 16) | (word&0x00FF00)  | ((word&0x0000FF) << 16)
 #define C(colour) 0xFF000000 | reverse_3byte_order(colour) & 0xFFFFFF
@@ -83,11 +93,13 @@ uint8_t ppu_buffer;
 
 Bus* ppu_bus;
 
-typedef struct {
-	uint8_t nametable[1024];
-}Nametable;
-
-Nametable nametables[4];
+/*
+ the console's 2k of nametable ram and the extra 2k a four screen cartridge carries. each of the four 1k
+ nametables at $2000-$2FFF is a pointer into one of them, only moved when the mirroring changes
+*/
+static uint8_t ciram[2048];
+static uint8_t cartridge_vram[2048];
+static uint8_t* nametable_slots[4] = { ciram, ciram + 0x400, ciram, ciram + 0x400 };
 
 uint8_t palette_ram[32];
 
@@ -103,15 +115,18 @@ uint16_t shifter_pattern_hi = 0x0000;
 uint16_t shifter_attrib_lo = 0x0000;
 uint16_t shifter_attrib_hi = 0x0000;
 
-void initialise_ppu(Bus* bus)
+void initialise_ppu(Bus* bus, Nes_profile profile)
 {
 	ppu_bus = bus;
+	ppu_clock = profile == NES_PROFILE_ACCURATE ? ppu_clock_accurate : ppu_clock_fast;
 }
 
 void reset_ppu()
 {
 	scanline = 0;
 	cycles = 0;
+	line_pending = false;
+	line_by_dots = false;
 	mask.reg = 0x00;
 	ppu_status.reg = 0x00;
 	ctrl.reg = 0x00;
@@ -234,109 +249,106 @@ static void ppu_write(uint16_t addr, uint8_t data)
 	write_bus_at_address(ppu_bus, addr, data);
 }
 
-void ppu_clock()
+static void fetch_tile_id()
 {
-	//visible scanlines
-	if (scanline >= -1 && scanline < 240)
-	{
-		//skip odd pixel pixel
-		if (scanline == 0 && cycles == 0)
-		{
-			cycles = 1;
-		}
+	next_tile_id = ppu_read(0x2000 | (vram.reg & 0x0FFF));
+}
 
-		// clear vblank
-		if (scanline == -1 && cycles == 1)
-		{
-			ppu_status.vblank = 0;
-		}
+static void fetch_tile_attribute()
+{
+	next_tile_attribute = ppu_read(0x23C0 | 
+		((vram.nametablex) << 10) |
+		((vram.nametabley) << 11) |
+		(vram.coarse_x >> 2 )|
+		((vram.coarse_y >> 2) << 3));
+	if (vram.coarse_y & 0x02) next_tile_attribute >>= 4;
+	if (vram.coarse_x & 0x02) next_tile_attribute >>= 2;
+	next_tile_attribute &= 0x03;
+}
 
-		if ((cycles >= 2 && cycles < 258) || (cycles >= 321 && cycles < 338))
-		{
-			UpdateShifters();
+static void fetch_tile_lsb()
+{
+	next_tile_chr_lsb = ppu_read((ctrl.pattern_background << 12) 
+		+((uint16_t)next_tile_id << 4) 
+		+(vram.fineY) + 0);
+}
 
-			switch ((cycles - 1) % 8)
-			{
-			case 0:
-			{
-				LoadBackgroundShifters();
+static void fetch_tile_msb()
+{
+	next_tile_chr_msb = ppu_read(ctrl.pattern_background << 12 +
+		((uint16_t)next_tile_id << 4) +
+		(vram.fineY) + 8);
+}
 
-				//read next tile id
-				next_tile_id = ppu_read(0x2000 | (vram.reg & 0x0FFF));
-				break;
-			}
-			case 2:
-			{
-				//read attribute byte
-				next_tile_attribute = ppu_read(0x23C0 | 
-					((vram.nametablex) << 10) |
-					((vram.nametabley) << 11) |
-					(vram.coarse_x >> 2 )|
-					((vram.coarse_y >> 2) << 3));
-				if (vram.coarse_y & 0x02) next_tile_attribute >>= 4;
-				if (vram.coarse_x & 0x02) next_tile_attribute >>= 2;
-				next_tile_attribute &= 0x03;
-				break;
-			}
-			case 4:
-			{
-				next_tile_chr_lsb = ppu_read((ctrl.pattern_background << 12) 
-					+((uint16_t)next_tile_id << 4) 
-					+(vram.fineY) + 0);
-				break;
-			}
-			case 6:
-				next_tile_chr_msb = ppu_read(ctrl.pattern_background << 12 +
-					((uint16_t)next_tile_id << 4) +
-					(vram.fineY) + 8);
-				break;
-			case 7:
-				incrementScrollX();
-				break;
-			}
+//the background fetches and scrolling of one dot on the pre-render and visible scanlines
+static void background_dot()
+{
+	if ((cycles >= 2 && cycles < 258) || (cycles >= 321 && cycles < 338))
+	{
+		UpdateShifters();
 
-			if (cycles == 256)
-			{
-				incrementScrollY();
-			}
+		switch ((cycles - 1) % 8)
+		{
+		case 0:
+		{
+			LoadBackgroundShifters();
 
-			if (cycles == 257)
-			{
-				LoadBackgroundShifters();
-				TransferAddressX();
-			}
+			//read next tile id
+			fetch_tile_id();
+			break;
+		}
+		case 2:
+		{
+			//read attribute byte
+			fetch_tile_attribute();
+			break;
+		}
+		case 4:
+		{
+			fetch_tile_lsb();
+			break;
+		}
+		case 6:
+			fetch_tile_msb();
+			break;
+		case 7:
+			incrementScrollX();
+			break;
+		}
 
-			if (cycles == 338 || cycles == 340)
-			{
-				next_tile_id = ppu_read(0x2000 | (vram.reg & 0x0FFF));
-			}
+		if (cycles == 256)
+		{
+			incrementScrollY();
+		}
 
-			if (scanline == -1 && cycles >= 280 && cycles < 305)
-			{
-				TransferAddressY();
-			}
+		if (cycles == 257)
+		{
+			LoadBackgroundShifters();
+			TransferAddressX();
 		}
-	}
 
-	// post-rendering scanlines
-	if (scanline >= 241 && scanline < 261)
-	{
-		if (scanline == 241 && cycles == 1)
+		if (cycles == 338 || cycles == 340)
 		{
-			ppu_status.vblank = 1;
+			fetch_tile_id();
+		}
 
-			if (ctrl.enable_nmi) nmi = true;
+		if (scanline == -1 && cycles >= 280 && cycles < 305)
+		{
+			TransferAddressY();
 		}
 	}
+}
 
+//colour of the background pixel the shifters point at, shift is how far past fine x to look
+static uint32_t background_colour(int shift)
+{
 	uint8_t bg_pixel = 0x00;
 	uint8_t bg_palette = 0x00;
 	uint8_t colour = 0x00;
 
-	//composition
 	if (mask.background_rendering)
 	{
-		uint16_t bit_mask = 0x8000 >> fine_x;
+		uint16_t bit_mask = 0x8000 >> (fine_x + shift);
 
 		uint8_t p0_pixel = (shifter_pattern_lo & bit_mask) > 0;
 		uint8_t p1_pixel = (shifter_pattern_hi & bit_mask) > 0;
@@ -351,9 +363,91 @@ void ppu_clock()
 		colour = palette_ram[((bg_palette << 2) + bg_pixel)&0x3F];
 	}
 
-	set_pixel(cycles - 1, scanline, colour_palette[colour]);
+	return colour_palette[colour];
+}
+
+/*
+ with rendering off nothing moves vram so every fetch reads the same tile, one round of them leaves the
+ latches and shifters as a whole line of them would
+*/
+static void blank_fetches()
+{
+	fetch_tile_id();
+	fetch_tile_attribute();
+	fetch_tile_lsb();
+	fetch_tile_msb();
+	LoadBackgroundShifters();
+}
+
+/*
+ dots 1-256 of a pre-render or visible scanline in one go, a tile at a time. does exactly what background_dot
+ and the composition would over those dots as long as nothing touched the ppu registers in between
+*/
+static void render_scanline()
+{
+	bool draw = compose_pixels && scanline >= 0;
+
+	if (!mask.background_rendering && !mask.sprite_rendering)
+	{
+		blank_fetches();
+		if (draw) fill_row(scanline, background_colour(0));
+		return;
+	}
+
+	for (int tile = 0; tile < 32; tile++)
+	{
+		//dot 1 neither shifts nor fetches
+		if (tile > 0)
+		{
+			UpdateShifters();
+			LoadBackgroundShifters();
+			fetch_tile_id();
+		}
 
-	//increment the cycle
+		if (draw && mask.background_rendering)
+		{
+			for (int pixel = 0; pixel < 8; pixel++) set_pixel(tile * 8 + pixel, scanline, background_colour(pixel));
+		}
+
+		fetch_tile_attribute();
+		fetch_tile_lsb();
+		fetch_tile_msb();
+
+		//the other 7 dots of the tile
+		if (mask.background_rendering)
+		{
+			shifter_pattern_lo <<= 7;
+			shifter_pattern_hi <<= 7;
+			shifter_attrib_lo <<= 7;
+			shifter_attrib_hi <<= 7;
+		}
+		incrementScrollX();
+	}
+
+	incrementScrollY();
+	if (draw && !mask.background_rendering) fill_row(scanline, background_colour(0));
+}
+
+//one dot of the pre-render and visible scanlines the way the accurate profile draws it
+static void render_dot()
+{
+	background_dot();
+	//composition, nothing in here has side effects so it can be skipped on frames nobody will see
+	if (compose_pixels) set_pixel(cycles - 1, scanline, background_colour(0));
+}
+
+//draws the dots of the pending line that are already over, called before the cpu touches a ppu register
+static void finish_line_by_dots()
+{
+	int dot = cycles;
+	for (cycles = 1; cycles < dot; cycles++) render_dot();
+	cycles = dot;
+	line_pending = false;
+	line_by_dots = true;
+}
+
+static void next_dot()
+{
 	cycles++;
 	if (cycles >= 341)
 	{
@@ -363,13 +457,31 @@ void ppu_clock()
 		{
 			scanline = -1;
 			frame_complete = true;
+			if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_FRAME_END, 0, 0);
+			frame_count++;
+			if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_FRAME_BEGIN, 0, 0);
 		}
 	}
 }
 
+#define PPU_CLOCK ppu_clock_fast
+#define PPU_DOT_RENDERER 0
+#include "ppuClock.h"
+#undef PPU_CLOCK
+#undef PPU_DOT_RENDERER
+
+#define PPU_CLOCK ppu_clock_accurate
+#define PPU_DOT_RENDERER 1
+#include "ppuClock.h"
+#undef PPU_CLOCK
+#undef PPU_DOT_RENDERER
+
+void (*ppu_clock)() = ppu_clock_fast;
+
 static uint8_t cpu_read_ppu(uint16_t addr)
 {
 	uint8_t data = 0x00;
+	if (line_pending) finish_line_by_dots();
 
 	switch ((addr-0x2000)%8)
 	{
@@ -402,11 +514,14 @@ static uint8_t cpu_read_ppu(uint16_t addr)
 	}
 	}
 
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_PPU_READ, (addr - 0x2000) % 8, data);
 	return data;
 }
 
 static void cpu_write_ppu(uint16_t addr, uint8_t data)
 {
+	if (line_pending) finish_line_by_dots();
+	if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_PPU_WRITE, (addr - 0x2000) % 8, data);
 	switch ((addr - 0x2000) % 8)
 	{
 	case 0: // Control
@@ -467,45 +582,44 @@ Bus_device ppu_device = {
 	.write = cpu_write_ppu,
 	.start_range = 0x2000,
 	.end_range = 0x3FFF,
+	.read_has_side_effects = true, //reading status clears vblank and the latch, reading data moves vram
 };
 
 
 static uint8_t nametable_read(uint16_t addr)
 {
-	int nametable = (addr&0xC00)>>10;
-	return nametables[nametable].nametable[addr&0x3FF];
+	return nametable_slots[(addr >> 10) & 3][addr & 0x3FF];
 }
 
 static void nametable_write(uint16_t addr, uint8_t data)
 {
-	Nt_mirroring_mode mirror_mode = current_mirroring_mode();
-
-	int nametable = (addr & 0xC00) >> 10;
-	int offset = addr & 0x3FF;
+	nametable_slots[(addr >> 10) & 3][addr & 0x3FF] = data;
+}
 
-	if (mirror_mode == VERTICAL)
-	{
-		if (nametable == 0 || nametable == 2)
-		{
-			nametables[0].nametable[offset] = data;
-			nametables[2].nametable[offset] = data;
-		}
-		else{
-			nametables[1].nametable[offset] = data;
-			nametables[3].nametable[offset] = data;
-		}
-	}
-	else if (mirror_mode == HORISONTAL)
+void ppu_map_nametables(Nt_mirroring_mode mode)
+{
+	switch (mode)
 	{
-		if (nametable == 0 || nametable == 1)
-		{
-			nametables[0].nametable[offset] = data;
-			nametables[1].nametable[offset] = data;
-		}
-		else {
-			nametables[2].nametable[offset] = data;
-			nametables[3].nametable[offset] = data;
-		}
+	case VERTICAL:
+		nametable_slots[0] = nametable_slots[2] = ciram;
+		nametable_slots[1] = nametable_slots[3] = ciram + 0x400;
+		break;
+	case HORISONTAL:
+		nametable_slots[0] = nametable_slots[1] = ciram;
+		nametable_slots[2] = nametable_slots[3] = ciram + 0x400;
+		break;
+	case SINGLE_SCREEN_LOWER:
+		nametable_slots[0] = nametable_slots[1] = nametable_slots[2] = nametable_slots[3] = ciram;
+		break;
+	case SINGLE_SCREEN_UPPER:
+		nametable_slots[0] = nametable_slots[1] = nametable_slots[2] = nametable_slots[3] = ciram + 0x400;
+		break;
+	case FOUR_SCREEN:
+		nametable_slots[0] = ciram;
+		nametable_slots[1] = ciram + 0x400;
+		nametable_slots[2] = cartridge_vram;
+		nametable_slots[3] = cartridge_vram + 0x400;
+		break;
 	}
 }
 
@@ -538,12 +652,105 @@ Bus_device palette_ram_device = {
 Bus_device* get_ppu_bus_device() { return &ppu_device; }
 Bus_device* get_nametables_device() { return &nametable_device; }
 Bus_device* get_palette_ram_device() { return &palette_ram_device; }
-uint8_t* get_nametable_buffer(int nametable) { return &nametables[nametable]; }
+uint8_t* get_nametable_buffer(int nametable) { return nametable_slots[nametable & 3]; }
 bool is_frame_complete(){return frame_complete;	}
 void reset_frame_complete() { frame_complete = false; }
 bool ppu_nmi() { return nmi; }
+void ppu_set_pixel_composition(bool enabled) { compose_pixels = enabled; }
 void nmi_acknolodged() { nmi = false; }
 
+bool ppu_peek_status(uint8_t* value)
+{
+	*value = ppu_status.reg;
+	return !ppu_status.vblank && !write_latch;
+}
+
+uint32_t ppu_dots_until_vblank()
+{
+	const int32_t frame_dots = 262 * 341;
+	const int32_t vblank_dot = (241 + 1) * 341 + 1;
+	int32_t now = (scanline + 1) * 341 + cycles;
+	int32_t dots = vblank_dot - now + 1; //the next clock draws the dot at now
+	if (dots <= 0) dots += frame_dots;
+	//dot 0 of scanline 0 is skipped every frame
+	if (now <= 341 || now > vblank_dot) dots--;
+	return (uint32_t)dots;
+}
+
+uint32_t ppu_dots_until_frame_end()
+{
+	const int32_t frame_dots = 262 * 341;
+	int32_t now = (scanline + 1) * 341 + cycles;
+	int32_t dots = frame_dots - now;
+	if (now <= 341) dots--;
+	return (uint32_t)dots;
+}
+
+//the pixels of dots from up to (not including) to of the current line with rendering off
+static void draw_blank_dots(int from, int to)
+{
+	if (!compose_pixels || scanline < 0) return;
+	if (from < 1) from = 1;
+	if (to > 257) to = 257;
+
+	uint32_t colour = background_colour(0);
+	if (from == 1 && to == 257) fill_row(scanline, colour);
+	else for (int dot = from; dot < to; dot++) set_pixel(dot - 1, scanline, colour);
+}
+
+uint32_t ppu_skip_blank_dots(uint32_t dots)
+{
+	if (mask.background_rendering || mask.sprite_rendering || nmi) return 0;
+	//vblank is cleared on dot 1 of the pre-render line, straight after the frame ends
+	if (scanline == -1 && cycles <= 1) return 0;
+	//nothing has touched the ppu since dot 1 so rendering was off for the whole of the line so far
+	if (line_pending)
+	{
+		draw_blank_dots(1, cycles);
+		blank_fetches();
+	}
+
+	uint32_t until_event = ppu_dots_until_vblank();
+	uint32_t frame_end = ppu_dots_until_frame_end();
+	if (frame_end < until_event) until_event = frame_end;
+	if (dots >= until_event) dots = until_event - 1;
+
+	bool fetched = false;
+	uint32_t run = 0;
+	while (run < dots)
+	{
+		if (scanline == 0 && cycles == 0) cycles = 1;
+
+		uint32_t take = 341 - cycles;
+		if (take > dots - run) take = dots - run;
+
+		if (scanline >= -1 && scanline < 240)
+		{
+			fetched = true;
+			draw_blank_dots(cycles, cycles + take);
+		}
+
+		cycles += take;
+		run += take;
+		if (cycles >= 341)
+		{
+			cycles = 0;
+			scanline++;
+		}
+	}
+
+	if (fetched) blank_fetches();
+
+	//stopping part way through a line the rest of it goes dot by dot, the cpu may turn rendering on
+	line_pending = false;
+	line_by_dots = scanline >= -1 && scanline < 240 && cycles > 1 && cycles <= 256;
+	return run;
+}
+
+int ppu_get_scanline() { return scanline; }
+int ppu_get_dot() { return cycles; }
+uint64_t ppu_get_frame_count() { return frame_count; }
+
 Ppu_Regs ppu_get_regs()
 {
 	Ppu_Regs r;
@@ -1,23 +1,65 @@
 #pragma once
 #include <stdbool.h>
 #include "bus.h"
+#include "nes.h"
+#include "cartridge.h"
 
-void initialise_ppu(Bus* bus);
+//the profile picks which build of the clock ppu_clock points at
+void initialise_ppu(Bus* bus, Nes_profile profile);
 void reset_ppu();
-void ppu_clock();
+extern void (*ppu_clock)();
+void ppu_clock_fast();
+void ppu_clock_accurate();
 bool ppu_nmi();
 void reset_frame_complete();
 void nmi_acknolodged();
 bool is_frame_complete();
 
+/*
+ when disabled the ppu skips pixel composition and set_pixel for the rest of the frame,
+ everything with a timing side effect (vblank, nmi, scrolling, shifters) still runs exactly as normal.
+ used to fast forward through frames that will never be presented
+*/
+void ppu_set_pixel_composition(bool enabled);
+
 Bus_device* get_ppu_bus_device();
 Bus_device* get_nametables_device();
 Bus_device* get_palette_ram_device();
 
+//the 1k of ram the nametable at $2000 + nametable * $400 currently reads and writes
 uint8_t* get_nametable_buffer(int nametable);
+
+//points the four nametables at the right ram, the cartridge calls it whenever its mirroring changes
+void ppu_map_nametables(Nt_mirroring_mode mode);
 typedef struct {
 	uint16_t vram, tram;
 	uint8_t  ctrl, mask, status;
 }Ppu_Regs;
 
-Ppu_Regs ppu_get_regs();
\ No newline at end of file
+Ppu_Regs ppu_get_regs();
+
+//current scanline (-1 is the pre-render line) and dot within it
+int ppu_get_scanline();
+int ppu_get_dot();
+
+/*
+ what a cpu read of $2002 would return without doing the read,
+ returns false if the read would change ppu state (vblank is set or the write latch is half way)
+*/
+bool ppu_peek_status(uint8_t* value);
+
+//ppu clocks until the one that sets vblank (and raises nmi when enabled), never overestimated
+uint32_t ppu_dots_until_vblank();
+
+//ppu clocks until the one that completes the frame, never overestimated
+uint32_t ppu_dots_until_frame_end();
+
+/*
+ with background and sprite rendering both off a dot only moves the counters, apart from filling the row on
+ dot 1 of a visible line. runs up to dots clocks in one go, stopping short of vblank being set or cleared
+ and the end of the frame, returns how many it ran (0 while rendering is on or an nmi is waiting)
+*/
+uint32_t ppu_skip_blank_dots(uint32_t dots);
+
+//number of frames completed since the program started
+uint64_t ppu_get_frame_count();
\ No newline at end of file
@@ -0,0 +1,65 @@
+/*
+ not a normal header, ppu.c includes it once per emulation profile (see Nes_profile in nes.h) to build that
+ profile's clock. PPU_CLOCK names the function and PPU_DOT_RENDERER picks how the background is drawn:
+  0 - dots 1-256 of a scanline in one go by render_scanline once they are over, unless the cpu touches a ppu
+      register part way through which sends the line dot by dot. the fetches for the next line still go dot
+      by dot unless rendering is off
+  1 - one dot per clock
+ both draw the same picture.
+*/
+void PPU_CLOCK()
+{
+	//visible scanlines
+	if (scanline >= -1 && scanline < 240)
+	{
+		//skip odd pixel pixel
+		if (scanline == 0 && cycles == 0)
+		{
+			cycles = 1;
+		}
+
+		// clear vblank
+		if (scanline == -1 && cycles == 1)
+		{
+			ppu_status.vblank = 0;
+		}
+
+#if PPU_DOT_RENDERER
+		render_dot();
+#else
+		if (cycles == 1)
+		{
+			line_pending = true;
+			line_by_dots = false;
+		}
+		else if (cycles <= 256)
+		{
+			if (line_by_dots) render_dot();
+		}
+		else
+		{
+			if (line_pending)
+			{
+				render_scanline();
+				line_pending = false;
+			}
+			//with rendering off the rest of the line only moves the counters
+			if (mask.background_rendering || mask.sprite_rendering) background_dot();
+		}
+#endif
+	}
+
+	// post-rendering scanlines
+	if (scanline >= 241 && scanline < 261)
+	{
+		if (scanline == 241 && cycles == 1)
+		{
+			ppu_status.vblank = 1;
+
+			if (ctrl.enable_nmi) nmi = true;
+			if (nmi && timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_NMI, 0, 0);
+		}
+	}
+
+	next_dot();
+}
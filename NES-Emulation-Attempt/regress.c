@@ -0,0 +1,367 @@
+#include "regress.h"
+#include "nes.h"
+#include "ppu.h"
+#include "ram.h"
+#include "cartridge.h"
+#include "6502.h"
+#include "controller.h"
+#include "frameBuffer.h"
+#include "xxhash.h"
+#include "platform.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_FRAMES 600
+#define DEFAULT_EVERY_FRAME 120 //boot is where timing changes show first so every frame up to here is checked
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+#define MAX_CHECKPOINTS 256
+#define MAX_SUITE_ROMS 1024
+#define MAX_PATH_LENGTH 1024
+
+typedef struct {
+	uint32_t frame;
+	uint64_t framebuffer_hash;
+	uint64_t ram_hash;
+	bool recorded;
+}Checkpoint;
+
+typedef struct {
+	uint32_t frames;
+	int count;
+	Checkpoint checkpoints[MAX_CHECKPOINTS];
+}Golden;
+
+typedef struct {
+	FILE* file;
+	bool has_next;
+	uint32_t next_frame;
+	uint8_t next_buttons[2];
+}Movie;
+
+static void default_golden(Golden* golden)
+{
+	golden->frames = DEFAULT_FRAMES;
+	golden->count = 0;
+	for (uint32_t frame = 1; frame <= DEFAULT_FRAMES; frame += frame < DEFAULT_EVERY_FRAME ? 1 : DEFAULT_CHECKPOINT_INTERVAL)
+	{
+		golden->checkpoints[golden->count++] = (Checkpoint){ .frame = frame };
+	}
+}
+
+//returns -1 if there is no golden file yet
+static int load_golden(const char* path, Golden* golden)
+{
+	FILE* file = fopen(path, "r");
+	if (!file) return -1;
+
+	golden->frames = DEFAULT_FRAMES;
+	golden->count = 0;
+
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		unsigned int frame;
+		unsigned long long fb, ram;
+		if (line[0] == '#') continue;
+
+		if (sscanf(line, "frames %u", &frame) == 1) {
+			golden->frames = frame;
+		}
+		else if (sscanf(line, "checkpoint %u", &frame) == 1 && golden->count < MAX_CHECKPOINTS) {
+			Checkpoint* checkpoint = &golden->checkpoints[golden->count++];
+			*checkpoint = (Checkpoint){ .frame = frame };
+			if (sscanf(line, "checkpoint %u fb %llx ram %llx", &frame, &fb, &ram) == 3) {
+				checkpoint->framebuffer_hash = fb;
+				checkpoint->ram_hash = ram;
+				checkpoint->recorded = true;
+			}
+		}
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static int save_golden(const char* path, const Golden* golden)
+{
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		log_warn("could not write %s", path);
+		return -1;
+	}
+
+	fprintf(file, "frames %u\n", golden->frames);
+	for (int i = 0; i < golden->count; i++)
+	{
+		const Checkpoint* checkpoint = &golden->checkpoints[i];
+		fprintf(file, "checkpoint %u fb %016llx ram %016llx\n", checkpoint->frame,
+			(unsigned long long)checkpoint->framebuffer_hash, (unsigned long long)checkpoint->ram_hash);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static uint8_t parse_buttons(const char* text)
+{
+	uint8_t buttons = 0;
+	for (; *text; text++)
+	{
+		switch (*text)
+		{
+		case 'A': buttons |= BUTTON_A; break;
+		case 'B': buttons |= BUTTON_B; break;
+		case 's': buttons |= BUTTON_SELECT; break;
+		case 'S': buttons |= BUTTON_START; break;
+		case 'U': buttons |= BUTTON_UP; break;
+		case 'D': buttons |= BUTTON_DOWN; break;
+		case 'L': buttons |= BUTTON_LEFT; break;
+		case 'R': buttons |= BUTTON_RIGHT; break;
+		default: break;
+		}
+	}
+	return buttons;
+}
+
+//the movie is read a line ahead so it never has to be held in memory
+static void read_movie_entry(Movie* movie)
+{
+	char line[128];
+	movie->has_next = false;
+	while (movie->file && fgets(line, sizeof(line), movie->file))
+	{
+		unsigned int frame;
+		char port1[16] = "", port2[16] = "";
+		if (line[0] == '#' || sscanf(line, "%u %15s %15s", &frame, port1, port2) < 2) continue;
+
+		movie->next_frame = frame;
+		movie->next_buttons[0] = parse_buttons(port1);
+		movie->next_buttons[1] = parse_buttons(port2);
+		movie->has_next = true;
+		return;
+	}
+}
+
+static void apply_movie(Movie* movie, uint32_t frame)
+{
+	while (movie->has_next && movie->next_frame <= frame)
+	{
+		set_controller_buttons(0, movie->next_buttons[0]);
+		set_controller_buttons(1, movie->next_buttons[1]);
+		read_movie_entry(movie);
+	}
+}
+
+static int write_bmp(const char* path, const uint32_t* pixels)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file) return -1;
+
+	uint32_t image_size = FRAME_WIDTH * FRAME_HEIGHT * 4;
+	uint8_t header[54] = { 'B', 'M' };
+	uint32_t file_size = sizeof(header) + image_size;
+	int32_t height = -FRAME_HEIGHT; //negative height stores the rows top down
+	memcpy(header + 2, &file_size, 4);
+	header[10] = sizeof(header);
+	header[14] = 40;
+	header[18] = FRAME_WIDTH & 0xFF;
+	header[19] = FRAME_WIDTH >> 8;
+	memcpy(header + 22, &height, 4);
+	header[26] = 1;
+	header[28] = 32;
+	memcpy(header + 34, &image_size, 4);
+	fwrite(header, sizeof(header), 1, file);
+
+	//frames are stored RGBA for the texture, bmp wants BGRA
+	for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++)
+	{
+		uint32_t p = pixels[i];
+		uint32_t bgra = (p & 0xFF00FF00) | ((p & 0xFF) << 16) | ((p >> 16) & 0xFF);
+		fwrite(&bgra, 4, 1, file);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+//each emulation profile keeps its own hashes, the accurate one draws mid-line register writes differently
+static void golden_path(char* path, size_t size, const char* rom_path)
+{
+	if (nes_get_profile() == NES_PROFILE_ACCURATE) snprintf(path, size, "%s.accurate.golden", rom_path);
+	else snprintf(path, size, "%s.golden", rom_path);
+}
+
+static void run_frame()
+{
+	while (!is_frame_complete()) nes_clock();
+	reset_frame_complete();
+}
+
+Regress_result run_regression_rom(const char* rom_path, bool update)
+{
+	char path[MAX_PATH_LENGTH];
+	Golden golden;
+	golden_path(path, sizeof(path), rom_path);
+	bool have_golden = load_golden(path, &golden) == 0;
+	if (!have_golden) default_golden(&golden);
+
+	//unmapped apu writes would drown out the result line
+	log_set_level(LOG_CRITICAL);
+
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		printf("ERROR %s could not be loaded\n", rom_path);
+		return REGRESS_ERROR;
+	}
+
+	Movie movie = { 0 };
+	snprintf(path, sizeof(path), "%s.movie", rom_path);
+	movie.file = fopen(path, "r");
+	read_movie_entry(&movie);
+
+	reset_nes();
+	set_emulator_running(true);
+	ppu_set_pixel_composition(true);
+
+	Regress_result result = REGRESS_PASS;
+	bool changed = false;
+	int next = 0;
+	for (uint32_t frame = 0; frame < golden.frames && result == REGRESS_PASS; frame++)
+	{
+		apply_movie(&movie, frame);
+		run_frame();
+
+		for (; next < golden.count && golden.checkpoints[next].frame <= frame + 1; next++)
+		{
+			Checkpoint* checkpoint = &golden.checkpoints[next];
+			if (checkpoint->frame != frame + 1) continue;
+
+			publish_frame(false);
+			acquire_latest_frame();
+			uint64_t fb = xxhash64(get_front_buffer(), FRAME_WIDTH * FRAME_HEIGHT * sizeof(uint32_t), 0);
+			uint64_t ram = xxhash64(get_ram_buffer(), 2048, 0);
+
+			if (checkpoint->recorded && !update && (fb != checkpoint->framebuffer_hash || ram != checkpoint->ram_hash))
+			{
+				snprintf(path, sizeof(path), "%s.frame%u.bmp", rom_path, checkpoint->frame);
+				write_bmp(path, get_front_buffer());
+				printf("FAIL  %s frame %u: %s hash %016llx expected %016llx, frame dumped to %s\n", rom_path, checkpoint->frame,
+					fb != checkpoint->framebuffer_hash ? "framebuffer" : "ram",
+					(unsigned long long)(fb != checkpoint->framebuffer_hash ? fb : ram),
+					(unsigned long long)(fb != checkpoint->framebuffer_hash ? checkpoint->framebuffer_hash : checkpoint->ram_hash), path);
+				result = REGRESS_FAIL;
+				break;
+			}
+
+			changed |= !checkpoint->recorded || fb != checkpoint->framebuffer_hash || ram != checkpoint->ram_hash;
+			checkpoint->framebuffer_hash = fb;
+			checkpoint->ram_hash = ram;
+			checkpoint->recorded = true;
+		}
+	}
+
+	if (movie.file) fclose(movie.file);
+	set_emulator_running(false);
+	remove_cartridge();
+	deinitalise_nes();
+
+	if (result != REGRESS_PASS) return result;
+
+	if (changed)
+	{
+		golden_path(path, sizeof(path), rom_path);
+		if (save_golden(path, &golden) == -1) return REGRESS_ERROR;
+		printf("%s %s (%d checkpoints recorded)\n", have_golden ? "UPDATED" : "NEW  ", rom_path, golden.count);
+	}
+	else
+	{
+		printf("PASS  %s (%u frames, %d checkpoints)\n", rom_path, golden.frames, golden.count);
+	}
+	return REGRESS_PASS;
+}
+
+typedef struct {
+	char* names[MAX_SUITE_ROMS];
+	int count;
+}Rom_list;
+
+static void collect_rom(const char* name, void* context)
+{
+	Rom_list* list = context;
+	size_t length = strlen(name);
+	if (length < 4 || strcmp(name + length - 4, ".nes") != 0 || list->count >= MAX_SUITE_ROMS) return;
+
+	list->names[list->count] = malloc(length + 1);
+	if (list->names[list->count]) strcpy(list->names[list->count++], name);
+}
+
+static int compare_names(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int run_regression_suite(const char* dir, bool update, int jobs)
+{
+	Rom_list roms = { 0 };
+	if (platform_list_directory(dir, collect_rom, &roms) == -1) {
+		log_warn("could not open rom directory %s", dir);
+		return -1;
+	}
+	qsort(roms.names, roms.count, sizeof(char*), compare_names);
+
+	char exe[MAX_PATH_LENGTH];
+	if (platform_executable_path(exe, sizeof(exe)) == -1) {
+		log_warn("could not find the emulator executable to run roms with");
+		return -1;
+	}
+
+	if (jobs <= 0) jobs = platform_cpu_count();
+	Platform_process** running = calloc(jobs, sizeof(Platform_process*));
+	if (!running) return -1;
+
+	int counts[3] = { 0 };
+	int started = 0;
+	int finished = 0;
+	double start = platform_now_seconds();
+
+	while (finished < roms.count)
+	{
+		for (int slot = 0; slot < jobs; slot++)
+		{
+			int exit_code;
+			if (running[slot] && platform_process_poll(running[slot], &exit_code))
+			{
+				running[slot] = NULL;
+				counts[exit_code == REGRESS_PASS || exit_code == REGRESS_FAIL ? exit_code : REGRESS_ERROR]++;
+				finished++;
+			}
+
+			if (!running[slot] && started < roms.count)
+			{
+				char rom_path[MAX_PATH_LENGTH];
+				snprintf(rom_path, sizeof(rom_path), "%s/%s", dir, roms.names[started]);
+				char* argv[6] = { exe, "--regress-rom", rom_path };
+				int argc = 3;
+				if (update) argv[argc++] = "--update";
+				if (cpu6502_jit_enabled()) argv[argc++] = "--jit";
+				if (nes_get_profile() == NES_PROFILE_ACCURATE) argv[argc++] = "--accurate";
+				running[slot] = platform_process_spawn(argc, argv);
+				if (!running[slot]) {
+					printf("ERROR %s could not start a process for it\n", rom_path);
+					counts[REGRESS_ERROR]++;
+					finished++;
+				}
+				started++;
+			}
+		}
+		platform_sleep_ms(1);
+	}
+
+	printf("%d roms: %d passed, %d failed, %d errors in %.2f s using %d processes\n", roms.count,
+		counts[REGRESS_PASS], counts[REGRESS_FAIL], counts[REGRESS_ERROR], platform_now_seconds() - start, jobs);
+
+	for (int i = 0; i < roms.count; i++) free(roms.names[i]);
+	free(running);
+	return counts[REGRESS_FAIL] == 0 && counts[REGRESS_ERROR] == 0 && roms.count > 0 ? 0 : -1;
+}
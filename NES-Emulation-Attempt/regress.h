@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+
+/*
+ golden frame regression suite.
+ every *.nes in a directory is run headless for a fixed number of frames, at each checkpoint the framebuffer
+ and ram are hashed with xxhash64 and compared to <rom>.golden, or <rom>.accurate.golden with the accurate
+ profile. any difference fails the rom and the frame is dumped next to it as <rom>.frame<N>.bmp.
+ roms run in their own processes so they can use every core.
+
+ <rom>.golden (written on the first run or with update, can be edited by hand to pick the checkpoints):
+  frames 600
+  checkpoint 60 fb 0123456789abcdef ram 0123456789abcdef
+  a checkpoint without hashes is recorded the next time the rom runs. a new file checks every frame up to 120
+  then every 60th, the roms that ship with the emulator have theirs committed for both profiles
+ <rom>.movie (optional input, buttons are held until the next line):
+  <frame> <port 1 buttons> [<port 2 buttons>]
+  buttons are any of A B s(elect) S(tart) U D L R, or . for none
+*/
+
+typedef enum {
+	REGRESS_PASS = 0,
+	REGRESS_FAIL = 1,
+	REGRESS_ERROR = 2,
+}Regress_result;
+
+/*
+ runs every rom in dir across jobs processes (0 uses every core), update rewrites the golden hashes
+ returns 0 if every rom passed
+*/
+int run_regression_suite(const char* dir, bool update, int jobs);
+
+//runs a single rom in this process and prints one result line
+Regress_result run_regression_rom(const char* rom_path, bool update);
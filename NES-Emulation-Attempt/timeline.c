@@ -0,0 +1,241 @@
+#include "timeline.h"
+#include "ppu.h"
+#include "nes.h"
+#include "cartridge.h"
+#include "platform.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TIMELINE_RING_EVENTS (1 << 16) //per thread, has to be a power of two
+
+//tids of the tracks shown in the viewer
+#define TRACK_NES 1
+#define TRACK_EMULATION 2
+#define TRACK_UI 3
+
+typedef struct {
+	uint64_t ns;
+	uint32_t frame;
+	int16_t scanline;
+	uint16_t dot;
+	uint8_t type;
+	uint8_t reg;
+	uint8_t value;
+}Timeline_event;
+
+//one producer (the thread it belongs to) and one consumer (the writer)
+typedef struct {
+	Timeline_event events[TIMELINE_RING_EVENTS];
+	volatile int32_t head;
+	volatile int32_t tail;
+	uint32_t dropped;
+}Timeline_ring;
+
+volatile bool timeline_active = false;
+
+static Timeline_ring rings[TIMELINE_THREAD_COUNT];
+static FILE* timeline_file = NULL;
+static Platform_thread* writer_thread = NULL;
+static uint64_t start_ns = 0;
+static uint32_t frame_limit = 0;
+static uint32_t frames_recorded = 0;
+static bool first_event = true;
+
+static const char* register_names[8] = {
+	"PPUCTRL", "PPUMASK", "PPUSTATUS", "OAMADDR", "OAMDATA", "PPUSCROLL", "PPUADDR", "PPUDATA",
+};
+
+void timeline_event(Timeline_thread thread, Timeline_event_type type, uint8_t reg, uint8_t value)
+{
+	Timeline_ring* ring = &rings[thread];
+	int32_t head = ring->head;
+	if (head - platform_atomic_load(&ring->tail) >= TIMELINE_RING_EVENTS) {
+		ring->dropped++;
+		return;
+	}
+
+	Timeline_event* event = &ring->events[head & (TIMELINE_RING_EVENTS - 1)];
+	event->ns = platform_now_ns() - start_ns;
+	event->type = (uint8_t)type;
+	event->reg = reg;
+	event->value = value;
+	if (thread == TIMELINE_EMULATION_THREAD)
+	{
+		event->frame = (uint32_t)ppu_get_frame_count();
+		event->scanline = (int16_t)ppu_get_scanline();
+		event->dot = (uint16_t)ppu_get_dot();
+	}
+	platform_atomic_store(&ring->head, head + 1);
+
+	//the frame limit is checked here so the ppu doesn't need to know about it
+	if (type == TIMELINE_FRAME_END && frame_limit && ++frames_recorded >= frame_limit) timeline_active = false;
+}
+
+static void write_event(const Timeline_event* event)
+{
+	static const struct {
+		const char* name;
+		char phase;
+		int track;
+	}kinds[] = {
+		[TIMELINE_FRAME_BEGIN] = { "frame", 'B', TRACK_NES },
+		[TIMELINE_FRAME_END] = { "frame", 'E', TRACK_NES },
+		[TIMELINE_NMI] = { "NMI", 'i', TRACK_NES },
+		[TIMELINE_PPU_READ] = { "read", 'i', TRACK_NES },
+		[TIMELINE_PPU_WRITE] = { "write", 'i', TRACK_NES },
+		[TIMELINE_BANK_SWITCH] = { "bank switch", 'i', TRACK_NES },
+		[TIMELINE_EMULATE_BEGIN] = { "emulate", 'B', TRACK_EMULATION },
+		[TIMELINE_EMULATE_END] = { "emulate", 'E', TRACK_EMULATION },
+		[TIMELINE_WAIT_BEGIN] = { "wait", 'B', TRACK_EMULATION },
+		[TIMELINE_WAIT_END] = { "wait", 'E', TRACK_EMULATION },
+		[TIMELINE_UPLOAD_BEGIN] = { "upload", 'B', TRACK_UI },
+		[TIMELINE_UPLOAD_END] = { "upload", 'E', TRACK_UI },
+		[TIMELINE_PRESENT_BEGIN] = { "present", 'B', TRACK_UI },
+		[TIMELINE_PRESENT_END] = { "present", 'E', TRACK_UI },
+	};
+
+	const char* name = kinds[event->type].name;
+	char register_name[32];
+	if (event->type == TIMELINE_PPU_READ || event->type == TIMELINE_PPU_WRITE)
+	{
+		snprintf(register_name, sizeof(register_name), "%s %s", name, register_names[event->reg & 7]);
+		name = register_name;
+	}
+
+	fprintf(timeline_file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+		first_event ? "" : ",", name, kinds[event->type].phase, event->ns / 1000.0, kinds[event->type].track);
+	first_event = false;
+
+	if (kinds[event->type].phase == 'i') fprintf(timeline_file, ",\"s\":\"t\"");
+	if (kinds[event->type].track != TRACK_NES) {
+		fprintf(timeline_file, "}");
+		return;
+	}
+
+	fprintf(timeline_file, ",\"args\":{\"frame\":%u,\"scanline\":%d,\"dot\":%u", event->frame, event->scanline, event->dot);
+	if (event->type == TIMELINE_PPU_READ || event->type == TIMELINE_PPU_WRITE)
+		fprintf(timeline_file, ",\"value\":\"$%02X\"", event->value);
+	else if (event->type == TIMELINE_BANK_SWITCH)
+		fprintf(timeline_file, ",\"slot\":%u,\"bank\":%u", event->reg, event->value);
+	fprintf(timeline_file, "}}");
+}
+
+//returns how many events were written
+static int drain_rings()
+{
+	int written = 0;
+	for (int i = 0; i < TIMELINE_THREAD_COUNT; i++)
+	{
+		Timeline_ring* ring = &rings[i];
+		int32_t head = platform_atomic_load(&ring->head);
+		int32_t tail = ring->tail;
+		for (; tail != head; tail++, written++) write_event(&ring->events[tail & (TIMELINE_RING_EVENTS - 1)]);
+		platform_atomic_store(&ring->tail, tail);
+	}
+	return written;
+}
+
+static void write_track_name(int track, const char* name)
+{
+	fprintf(timeline_file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		first_event ? "" : ",", track, name);
+	first_event = false;
+}
+
+static int timeline_writer_main(void* arg)
+{
+	(void)arg;
+	fprintf(timeline_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	write_track_name(TRACK_NES, "nes (emulated)");
+	write_track_name(TRACK_EMULATION, "emulation thread");
+	write_track_name(TRACK_UI, "ui thread");
+
+	while (timeline_active)
+	{
+		if (drain_rings() == 0) platform_sleep_ms(1);
+	}
+	drain_rings();
+
+	fprintf(timeline_file, "\n]}\n");
+	fclose(timeline_file);
+	timeline_file = NULL;
+
+	for (int i = 0; i < TIMELINE_THREAD_COUNT; i++)
+	{
+		if (rings[i].dropped) log_warn("timeline ring %d was full, %u events were dropped", i, rings[i].dropped);
+	}
+	log_info("timeline finished");
+	return 0;
+}
+
+int start_timeline(const char* path, uint32_t frames)
+{
+	stop_timeline();
+
+	timeline_file = fopen(path, "w");
+	if (!timeline_file) {
+		log_warn("could not create timeline %s", path);
+		return -1;
+	}
+
+	for (int i = 0; i < TIMELINE_THREAD_COUNT; i++)
+	{
+		rings[i].head = 0;
+		rings[i].tail = 0;
+		rings[i].dropped = 0;
+	}
+	start_ns = platform_now_ns();
+	frame_limit = frames;
+	frames_recorded = 0;
+	first_event = true;
+	timeline_active = true;
+
+	writer_thread = platform_thread_create(timeline_writer_main, NULL);
+	if (!writer_thread) {
+		log_critical("Failed to create the timeline writer thread");
+		timeline_active = false;
+		fclose(timeline_file);
+		timeline_file = NULL;
+		return -1;
+	}
+
+	//the frame in progress gets a begin so its end has something to close
+	timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_FRAME_BEGIN, 0, 0);
+	return 0;
+}
+
+void stop_timeline()
+{
+	//the writer may have already finished if the frame limit was reached
+	timeline_active = false;
+	if (!writer_thread) return;
+	platform_thread_join(writer_thread);
+	writer_thread = NULL;
+}
+
+int timeline_rom(const char* rom_path, const char* out_path, uint32_t frames)
+{
+	if (initialise_nes() == -1 || insert_cartridge(rom_path) == -1) {
+		log_warn("could not load %s", rom_path);
+		return -1;
+	}
+
+	reset_nes();
+	set_emulator_running(true);
+	int result = start_timeline(out_path, frames ? frames : 1);
+	while (result == 0 && timeline_active)
+	{
+		timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_EMULATE_BEGIN, 0, 0);
+		while (!is_frame_complete()) nes_clock();
+		reset_frame_complete();
+		if (timeline_active) timeline_event(TIMELINE_EMULATION_THREAD, TIMELINE_EMULATE_END, 0, 0);
+	}
+	stop_timeline();
+
+	set_emulator_running(false);
+	remove_cartridge();
+	deinitalise_nes();
+	return result;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ timeline of emulator events in chrome trace event json, open it in perfetto or chrome://tracing.
+ emulated frames, nmi and every $2000-$2007 access (with scanline and dot) go on an "nes" track,
+ the host side emulate/wait and upload/present spans go on tracks for the emulation and ui threads.
+ each recording thread has its own preallocated ring and a writer thread turns them into json,
+ so recording costs a store and an atomic, a full ring drops events rather than stalling.
+*/
+
+typedef enum {
+	TIMELINE_EMULATION_THREAD,
+	TIMELINE_UI_THREAD,
+	TIMELINE_THREAD_COUNT,
+}Timeline_thread;
+
+typedef enum {
+	TIMELINE_FRAME_BEGIN,
+	TIMELINE_FRAME_END,
+	TIMELINE_NMI,
+	TIMELINE_PPU_READ, //value is the ppu register 0-7
+	TIMELINE_PPU_WRITE,
+	TIMELINE_BANK_SWITCH, //for mappers that switch banks, mapper 0 never does
+	TIMELINE_EMULATE_BEGIN,
+	TIMELINE_EMULATE_END,
+	TIMELINE_WAIT_BEGIN,
+	TIMELINE_WAIT_END,
+	TIMELINE_UPLOAD_BEGIN,
+	TIMELINE_UPLOAD_END,
+	TIMELINE_PRESENT_BEGIN,
+	TIMELINE_PRESENT_END,
+}Timeline_event_type;
+
+//checked before recording anything, cleared on its own once the frame limit is reached
+extern volatile bool timeline_active;
+
+/*
+ starts recording to path, frames is how many emulated frames to record before stopping by itself (0 for no limit).
+ has to be called from the emulation thread
+ returns -1 if the file or writer thread could not be created
+*/
+int start_timeline(const char* path, uint32_t frames);
+
+//stops recording and waits for the writer to finish the file, emulation thread only
+void stop_timeline();
+
+/*
+ records one event for the thread calling it, reg and value are only used by register and bank events.
+ events from the emulation thread also record the ppu position
+*/
+void timeline_event(Timeline_thread thread, Timeline_event_type type, uint8_t reg, uint8_t value);
+
+/*
+ runs a rom headless recording the first frames frames
+ returns -1 if the rom could not be loaded or the timeline not created
+*/
+int timeline_rom(const char* rom_path, const char* out_path, uint32_t frames);
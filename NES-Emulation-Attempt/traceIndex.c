@@ -0,0 +1,352 @@
+#include "traceIndex.h"
+#include "cpuTrace.h"
+#include "6502.h"
+#include "platform.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADDRESS_COUNT 65536
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size; //of the trace it was built from
+	uint64_t record_count;
+	uint64_t frame_count;
+}Trace_index_header;
+
+/*
+ index layout after the header, everything is 8 byte aligned:
+  uint64_t frame_start[frame_count + 1]    last entry is record_count
+  uint64_t exec_offset[ADDRESS_COUNT + 1]  start of each address's list in exec_list
+  uint64_t write_offset[ADDRESS_COUNT + 1]
+  uint32_t exec_list[record_count]
+  uint32_t write_list[write_offset[ADDRESS_COUNT]]
+*/
+typedef struct {
+	Platform_file_map* trace_map;
+	Platform_file_map* index_map;
+	const Trace_record* records;
+	uint64_t record_count;
+	const Trace_index_header* header;
+	const uint64_t* frame_start;
+	const uint64_t* exec_offset;
+	const uint64_t* write_offset;
+	const uint32_t* exec_list;
+	const uint32_t* write_list;
+}Trace_index;
+
+static void index_path(const char* trace_path, char* out, size_t size)
+{
+	snprintf(out, size, "%s.idx", trace_path);
+}
+
+static const Trace_record* map_trace(const char* trace_path, uint64_t* record_count, Platform_file_map** map)
+{
+	uint64_t size = 0;
+	const uint8_t* data = platform_map_file(trace_path, &size, map);
+	if (!data) {
+		log_warn("could not map cpu trace %s", trace_path);
+		return NULL;
+	}
+
+	if (size < sizeof(Trace_file_header) || !is_cpu_trace_header((const Trace_file_header*)data)) {
+		log_warn("%s is not a version %d cpu trace", trace_path, CPU_TRACE_VERSION);
+		platform_unmap_file(*map);
+		return NULL;
+	}
+
+	*record_count = (size - sizeof(Trace_file_header)) / sizeof(Trace_record);
+	return (const Trace_record*)(data + sizeof(Trace_file_header));
+}
+
+//a frame starts whenever the scanline goes backwards (the ppu wrapped back to the pre-render line)
+static bool starts_frame(const Trace_record* records, uint64_t i)
+{
+	return i > 0 && records[i].scanline < records[i - 1].scanline;
+}
+
+int build_trace_index(const char* trace_path)
+{
+	Platform_file_map* trace_map;
+	uint64_t record_count;
+	const Trace_record* records = map_trace(trace_path, &record_count, &trace_map);
+	if (!records) return -1;
+
+	if (record_count > UINT32_MAX) {
+		log_warn("%s has %llu records, the index can only hold %u", trace_path, (unsigned long long)record_count, UINT32_MAX);
+		platform_unmap_file(trace_map);
+		return -1;
+	}
+
+	//first pass only counts so the index file can be created at its final size
+	uint64_t* exec_count = calloc(ADDRESS_COUNT, sizeof(uint64_t));
+	uint64_t* write_count = calloc(ADDRESS_COUNT, sizeof(uint64_t));
+	if (!exec_count || !write_count) {
+		log_critical("Failed to allocate trace index counters");
+		free(exec_count);
+		free(write_count);
+		platform_unmap_file(trace_map);
+		return -1;
+	}
+
+	uint64_t frame_count = record_count ? 1 : 0;
+	uint64_t total_writes = 0;
+	for (uint64_t i = 0; i < record_count; i++)
+	{
+		exec_count[records[i].pc]++;
+		if (instruction_writes_memory(records[i].bytes[0])) {
+			write_count[records[i].addr]++;
+			total_writes++;
+		}
+		if (starts_frame(records, i)) frame_count++;
+	}
+
+	uint64_t size = sizeof(Trace_index_header)
+		+ (frame_count + 1) * sizeof(uint64_t)
+		+ (ADDRESS_COUNT + 1) * sizeof(uint64_t) * 2
+		+ (record_count + total_writes) * sizeof(uint32_t);
+
+	char path[1024];
+	index_path(trace_path, path, sizeof(path));
+	Platform_file_map* index_map;
+	uint8_t* data = platform_create_mapped_file(path, size, &index_map);
+	if (!data) {
+		log_warn("could not create trace index %s", path);
+		free(exec_count);
+		free(write_count);
+		platform_unmap_file(trace_map);
+		return -1;
+	}
+
+	Trace_index_header* header = (Trace_index_header*)data;
+	uint64_t* frame_start = (uint64_t*)(header + 1);
+	uint64_t* exec_offset = frame_start + frame_count + 1;
+	uint64_t* write_offset = exec_offset + ADDRESS_COUNT + 1;
+	uint32_t* exec_list = (uint32_t*)(write_offset + ADDRESS_COUNT + 1);
+	uint32_t* write_list = exec_list + record_count;
+
+	exec_offset[0] = 0;
+	write_offset[0] = 0;
+	for (int addr = 0; addr < ADDRESS_COUNT; addr++)
+	{
+		exec_offset[addr + 1] = exec_offset[addr] + exec_count[addr];
+		write_offset[addr + 1] = write_offset[addr] + write_count[addr];
+		//the counts become fill cursors for the second pass
+		exec_count[addr] = exec_offset[addr];
+		write_count[addr] = write_offset[addr];
+	}
+
+	//second pass fills the lists, records are visited in order so every list comes out sorted
+	uint64_t frame = 0;
+	if (record_count) frame_start[frame++] = 0;
+	for (uint64_t i = 0; i < record_count; i++)
+	{
+		exec_list[exec_count[records[i].pc]++] = (uint32_t)i;
+		if (instruction_writes_memory(records[i].bytes[0])) write_list[write_count[records[i].addr]++] = (uint32_t)i;
+		if (starts_frame(records, i)) frame_start[frame++] = i;
+	}
+	frame_start[frame_count] = record_count;
+
+	//the header goes in last so a half built index is never mistaken for a good one
+	header->version = TRACE_INDEX_VERSION;
+	header->record_size = sizeof(Trace_record);
+	header->record_count = record_count;
+	header->frame_count = frame_count;
+	memcpy(header->magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC));
+
+	log_info("indexed %llu records, %llu frames and %llu writes of %s", (unsigned long long)record_count,
+		(unsigned long long)frame_count, (unsigned long long)total_writes, trace_path);
+
+	free(exec_count);
+	free(write_count);
+	platform_unmap_file(index_map);
+	platform_unmap_file(trace_map);
+	return 0;
+}
+
+static void close_index(Trace_index* index)
+{
+	if (index->index_map) platform_unmap_file(index->index_map);
+	if (index->trace_map) platform_unmap_file(index->trace_map);
+	memset(index, 0, sizeof(Trace_index));
+}
+
+//returns -1 if the index is missing, for another trace or was built by a different version
+static int open_index(const char* trace_path, Trace_index* index)
+{
+	memset(index, 0, sizeof(Trace_index));
+	index->records = map_trace(trace_path, &index->record_count, &index->trace_map);
+	if (!index->records) return -1;
+
+	char path[1024];
+	index_path(trace_path, path, sizeof(path));
+	uint64_t size = 0;
+	const uint8_t* data = platform_map_file(path, &size, &index->index_map);
+	const Trace_index_header* header = (const Trace_index_header*)data;
+	if (!data || size < sizeof(Trace_index_header) || memcmp(header->magic, TRACE_INDEX_MAGIC, sizeof(TRACE_INDEX_MAGIC)) != 0
+		|| header->version != TRACE_INDEX_VERSION || header->record_size != sizeof(Trace_record)
+		|| header->record_count != index->record_count)
+	{
+		close_index(index);
+		return -1;
+	}
+
+	index->header = header;
+	index->frame_start = (const uint64_t*)(header + 1);
+	index->exec_offset = index->frame_start + header->frame_count + 1;
+	index->write_offset = index->exec_offset + ADDRESS_COUNT + 1;
+	index->exec_list = (const uint32_t*)(index->write_offset + ADDRESS_COUNT + 1);
+	index->write_list = index->exec_list + index->record_count;
+	return 0;
+}
+
+//first position in list[0..count) holding a value >= value
+static uint64_t lower_bound(const uint32_t* list, uint64_t count, uint64_t value)
+{
+	uint64_t lower = 0;
+	uint64_t higher = count;
+	while (lower < higher) {
+		uint64_t middle = lower + (higher - lower) / 2;
+		if (list[middle] < value) lower = middle + 1;
+		else higher = middle;
+	}
+	return lower;
+}
+
+//frame that record belongs to
+static uint64_t frame_of(const Trace_index* index, uint64_t record)
+{
+	uint64_t lower = 0;
+	uint64_t higher = index->header->frame_count;
+	while (higher - lower > 1) {
+		uint64_t middle = lower + (higher - lower) / 2;
+		if (index->frame_start[middle] <= record) lower = middle;
+		else higher = middle;
+	}
+	return lower;
+}
+
+//first record at or after cycle, cycles only go up through a trace
+static uint64_t record_at_cycle(const Trace_index* index, uint64_t cycle)
+{
+	uint64_t lower = 0;
+	uint64_t higher = index->record_count;
+	while (lower < higher) {
+		uint64_t middle = lower + (higher - lower) / 2;
+		if (index->records[middle].cycle < cycle) lower = middle + 1;
+		else higher = middle;
+	}
+	return lower;
+}
+
+static void print_record(const Trace_index* index, uint64_t record)
+{
+	char line[128];
+	format_trace_record(&index->records[record], line, sizeof(line));
+	printf("frame %-6llu record %-10llu %s\n", (unsigned long long)frame_of(index, record), (unsigned long long)record, line);
+}
+
+//prints every entry of an address's list that falls within [first, last) records
+static uint64_t print_range(const Trace_index* index, const uint32_t* list, uint64_t count, uint64_t first, uint64_t last)
+{
+	uint64_t matches = 0;
+	for (uint64_t i = lower_bound(list, count, first); i < count && list[i] < last; i++)
+	{
+		print_record(index, list[i]);
+		matches++;
+	}
+	return matches;
+}
+
+static bool parse_address(const char* text, uint16_t* addr)
+{
+	if (*text == '$') text++;
+	char* end = NULL;
+	unsigned long value = strtoul(text, &end, 16);
+	if (end == text || *end != '\0' || value > 0xFFFF) return false;
+	*addr = (uint16_t)value;
+	return true;
+}
+
+static bool parse_number(const char* text, uint64_t* value)
+{
+	char* end = NULL;
+	*value = strtoull(text, &end, 10);
+	return end != text && *end == '\0';
+}
+
+int query_cpu_trace(const char* trace_path, int argc, char** argv)
+{
+	uint16_t addr;
+	if (argc < 2 || !parse_address(argv[1], &addr)) {
+		log_warn("expected a query of the form exec/writes <addr> [frames <first> <last>] or last-write <addr> before <cycle>");
+		return -1;
+	}
+
+	Trace_index index;
+	if (open_index(trace_path, &index) == -1)
+	{
+		log_info("building index for %s", trace_path);
+		if (build_trace_index(trace_path) == -1 || open_index(trace_path, &index) == -1) return -1;
+	}
+
+	double start = platform_now_seconds();
+	uint64_t matches = 0;
+	int result = 0;
+
+	if (strcmp(argv[0], "exec") == 0 || strcmp(argv[0], "writes") == 0)
+	{
+		bool exec = argv[0][0] == 'e';
+		const uint32_t* list = exec ? index.exec_list : index.write_list;
+		const uint64_t* offset = exec ? index.exec_offset : index.write_offset;
+
+		uint64_t first = 0;
+		uint64_t last = index.record_count;
+		uint64_t first_frame, last_frame;
+		if (argc == 5 && strcmp(argv[2], "frames") == 0 && parse_number(argv[3], &first_frame) && parse_number(argv[4], &last_frame))
+		{
+			uint64_t frames = index.header->frame_count;
+			first = index.frame_start[first_frame < frames ? first_frame : frames];
+			last = index.frame_start[last_frame + 1 < frames ? last_frame + 1 : frames];
+		}
+		else if (argc != 2)
+		{
+			log_warn("expected %s <addr> [frames <first> <last>]", argv[0]);
+			result = -1;
+		}
+
+		if (result == 0) matches = print_range(&index, list + offset[addr], offset[addr + 1] - offset[addr], first, last);
+	}
+	else if (strcmp(argv[0], "last-write") == 0)
+	{
+		uint64_t cycle;
+		if (argc != 4 || strcmp(argv[2], "before") != 0 || !parse_number(argv[3], &cycle))
+		{
+			log_warn("expected last-write <addr> before <cycle>");
+			result = -1;
+		}
+		else
+		{
+			const uint32_t* list = index.write_list + index.write_offset[addr];
+			uint64_t count = index.write_offset[addr + 1] - index.write_offset[addr];
+			uint64_t position = lower_bound(list, count, record_at_cycle(&index, cycle));
+			if (position > 0)
+			{
+				print_record(&index, list[position - 1]);
+				matches = 1;
+			}
+		}
+	}
+	else
+	{
+		log_warn("unknown trace query %s", argv[0]);
+		result = -1;
+	}
+
+	if (result == 0) printf("%llu matches in %.3f ms\n", (unsigned long long)matches, (platform_now_seconds() - start) * 1000.0);
+	close_index(&index);
+	return result;
+}
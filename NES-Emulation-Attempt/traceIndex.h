@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ side index for binary cpu traces so questions about a huge trace don't need a linear scan.
+ the trace is memory mapped and the index is written next to it as <trace>.idx:
+  - the record each frame starts at (frame 0 is the first frame in the trace)
+  - for every address, a sorted list of the records that executed it
+  - for every address, a sorted list of the records that wrote it (stores and read-modify-write only)
+ queries are then a couple of binary searches into those lists.
+ record numbers are stored as 32 bits so a trace can hold up to 4G instructions (~96GB).
+*/
+
+#define TRACE_INDEX_MAGIC "NESTIDX"
+#define TRACE_INDEX_VERSION 1
+
+/*
+ builds <trace_path>.idx, replacing any existing one
+ returns -1 if the trace could not be read or the index could not be written
+*/
+int build_trace_index(const char* trace_path);
+
+/*
+ answers a query against a trace, building the index first if it is missing or out of date
+ query words (addresses in hex with an optional $, frames and cycles in decimal):
+  exec <addr> [frames <first> <last>]       every execution of addr
+  writes <addr> [frames <first> <last>]     every write to addr
+  last-write <addr> before <cycle>          the last write to addr before a cpu cycle
+ matching records are printed as nestest style lines
+ returns -1 on a bad query or if the trace/index can't be used
+*/
+int query_cpu_trace(const char* trace_path, int argc, char** argv);
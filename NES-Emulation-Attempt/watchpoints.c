@@ -0,0 +1,224 @@
+#include "watchpoints.h"
+#include "bus.h"
+#include "6502.h"
+#include "nes.h"
+#include "platform.h"
+#include "logger.h"
+#include <string.h>
+
+#define BUS_COUNT 2
+#define PAGE_COUNT 256
+
+/*
+ watches and the page counts are only changed by the ui thread, the traps run on the emulation thread.
+ a watch byte is set before its page is overlaid and the overlay removed before the byte is cleared
+ so a trap never runs for a page it does not know about
+*/
+static uint8_t watches[BUS_COUNT][65536];
+static uint16_t page_watch_count[BUS_COUNT][PAGE_COUNT];
+static volatile int total_watchpoints = 0;
+
+/*
+ the log is only written by the emulation thread, log_head counts every hit ever recorded.
+ clearing just moves log_base so the reader never has to touch the writer's state
+*/
+static Watch_hit watch_log[WATCH_LOG_SIZE];
+static volatile int32_t log_head = 0;
+static int32_t log_base = 0;
+
+static void record_hit(uint8_t bus, uint16_t addr, Watch_type type, uint8_t old_value, uint8_t new_value, bool old_value_known)
+{
+	int32_t head = platform_atomic_load(&log_head);
+	Watch_hit* hit = &watch_log[head % WATCH_LOG_SIZE];
+	hit->bus = bus;
+	hit->type = (uint8_t)type;
+	hit->addr = addr;
+	hit->pc = cpu6502_get_instruction_pc();
+	hit->cycle = get_cpu_cycle_count();
+	hit->old_value = old_value;
+	hit->new_value = new_value;
+	hit->old_value_known = old_value_known;
+	platform_atomic_store(&log_head, head + 1);
+}
+
+static uint8_t trap_read(uint8_t bus_number, const uint16_t addr)
+{
+	const Bus* bus = get_bus(bus_number);
+	uint8_t value = bus_read_underlying(bus, addr);
+	if (watches[bus_number - 1][addr] & WATCH_READ) {
+		record_hit(bus_number, addr, WATCH_READ, value, value, true);
+	}
+	return value;
+}
+
+static void trap_write(uint8_t bus_number, const uint16_t addr, const uint8_t data)
+{
+	const Bus* bus = get_bus(bus_number);
+	uint8_t watch = watches[bus_number - 1][addr];
+
+	uint8_t old_value = 0x00;
+	bool old_value_known = false;
+	if ((watch & (WATCH_WRITE | WATCH_CHANGE)) && !bus_read_has_side_effects(bus, addr)) {
+		old_value = bus_read_underlying(bus, addr);
+		old_value_known = true;
+	}
+
+	bus_write_underlying(bus, addr, data);
+
+	if (watch & WATCH_WRITE) {
+		record_hit(bus_number, addr, WATCH_WRITE, old_value, data, old_value_known);
+	}
+	//without the old value there is no way to tell so it counts as a change
+	else if ((watch & WATCH_CHANGE) && (!old_value_known || old_value != data)) {
+		record_hit(bus_number, addr, WATCH_CHANGE, old_value, data, old_value_known);
+	}
+}
+
+//bus_read_fn has no context pointer so each bus gets its own pair of traps
+static uint8_t cpu_trap_read(const uint16_t addr) { return trap_read(1, addr); }
+static void cpu_trap_write(const uint16_t addr, const uint8_t data) { trap_write(1, addr, data); }
+static uint8_t ppu_trap_read(const uint16_t addr) { return trap_read(2, addr); }
+static void ppu_trap_write(const uint16_t addr, const uint8_t data) { trap_write(2, addr, data); }
+
+static const Bus_device trap_devices[BUS_COUNT] = {
+	{ .name = "cpu watchpoint trap", .start_range = 0x0000, .end_range = 0xFFFF, .read = cpu_trap_read, .write = cpu_trap_write },
+	{ .name = "ppu watchpoint trap", .start_range = 0x0000, .end_range = 0xFFFF, .read = ppu_trap_read, .write = ppu_trap_write },
+};
+
+#define MAX_MIRRORS 1024
+
+/*
+ every address that reaches the same byte as addr, the first one is the same whichever mirror addr is.
+ internal ram repeats every 2k up to $2000, the ppu registers every 8 bytes up to $4000 and palette ram every
+ 32 bytes. nametables are only watched at the address given, which of them share ram is up to the cartridge's
+ mirroring and that can change while the watch is set
+*/
+static int mirrors_of(uint8_t bus_number, uint16_t addr, uint16_t mirrors[MAX_MIRRORS])
+{
+	uint32_t base = addr, stride = 0, end = 0;
+	if (bus_number == 1 && addr < 0x2000) { base = addr & 0x07FF; stride = 0x0800; end = 0x2000; }
+	else if (bus_number == 1 && addr < 0x4000) { base = 0x2000 | (addr & 0x0007); stride = 0x0008; end = 0x4000; }
+	else if (bus_number == 2 && addr >= 0x3F00 && addr < 0x4000) { base = 0x3F00 | (addr & 0x001F); stride = 0x0020; end = 0x4000; }
+
+	if (!stride)
+	{
+		mirrors[0] = addr;
+		return 1;
+	}
+
+	int count = 0;
+	for (uint32_t mirror = base; mirror < end; mirror += stride) mirrors[count++] = (uint16_t)mirror;
+	return count;
+}
+
+//the overlay comes off before the watch byte is cleared
+static void unwatch(Bus* bus, uint8_t bus_number, const uint16_t* mirrors, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		uint8_t page = mirrors[i] >> 8;
+		if (--page_watch_count[bus_number - 1][page] == 0) bus_set_page_overlay(bus, page, NULL);
+		watches[bus_number - 1][mirrors[i]] = 0;
+	}
+}
+
+int add_watchpoint(uint8_t bus_number, uint16_t addr, int types)
+{
+	Bus* bus = get_bus(bus_number);
+	types &= WATCH_READ | WATCH_WRITE | WATCH_CHANGE;
+	if (!bus || !types) return -1;
+
+	uint16_t mirrors[MAX_MIRRORS];
+	int count = mirrors_of(bus_number, addr, mirrors);
+	if (watches[bus_number - 1][mirrors[0]] == 0)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			uint8_t page = mirrors[i] >> 8;
+			watches[bus_number - 1][mirrors[i]] = (uint8_t)types;
+			if (page_watch_count[bus_number - 1][page]++ == 0 && bus_set_page_overlay(bus, page, &trap_devices[bus_number - 1]) == -1)
+			{
+				page_watch_count[bus_number - 1][page]--;
+				watches[bus_number - 1][mirrors[i]] = 0;
+				unwatch(bus, bus_number, mirrors, i);
+				return -1;
+			}
+		}
+		total_watchpoints++;
+	}
+	else
+	{
+		for (int i = 0; i < count; i++) watches[bus_number - 1][mirrors[i]] |= (uint8_t)types;
+	}
+
+	log_info("added watchpoint type %d at 0x%04X on bus %d (%d mirrors)", types, addr, bus_number, count);
+	return 0;
+}
+
+int remove_watchpoint(uint8_t bus_number, uint16_t addr)
+{
+	Bus* bus = get_bus(bus_number);
+	if (!bus) return -1;
+
+	uint16_t mirrors[MAX_MIRRORS];
+	int count = mirrors_of(bus_number, addr, mirrors);
+	if (watches[bus_number - 1][mirrors[0]] == 0) return -1;
+
+	unwatch(bus, bus_number, mirrors, count);
+	total_watchpoints--;
+
+	log_info("removed watchpoint at 0x%04X on bus %d", addr, bus_number);
+	return 0;
+}
+
+void clear_watchpoints()
+{
+	for (int b = 0; b < BUS_COUNT; b++)
+	{
+		for (int page = 0; page < PAGE_COUNT; page++)
+		{
+			if (page_watch_count[b][page] == 0) continue;
+			bus_set_page_overlay(get_bus((uint8_t)(b + 1)), (uint8_t)page, NULL);
+			page_watch_count[b][page] = 0;
+		}
+		memset(watches[b], 0, sizeof(watches[b]));
+	}
+	total_watchpoints = 0;
+}
+
+int watchpoint_count()
+{
+	return total_watchpoints;
+}
+
+int get_watch_log(Watch_hit* hits, int max)
+{
+	int32_t head = platform_atomic_load(&log_head);
+	int32_t available = head - log_base;
+	if (available > WATCH_LOG_SIZE) available = WATCH_LOG_SIZE;
+	if (max > available) max = available;
+
+	for (int i = 0; i < max; i++)
+	{
+		hits[i] = watch_log[(head - 1 - i) % WATCH_LOG_SIZE];
+	}
+
+	//the emulation thread may have lapped the ring while copying, drop anything it could have overwritten
+	int32_t lapped = platform_atomic_load(&log_head) - head;
+	if (lapped > 0)
+	{
+		max -= lapped;
+		if (max < 0) max = 0;
+	}
+	return max;
+}
+
+uint64_t watch_hit_total()
+{
+	return (uint64_t)(platform_atomic_load(&log_head) - log_base);
+}
+
+void clear_watch_log()
+{
+	log_base = platform_atomic_load(&log_head);
+}
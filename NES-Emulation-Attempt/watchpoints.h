@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+	WATCH_READ = (1 << 0),
+	WATCH_WRITE = (1 << 1),
+	WATCH_CHANGE = (1 << 2), //a write that actually changes the value
+}Watch_type;
+
+/*
+ watchpoints work by overlaying a trapping device on just the 256 byte pages that hold a watched address,
+ every other page keeps going straight to its device so an unwatched page costs nothing.
+ bus is 1 for the cpu bus or 2 for the ppu bus, same as get_bus.
+ all of these are safe to call from the ui thread while emulation runs.
+ a watch covers every mirror of its address (internal ram, the ppu registers and palette ram), watching or removing
+ any one of them is the same as the others. nametables are the exception, only the address given is watched
+*/
+
+/*
+ types can be or'd together, adding to an existing watchpoint merges the types
+ returns -1 if the bus is invalid or all watchpoints are in use
+*/
+int add_watchpoint(uint8_t bus, uint16_t addr, int types);
+
+/*
+ returns -1 if there was no watchpoint at addr
+*/
+int remove_watchpoint(uint8_t bus, uint16_t addr);
+
+void clear_watchpoints();
+
+int watchpoint_count();
+
+typedef struct {
+	uint8_t bus;
+	uint8_t type; //the Watch_type that fired
+	uint16_t addr;
+	uint16_t pc; //address of the cpu instruction executing at the time
+	uint64_t cycle; //cpu cycles since reset
+	uint8_t old_value; //for reads both values are the value read
+	uint8_t new_value;
+	bool old_value_known; //false when reading the old value would have side effects (ppu registers)
+}Watch_hit;
+
+#define WATCH_LOG_SIZE 256
+
+/*
+ copies up to max of the most recent hits, newest first
+ returns how many were copied
+*/
+int get_watch_log(Watch_hit* hits, int max);
+
+//total hits recorded since the log was last cleared, including ones that have been overwritten
+uint64_t watch_hit_total();
+
+void clear_watch_log();
@@ -5,11 +5,18 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "nes.h"
+#include "emuThread.h"
 #include "ram.h"
 #include "6502.h"
 #include "cartridge.h"
 #include "Graphics.h"
 #include "ppu.h"
+#include "breakpoints.h"
+#include "watchpoints.h"
+#include "perfCounters.h"
+#include "frameTimes.h"
+#include "platform.h"
+#include "logger.h"
 
 #pragma comment(lib, "comctl32.lib")
 
@@ -20,10 +27,13 @@ HINSTANCE hInst = NULL;
 static HWND  g_hwndMain = NULL;
 static HWND  g_hwndDxWnd = NULL;
 static HWND  g_btnRun = NULL, g_btnStep = NULL,  g_btnRefresh = NULL;
+static HWND  g_editBreak = NULL, g_btnBreak = NULL, g_btnClearBreaks = NULL, g_btnWatch = NULL;
 static HWND  g_lvRegs = NULL, g_lvDisasm = NULL, g_lvMem = NULL;
 static HWND  g_status = NULL;
 
 HMENU g_hview;
+HMENU g_hspeed;
+HMENU g_hemulation;
 
 static HFONT g_fontMono = NULL;
 static HFONT g_fontUI = NULL;
@@ -41,15 +51,39 @@ static HFONT g_fontUI = NULL;
 #define ID_NAMETABLE2         40007
 #define ID_NAMETABLE3         40008
 
+#define ID_SPEED_1X           40009
+#define ID_SPEED_2X           40010
+#define ID_SPEED_4X           40011
+#define ID_SPEED_8X           40012
+#define ID_SPEED_UNCAPPED     40013
+
+#define ID_WATCH_LOG          40014
+
+#define ID_TRACE_START        40015
+#define ID_TRACE_STOP         40016
+
+#define ID_PROFILE_START      40017
+#define ID_PROFILE_STOP       40018
+
+#define ID_TIMELINE_FRAME     40019
+#define ID_TIMELINE_START     40020
+#define ID_TIMELINE_STOP      40021
+
+#define ID_JIT                40022
+
 #define ID_BTN_RUN       41001
 #define ID_BTN_STEP      41002
 #define ID_BTN_REFRESH   41004
+#define ID_BTN_BREAK     41005
+#define ID_BTN_CLEAR_BREAKS 41006
+#define ID_BTN_WATCH     41007
 
 #define ID_LV_REGS       42001
 #define ID_LV_DISASM     42002
 #define ID_LV_MEM        42003
 #define ID_EDIT_LOG      42004
 #define ID_STATUS        42005
+#define ID_EDIT_BREAK    42006
 /*################################*/
 
 typedef enum Memory_view_type {
@@ -58,6 +92,7 @@ typedef enum Memory_view_type {
     Nametable1 = ID_NAMETABLE1,
     Nametable2 = ID_NAMETABLE2,
     Nametable3 = ID_NAMETABLE3,
+    WatchLog = ID_WATCH_LOG,
 }Memory_view_type;
 
 Memory_view_type memory_view_type;
@@ -113,6 +148,20 @@ static BOOL open_rom_dialog(HWND owner, wchar_t* outPath, DWORD cap)
     return GetOpenFileNameW(&ofn);
 }
 
+static BOOL save_file_dialog(HWND owner, const wchar_t* filter, const wchar_t* ext, wchar_t* outPath, DWORD cap)
+{
+    OPENFILENAMEW ofn = { 0 };
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = owner;
+    ofn.lpstrFilter = filter;
+    ofn.lpstrDefExt = ext;
+    ofn.lpstrFile = outPath;
+    ofn.nMaxFile = cap;
+    ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
+    outPath[0] = L'\0';
+    return GetSaveFileNameW(&ofn);
+}
+
 static int clampi(int v, int lo, int hi) { return (v < lo) ? lo : (v > hi) ? hi : v; }
 
 static void layout_controls(HWND hwnd)
@@ -146,6 +195,13 @@ static void layout_controls(HWND hwnd)
     if (g_btnStep)    MoveWindow(g_btnStep, x + (btnW + gap) * 1, y, btnW, btnH, TRUE);
     if (g_btnRefresh) MoveWindow(g_btnRefresh, x + (btnW + gap) * 2, y, btnW, btnH, TRUE);
 
+    // Breakpoint entry sits after the run controls
+    int breakX = x + (btnW + gap) * 3 + gap * 2;
+    if (g_editBreak)      MoveWindow(g_editBreak, breakX, y, btnW * 2, btnH, TRUE);
+    if (g_btnBreak)       MoveWindow(g_btnBreak, breakX + btnW * 2 + gap, y, btnW, btnH, TRUE);
+    if (g_btnClearBreaks) MoveWindow(g_btnClearBreaks, breakX + btnW * 3 + gap * 2, y, btnW, btnH, TRUE);
+    if (g_btnWatch)       MoveWindow(g_btnWatch, breakX + btnW * 4 + gap * 3, y, btnW, btnH, TRUE);
+
     y += btnH + gap;
 
     // Available height for main panes + log + status
@@ -189,6 +245,14 @@ static void lv_add_col(HWND lv, int col, int width, const wchar_t* title)
     ListView_InsertColumn(lv, col, &c);
 }
 
+static void lv_set_col_title(HWND lv, int col, const wchar_t* title)
+{
+    LVCOLUMNW c = { 0 };
+    c.mask = LVCF_TEXT;
+    c.pszText = (LPWSTR)title;
+    ListView_SetColumn(lv, col, &c);
+}
+
 static void lv_clear(HWND lv)
 {
     ListView_DeleteAllItems(lv);
@@ -209,6 +273,9 @@ static void lv_set_cell(HWND lv, int row, int col, const wchar_t* txt)
     ListView_SetItemText(lv, row, col, (LPWSTR)txt);
 }
 
+//what the emulation thread published the last time it stopped, the views never read the live cores
+static Emu_state view_state;
+
 static void lv_populate_nametable(int nametable)
 {
     int nametable_base = (0x2000 | (nametable << 10));
@@ -220,7 +287,7 @@ static void lv_populate_nametable(int nametable)
         lv_add_row(g_lvMem, i, t);
     }
 
-    uint8_t* nametable_ptr= get_nametable_buffer(nametable);
+    uint8_t* nametable_ptr = view_state.nametables[nametable];
 
     for (int row = 0; row < 64; row++)
     {
@@ -259,7 +326,7 @@ static void lv_populate_ram()
         lv_add_row(g_lvMem, i, t);
     }
 
-    uint8_t* ram = get_ram_buffer();
+    uint8_t* ram = view_state.ram;
 
     for (int row = 0; row < 128; row++)
     {
@@ -286,37 +353,80 @@ static void lv_populate_ram()
     }
 }
 
+/*
+ the watch log borrows the memory pane, its columns are renamed while it is shown
+ and put back to the hex dump headers when another view is picked
+*/
+static void set_memory_columns(bool watch_log)
+{
+    static const wchar_t* watch_titles[] = { L"PC", L"Bus", L"Type", L"Addr", L"Old", L"New" };
+
+    for (int col = 0; col < 17; col++)
+    {
+        wchar_t t[8];
+        if (col == 0) swprintf(t, 8, L"%s", watch_log ? watch_titles[0] : L"Address");
+        else if (watch_log && col < 6) swprintf(t, 8, L"%s", watch_titles[col]);
+        else if (watch_log) t[0] = L'\0';
+        else swprintf(t, 8, L"%X", col - 1);
+        lv_set_col_title(g_lvMem, col, t);
+    }
+    lv_set_col_title(g_lvMem, 17, watch_log ? L"Cycle" : L"ASCII");
+}
+
+static void lv_populate_watch_log()
+{
+    static const wchar_t* types[] = { L"", L"R", L"W", L"", L"C" };
+    Watch_hit hits[128];
+    int count = get_watch_log(hits, 128);
+
+    lv_clear(g_lvMem);
+    for (int row = 0; row < count; row++)
+    {
+        wchar_t t[32];
+        swprintf(t, 32, L"%04X", hits[row].pc);
+        lv_add_row(g_lvMem, row, t);
+
+        lv_set_cell(g_lvMem, row, 1, hits[row].bus == 1 ? L"CPU" : L"PPU");
+        lv_set_cell(g_lvMem, row, 2, types[hits[row].type]);
+        swprintf(t, 32, L"%04X", hits[row].addr);
+        lv_set_cell(g_lvMem, row, 3, t);
+        if (hits[row].old_value_known) swprintf(t, 32, L"%02X", hits[row].old_value);
+        else swprintf(t, 32, L"??");
+        lv_set_cell(g_lvMem, row, 4, t);
+        swprintf(t, 32, L"%02X", hits[row].new_value);
+        lv_set_cell(g_lvMem, row, 5, t);
+        swprintf(t, 32, L"%llu", hits[row].cycle);
+        lv_set_cell(g_lvMem, row, 17, t);
+    }
+}
+
 static int      currentDisassembledIndex = 0;
 static uint16_t last_pc = 0;
 static uint16_t expected_next_pc = 0;
 static int      have_expected = 0;
+static Debug_instructions shown_disassembly[DEBUG_INSTRUCTIONS];
 
 static void lv_populate_disassembly(void)
 {
-    Debug_instructions* di_list = NULL;
+    Debug_instructions* di_list = shown_disassembly;
 
-    Cpu6502_Regs r = cpu6502_get_regs();
-    uint16_t pc = r.pc;
+    uint16_t pc = view_state.cpu.pc;
 
     // If we don't have a valid expected next pc yet, or pc isn't sequential -> full regen
-    if (!have_expected || pc != expected_next_pc || currentDisassembledIndex >= 24)
+    if (!have_expected || pc != expected_next_pc || currentDisassembledIndex >= DEBUG_INSTRUCTIONS)
     {
         currentDisassembledIndex = 0;
-        di_list = reset_debug_instructions();
+        memcpy(shown_disassembly, view_state.disassembly, sizeof(shown_disassembly));
 
         // Set expectation based on line 0 (the instruction at current pc)
         last_pc = di_list[0].address;
         expected_next_pc = (uint16_t)(last_pc + di_list[0].numberOfBytes);
         have_expected = 1;
     }
-    else
-    {
-        // Sequential step: just use existing list and advance highlight
-        di_list = get_debug_instructions();
-    }
+    // on a sequential step the list already shown is kept and only the highlight advances
 
     // Update UI (mnemonics + highlight)
-    for (int i = 0; i < 24; i++)
+    for (int i = 0; i < DEBUG_INSTRUCTIONS; i++)
     {
         wchar_t temp[160];
         if (i == currentDisassembledIndex)
@@ -364,8 +474,8 @@ static BOOL regs_first = TRUE;
 
 static void lv_populate_registers() 
 {
-    Cpu6502_Regs r = cpu6502_get_regs();
-    Ppu_Regs ppu_r = ppu_get_regs();
+    Cpu6502_Regs r = view_state.cpu;
+    Ppu_Regs ppu_r = view_state.ppu;
     
     uint32_t cur[REG_COUNT] = {
         r.pc,
@@ -453,6 +563,7 @@ static void lv_populate_registers()
 
 static void refresh_view()
 {
+    get_emulation_state(&view_state);
     lv_populate_disassembly();
     lv_populate_registers();
 
@@ -473,6 +584,9 @@ static void refresh_view()
     case Nametable3:
         lv_populate_nametable(3);
         break;
+    case WatchLog:
+        lv_populate_watch_log();
+        break;
     default:
         break;
     }
@@ -495,6 +609,23 @@ static void create_controls(HWND hwnd)
         WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
         0, 0, 10, 10, hwnd, (HMENU)ID_BTN_REFRESH, NULL, NULL);
 
+    g_editBreak = CreateWindowExW(WS_EX_CLIENTEDGE, L"EDIT", L"",
+        WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL | ES_UPPERCASE,
+        0, 0, 10, 10, hwnd, (HMENU)ID_EDIT_BREAK, NULL, NULL);
+    SendMessageW(g_editBreak, EM_SETCUEBANNER, TRUE, (LPARAM)L"[R][W][X] $addr [IF condition]");
+
+    g_btnBreak = CreateWindowExW(0, L"BUTTON", L"Toggle Break",
+        WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        0, 0, 10, 10, hwnd, (HMENU)ID_BTN_BREAK, NULL, NULL);
+
+    g_btnClearBreaks = CreateWindowExW(0, L"BUTTON", L"Clear Breaks",
+        WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        0, 0, 10, 10, hwnd, (HMENU)ID_BTN_CLEAR_BREAKS, NULL, NULL);
+
+    g_btnWatch = CreateWindowExW(0, L"BUTTON", L"Toggle Watch",
+        WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+        0, 0, 10, 10, hwnd, (HMENU)ID_BTN_WATCH, NULL, NULL);
+
     // Registers ListView
     g_lvRegs = CreateWindowExW(
         WS_EX_CLIENTEDGE, WC_LISTVIEWW, L"",
@@ -532,6 +663,10 @@ static void create_controls(HWND hwnd)
     set_font_recursive(g_btnRun, g_fontUI);
     set_font_recursive(g_btnStep, g_fontUI);
     set_font_recursive(g_btnRefresh, g_fontUI);
+    set_font_recursive(g_editBreak, g_fontMono);
+    set_font_recursive(g_btnBreak, g_fontUI);
+    set_font_recursive(g_btnClearBreaks, g_fontUI);
+    set_font_recursive(g_btnWatch, g_fontUI);
 
     // Configure listviews
     lv_set_extended(g_lvRegs);
@@ -592,11 +727,12 @@ static void create_controls(HWND hwnd)
     layout_controls(hwnd);
 
     // Status parts
-    int parts[3] = { 200, 520, -1 };
-    SendMessageW(g_status, SB_SETPARTS, 3, (LPARAM)parts);
+    int parts[4] = { 160, 300, 720, -1 };
+    SendMessageW(g_status, SB_SETPARTS, 4, (LPARAM)parts);
     SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"Break");
     SendMessageW(g_status, SB_SETTEXTW, 1, (LPARAM)L"CPU: 6502");
     SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"");
+    SendMessageW(g_status, SB_SETTEXTW, 3, (LPARAM)L"");
 }
 
 static void on_open_rom(HWND hwnd)
@@ -607,11 +743,12 @@ static void on_open_rom(HWND hwnd)
     char file[MAX_PATH];
     wcstombs_s(NULL, file, sizeof(file), path, sizeof(path));
 
-    remove_cartridge();
-    insert_cartridge(file);
-    reset_nes();
-
-    refresh_view();
+    //the view is refreshed once the emulation thread reports the rom is loaded
+    if (post_load_rom_command(file))
+    {
+        SetWindowTextW(g_btnRun, L"Continue [C]");
+        SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"Stopped");
+    }
 }
 
 static void clearChecks()
@@ -621,6 +758,200 @@ static void clearChecks()
     CheckMenuItem(g_hview, ID_NAMETABLE1, MF_BYCOMMAND | MF_UNCHECKED);
     CheckMenuItem(g_hview, ID_NAMETABLE2, MF_BYCOMMAND | MF_UNCHECKED);
     CheckMenuItem(g_hview, ID_NAMETABLE3, MF_BYCOMMAND | MF_UNCHECKED);
+    CheckMenuItem(g_hview, ID_WATCH_LOG, MF_BYCOMMAND | MF_UNCHECKED);
+}
+
+/*
+ parses "[R][W][X] [$]addr [IF condition]", with no type letters it defaults to an execute breakpoint
+ condition is set to the text after IF or NULL when there is none
+ returns false if the address is missing or not hex
+*/
+static bool parse_breakpoint_text(const wchar_t* text, uint16_t* addr, int* types, const wchar_t** condition)
+{
+    *condition = NULL;
+    *types = 0;
+    while (*text == L' ') text++;
+
+    for (; *text && *text != L' ' && *text != L'$'; text++)
+    {
+        if (*text == L'R') *types |= BREAK_ON_READ;
+        else if (*text == L'W') *types |= BREAK_ON_WRITE;
+        else if (*text == L'X') *types |= BREAK_ON_EXECUTE;
+        else break;
+    }
+    if (*types == 0) *types = BREAK_ON_EXECUTE;
+
+    while (*text == L' ' || *text == L'$') text++;
+
+    wchar_t* end = NULL;
+    unsigned long value = wcstoul(text, &end, 16);
+    if (end == text || value > 0xFFFF) return false;
+
+    while (*end == L' ') end++;
+    if (end[0] == L'I' && end[1] == L'F' && end[2] == L' ') *condition = end + 3;
+    else if (*end != L'\0') return false;
+
+    *addr = (uint16_t)value;
+    return true;
+}
+
+static void update_breakpoint_status()
+{
+    wchar_t text[64];
+    swprintf(text, 64, L"Breakpoints: %d", breakpoint_count());
+    SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)text);
+}
+
+static void on_toggle_breakpoint()
+{
+    wchar_t text[256];
+    GetWindowTextW(g_editBreak, text, 256);
+
+    uint16_t addr;
+    int types;
+    const wchar_t* condition;
+    if (!parse_breakpoint_text(text, &addr, &types, &condition))
+    {
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Invalid breakpoint, expected [R][W][X] $addr [IF condition]");
+        return;
+    }
+
+    if (condition)
+    {
+        char expression[256];
+        char error[128];
+        wcstombs_s(NULL, expression, sizeof(expression), condition, _TRUNCATE);
+        if (set_breakpoint_condition(addr, types, expression, error, sizeof(error)) == -1)
+        {
+            wchar_t message[160];
+            swprintf(message, 160, L"Condition error: %hs", error);
+            SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)message);
+            return;
+        }
+    }
+    else if ((get_breakpoint(addr) & types) == types)
+        remove_breakpoint(addr, types);
+    else
+        add_breakpoint(addr, types);
+
+    update_breakpoint_status();
+}
+
+/*
+ parses "[R][W][C] [PPU] [$]addr" using the breakpoint box, with no type letters it watches writes
+ returns false if the address is missing or not hex
+*/
+static bool parse_watch_text(const wchar_t* text, uint8_t* bus, uint16_t* addr, int* types)
+{
+    *types = 0;
+    *bus = 1;
+    while (*text == L' ') text++;
+
+    for (; *text && *text != L' ' && *text != L'$'; text++)
+    {
+        if (*text == L'R') *types |= WATCH_READ;
+        else if (*text == L'W') *types |= WATCH_WRITE;
+        else if (*text == L'C') *types |= WATCH_CHANGE;
+        else break;
+    }
+    if (*types == 0) *types = WATCH_WRITE;
+
+    while (*text == L' ') text++;
+    if (wcsncmp(text, L"PPU ", 4) == 0)
+    {
+        *bus = 2;
+        text += 4;
+    }
+    while (*text == L' ' || *text == L'$') text++;
+
+    wchar_t* end = NULL;
+    unsigned long value = wcstoul(text, &end, 16);
+    if (end == text || value > 0xFFFF) return false;
+    while (*end == L' ') end++;
+    if (*end != L'\0') return false;
+
+    *addr = (uint16_t)value;
+    return true;
+}
+
+static void on_toggle_watchpoint()
+{
+    wchar_t text[256];
+    GetWindowTextW(g_editBreak, text, 256);
+
+    uint8_t bus;
+    uint16_t addr;
+    int types;
+    if (!parse_watch_text(text, &bus, &addr, &types))
+    {
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Invalid watchpoint, expected [R][W][C] [PPU] $addr");
+        return;
+    }
+
+    if (remove_watchpoint(bus, addr) == -1)
+        add_watchpoint(bus, addr, types);
+
+    wchar_t status[64];
+    swprintf(status, 64, L"Watchpoints: %d", watchpoint_count());
+    SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)status);
+}
+
+static void select_speed(int id)
+{
+    static const int multipliers[] = { 1, 2, 4, 8, EMU_SPEED_UNCAPPED };
+
+    if (!post_speed_command(multipliers[id - ID_SPEED_1X])) return;
+
+    for (int i = ID_SPEED_1X; i <= ID_SPEED_UNCAPPED; i++)
+    {
+        CheckMenuItem(g_hspeed, i, MF_BYCOMMAND | (i == id ? MF_CHECKED : MF_UNCHECKED));
+    }
+}
+
+//the emulation thread logs a warning and stays on the interpreter if the jit can't be used
+static void toggle_jit()
+{
+    static bool jit_on = false;
+
+    if (!post_emulation_command(jit_on ? EMU_CMD_DISABLE_JIT : EMU_CMD_ENABLE_JIT)) return;
+    jit_on = !jit_on;
+    CheckMenuItem(g_hemulation, ID_JIT, MF_BYCOMMAND | (jit_on ? MF_CHECKED : MF_UNCHECKED));
+}
+
+//the trace is streamed until stopped, decode it with --decode-trace
+static void on_start_trace(HWND hwnd)
+{
+    wchar_t path[MAX_PATH];
+    if (!save_file_dialog(hwnd, L"CPU Trace (*.nestrace)\0*.nestrace\0All Files\0*.*\0", L"nestrace", path, MAX_PATH)) return;
+
+    char file[MAX_PATH];
+    wcstombs_s(NULL, file, sizeof(file), path, _TRUNCATE);
+    if (post_start_trace_command(file))
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Recording CPU trace");
+}
+
+//folded stacks for flamegraph.pl or speedscope, symbols can be added with the --profile tool
+static void on_stop_profile(HWND hwnd)
+{
+    wchar_t path[MAX_PATH];
+    if (!save_file_dialog(hwnd, L"Folded Stacks (*.folded)\0*.folded\0All Files\0*.*\0", L"folded", path, MAX_PATH)) return;
+
+    char file[MAX_PATH];
+    wcstombs_s(NULL, file, sizeof(file), path, _TRUNCATE);
+    if (post_stop_profile_command(file))
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"CPU profile saved");
+}
+
+//chrome trace event json, open it in perfetto
+static void on_start_timeline(HWND hwnd, int frames)
+{
+    wchar_t path[MAX_PATH];
+    if (!save_file_dialog(hwnd, L"Trace Event JSON (*.json)\0*.json\0All Files\0*.*\0", L"json", path, MAX_PATH)) return;
+
+    char file[MAX_PATH];
+    wcstombs_s(NULL, file, sizeof(file), path, _TRUNCATE);
+    if (post_start_timeline_command(file, frames))
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Recording timeline");
 }
 
 bool CtrlPressed = false;
@@ -661,7 +992,24 @@ static LRESULT nes_dbg_proc(HANDLE hwnd,UINT msg,WPARAM wparam, LPARAM lparam)
     {
         switch (LOWORD(wparam))
         {
-        case ID_RESET: reset_nes(); refresh_view(); break;
+        case ID_RESET: post_emulation_command(EMU_CMD_RESET); break;
+        case ID_TRACE_START: on_start_trace(hwnd); break;
+        case ID_TRACE_STOP:
+            post_emulation_command(EMU_CMD_STOP_TRACE);
+            SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"CPU trace stopped");
+            break;
+        case ID_PROFILE_START:
+            post_emulation_command(EMU_CMD_START_PROFILE);
+            SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Profiling CPU");
+            break;
+        case ID_PROFILE_STOP: on_stop_profile(hwnd); break;
+        case ID_TIMELINE_FRAME: on_start_timeline(hwnd, 1); break;
+        case ID_TIMELINE_START: on_start_timeline(hwnd, 0); break;
+        case ID_TIMELINE_STOP:
+            post_emulation_command(EMU_CMD_STOP_TIMELINE);
+            SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)L"Timeline stopped");
+            break;
+        case ID_JIT: toggle_jit(); break;
         case ID_FILE_OPEN: on_open_rom(hwnd); break;
         case ID_FILE_EXIT: DestroyWindow(hwnd); break;
 
@@ -671,12 +1019,11 @@ static LRESULT nes_dbg_proc(HANDLE hwnd,UINT msg,WPARAM wparam, LPARAM lparam)
             {
                 SetWindowTextW(g_btnRun, L"Stop [C]");
                 SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"Running");
-                set_emulator_running(true);
+                post_emulation_command(EMU_CMD_RUN);
             }else if(is_emulator_running()) {
                 SetWindowTextW(g_btnRun, L"Continue [C]");
                 SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"Stopped");
-                set_emulator_running(false);
-                refresh_view();
+                post_emulation_command(EMU_CMD_PAUSE);
             }
             break;
         }
@@ -684,22 +1031,32 @@ static LRESULT nes_dbg_proc(HANDLE hwnd,UINT msg,WPARAM wparam, LPARAM lparam)
         {
             if (!is_emulator_running())
             {
-                wait_till_cpu_cycle();
-                nes_clock();
-                while (get_cycles() != 0) nes_clock();
-                refresh_view();
+                post_emulation_command(EMU_CMD_STEP);
             }
             break;
         }
         case ID_BTN_REFRESH: refresh_view(); break;
+        case ID_BTN_BREAK: on_toggle_breakpoint(); break;
+        case ID_BTN_CLEAR_BREAKS: clear_breakpoints(); update_breakpoint_status(); break;
+        case ID_BTN_WATCH: on_toggle_watchpoint(); break;
+        case ID_SPEED_1X:
+        case ID_SPEED_2X:
+        case ID_SPEED_4X:
+        case ID_SPEED_8X:
+        case ID_SPEED_UNCAPPED:
+            select_speed(LOWORD(wparam));
+            break;
         case ID_RAM:
         case ID_NAMETABLE0:
         case ID_NAMETABLE1:
         case ID_NAMETABLE2:
         case ID_NAMETABLE3:
+        case ID_WATCH_LOG:
         {
             clearChecks();
             CheckMenuItem(g_hview, LOWORD(wparam), MF_BYCOMMAND | MF_CHECKED);
+            if ((memory_view_type == WatchLog) != (LOWORD(wparam) == ID_WATCH_LOG))
+                set_memory_columns(LOWORD(wparam) == ID_WATCH_LOG);
             memory_view_type = LOWORD(wparam);
             refresh_view();
             break;
@@ -731,7 +1088,9 @@ static HMENU create_menu_bar(void)
     HMENU hMenuBar = CreateMenu();
     HMENU hFile = CreatePopupMenu();
     HMENU hEmulation = CreatePopupMenu();
+    g_hemulation = hEmulation;
     g_hview = CreatePopupMenu();
+    g_hspeed = CreatePopupMenu();
 
     AppendMenu(hFile, MF_STRING, ID_FILE_OPEN, L"&Open ROM...\tCtrl+O");
     AppendMenu(hFile, MF_SEPARATOR, 0, NULL);
@@ -739,11 +1098,36 @@ static HMENU create_menu_bar(void)
 
     AppendMenu(hEmulation, MF_STRING, ID_RESET, L"&Reset Emulation\tCtrl+1");
 
+    AppendMenu(g_hspeed, MF_STRING, ID_SPEED_1X, L"&1x (Real Time)");
+    AppendMenu(g_hspeed, MF_STRING, ID_SPEED_2X, L"&2x");
+    AppendMenu(g_hspeed, MF_STRING, ID_SPEED_4X, L"&4x");
+    AppendMenu(g_hspeed, MF_STRING, ID_SPEED_8X, L"&8x");
+    AppendMenu(g_hspeed, MF_STRING, ID_SPEED_UNCAPPED, L"&Uncapped");
+    CheckMenuItem(g_hspeed, ID_SPEED_1X, MF_BYCOMMAND | MF_CHECKED);
+    AppendMenu(hEmulation, MF_POPUP, (UINT_PTR)g_hspeed, L"&Speed");
+#if defined(_M_X64)
+    AppendMenu(hEmulation, MF_STRING, ID_JIT, L"Experimental &JIT (x64)");
+#else
+    AppendMenu(hEmulation, MF_STRING | MF_GRAYED, ID_JIT, L"Experimental &JIT (x64)");
+#endif
+    AppendMenu(hEmulation, MF_SEPARATOR, 0, NULL);
+    AppendMenu(hEmulation, MF_STRING, ID_TRACE_START, L"Record CPU &Trace...");
+    AppendMenu(hEmulation, MF_STRING, ID_TRACE_STOP, L"St&op CPU Trace");
+    AppendMenu(hEmulation, MF_SEPARATOR, 0, NULL);
+    AppendMenu(hEmulation, MF_STRING, ID_PROFILE_START, L"Start CPU &Profile");
+    AppendMenu(hEmulation, MF_STRING, ID_PROFILE_STOP, L"Stop CPU Profile and Sa&ve...");
+    AppendMenu(hEmulation, MF_SEPARATOR, 0, NULL);
+    AppendMenu(hEmulation, MF_STRING, ID_TIMELINE_FRAME, L"Record Timeline of &Next Frame...");
+    AppendMenu(hEmulation, MF_STRING, ID_TIMELINE_START, L"Record T&imeline...");
+    AppendMenu(hEmulation, MF_STRING, ID_TIMELINE_STOP, L"Stop Timeline");
+
     AppendMenu(g_hview, MF_STRING, ID_RAM, L"&Ram");
     AppendMenu(g_hview, MF_STRING, ID_NAMETABLE0, L"&Pyhsical Nametable 0");
     AppendMenu(g_hview, MF_STRING, ID_NAMETABLE1, L"&Pyhsical Nametable 1");
     AppendMenu(g_hview, MF_STRING, ID_NAMETABLE2, L"&Logical Nametable 0");
     AppendMenu(g_hview, MF_STRING, ID_NAMETABLE3, L"&Logical Nametable 1");
+    AppendMenu(g_hview, MF_SEPARATOR, 0, NULL);
+    AppendMenu(g_hview, MF_STRING, ID_WATCH_LOG, L"&Watch Log");
 
     memory_view_type = RAM;
     CheckMenuItem(g_hview, ID_RAM, MF_BYCOMMAND | MF_CHECKED);
@@ -786,16 +1170,21 @@ static LRESULT nes_proc(HANDLE hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
     return DefWindowProcW(hwnd, msg, wparam, lparam);
 }
 
-static LARGE_INTEGER fps_freq;
-static LARGE_INTEGER fps_last;
+//presented frames are timed from one new frame to the next, the fps shown is still averaged over a second
+#define FPS_SAMPLE_NS 1000000000ull
+
+static uint64_t fps_last = 0;
+static uint64_t last_new_frame = 0;
 static int fps_frames = 0;
 static float fps_value = 0.0f;
 static double last_present_time = 0.0;
 
+static Frame_time_histogram present_times;
+static Frame_time_histogram total_times;
+
 static void fps_init()
 {
-    QueryPerformanceFrequency(&fps_freq);
-    QueryPerformanceCounter(&fps_last);
+    fps_last = platform_now_ns();
 }
 
 bool create_windows()
@@ -864,48 +1253,93 @@ bool create_windows()
 
 void send_break()
 {
-    if (is_emulator_running())
+    static const wchar_t* reasons[] = { L"", L"exec", L"read", L"", L"write" };
+
+    wchar_t text[64];
+    swprintf(text, 64, L"Break (%s $%04X)", reasons[breakpoint_reason], breakpoint_address);
+
+    //conditional breakpoints also report how often they were checked and what that cost
+    Breakpoint_stats stats[MAX_CONDITIONAL_BREAKPOINTS];
+    int count = get_breakpoint_stats(stats, MAX_CONDITIONAL_BREAKPOINTS);
+    for (int i = 0; i < count; i++)
+    {
+        if (stats[i].addr != breakpoint_address) continue;
+
+        wchar_t detail[160];
+        swprintf(detail, 160, L"%hs: %llu hits / %llu evals, %.0f ns/eval",
+            stats[i].expression, stats[i].hits, stats[i].evaluations, stats[i].average_ns);
+        SendMessageW(g_status, SB_SETTEXTW, 2, (LPARAM)detail);
+    }
+
+    SetWindowTextW(g_btnRun, L"Continue [C]");
+    SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)text);
+    refresh_view();
+}
+
+//reacts to whatever the emulation thread reported since the last loop
+static void handle_emulation_events()
+{
+    int events = take_emulation_events();
+
+    if (events & EMU_EVENT_BREAK)
+    {
+        send_break();
+    }
+    else if (events & EMU_EVENT_STOPPED)
     {
-        set_emulator_running(false);
-        SetWindowTextW(g_btnRun, L"Continue [C]");
-        SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"Stopped");
         refresh_view();
     }
+
+    if (events & EMU_EVENT_ROM_FAILED)
+    {
+        SendMessageW(g_status, SB_SETTEXTW, 0, (LPARAM)L"ROM failed to load");
+    }
+}
+
+static void show_frame_times()
+{
+    char total[64], emulation[64], present[64];
+    format_frame_times(&total_times, total, sizeof(total));
+    format_frame_times(get_emulation_frame_times(), emulation, sizeof(emulation));
+    format_frame_times(&present_times, present, sizeof(present));
+
+    wchar_t text[256];
+    swprintf(text, 256, L"frame %hs | emu p99 %.2f | present p99 %.2f",
+        total, frame_time_percentile(get_emulation_frame_times(), 99.0) / 1e6,
+        frame_time_percentile(&present_times, 99.0) / 1e6);
+    SendMessageW(g_status, SB_SETTEXTW, 3, (LPARAM)text);
 }
 
 static void fps_on_frame()
 {
-    LARGE_INTEGER now;
-    QueryPerformanceCounter(&now);
+    uint64_t now = platform_now_ns();
 
+    //the first frame after a pause would count the whole pause
+    if (last_new_frame != 0 && now - last_new_frame < FPS_SAMPLE_NS)
+    {
+        frame_time_record(&total_times, now - last_new_frame);
+    }
+    last_new_frame = now;
     fps_frames++;
 
-    double elapsed =
-        (double)(now.QuadPart - fps_last.QuadPart) /
-        (double)fps_freq.QuadPart;
-
-    if (elapsed >= 1.0)
+    if (now - fps_last >= FPS_SAMPLE_NS)
     {
-        fps_value = (float)(fps_frames / elapsed);
+        fps_value = (float)(fps_frames * 1e9 / (double)(now - fps_last));
         fps_frames = 0;
         fps_last = now;
+        show_frame_times();
     }
 }
 
-double now_seconds()
+void dump_frame_times()
 {
-    static LARGE_INTEGER freq;
-    static int init = 0;
-
-    if (!init)
-    {
-        QueryPerformanceFrequency(&freq);
-        init = 1;
-    }
-
-    LARGE_INTEGER t;
-    QueryPerformanceCounter(&t);
-    return (double)t.QuadPart / (double)freq.QuadPart;
+    char text[128];
+    format_frame_times(&total_times, text, sizeof(text));
+    log_info("frame times over %llu frames: %s", total_times.count, text);
+    format_frame_times(get_emulation_frame_times(), text, sizeof(text));
+    log_info("emulation times over %llu frames: %s", get_emulation_frame_times()->count, text);
+    format_frame_times(&present_times, text, sizeof(text));
+    log_info("upload/present times over %llu presents: %s", present_times.count, text);
 }
 
 #define TARGET_FPS 60.0
@@ -927,28 +1361,38 @@ int updateWindows()
         }
     }
 
-    if (!is_emulator_running())
-    {
-        update_window_graphics();
-    }
-    else if(is_emulator_running()){
-        if (is_frame_complete())
-        {
-            double now = now_seconds();
-            double elapsed = now - last_present_time;
+    handle_emulation_events();
 
-            if (elapsed >= FRAME_TIME)
-            {
-                update_window_graphics();
-                fps_on_frame();
-                last_present_time = now;
-                wchar_t title[128];
-                swprintf(title, 128, L"NES Emulator - %.2f FPS", fps_value);
-                SetWindowTextW(g_hwndDxWnd, title);
-            }
+    //frames are produced by the emulation thread, all that happens here is presenting the latest one
+    double now = platform_now_seconds();
+    double elapsed = now - last_present_time;
 
-            reset_frame_complete();
+    if (elapsed >= FRAME_TIME)
+    {
+        uint64_t present_start = platform_now_ns();
+        bool new_frame = update_window_graphics();
+        last_present_time = now;
+        uint64_t present_ns = platform_now_ns() - present_start;
+        frame_time_record(&present_times, present_ns);
+#ifdef PERF_COUNTERS
+        perf_add_present_time(present_ns / 1e9);
+#endif
+
+        if (new_frame && is_emulator_running())
+        {
+            fps_on_frame();
+            wchar_t title[128];
+            double emulated_fps = get_emulation_fps();
+            swprintf(title, 128, L"NES Emulator - %.2f FPS - %.0f%% speed (%.1f emulated FPS)",
+                fps_value, emulated_fps / TARGET_FPS * 100.0, emulated_fps);
+            SetWindowTextW(g_hwndDxWnd, title);
         }
     }
+    else
+    {
+        //nothing to do until the next present or the next message, don't spin the ui thread
+        DWORD wait_ms = (DWORD)((FRAME_TIME - elapsed) * 1000.0);
+        MsgWaitForMultipleObjects(0, NULL, FALSE, wait_ms, QS_ALLINPUT);
+    }
     return 0;
 }
\ No newline at end of file
@@ -3,4 +3,7 @@
 
 bool create_windows();
 void send_break();
-int updateWindows();
\ No newline at end of file
+int updateWindows();
+
+//logs the frame time percentiles collected this session, called on exit
+void dump_frame_times();
\ No newline at end of file
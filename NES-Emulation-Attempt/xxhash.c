@@ -0,0 +1,103 @@
+#include "xxhash.h"
+#include <string.h>
+
+//straight port of the reference XXH64, reads are done through memcpy so unaligned input is fine
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t value, int amount)
+{
+	return (value << amount) | (value >> (64 - amount));
+}
+
+static uint64_t read64(const uint8_t* p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t read32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t value)
+{
+	acc ^= round64(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t xxhash64(const void* data, size_t length, uint64_t seed)
+{
+	const uint8_t* p = data;
+	const uint8_t* end = p + length;
+	uint64_t hash;
+
+	if (length >= 32)
+	{
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = round64(v1, read64(p)); p += 8;
+			v2 = round64(v2, read64(p)); p += 8;
+			v3 = round64(v3, read64(p)); p += 8;
+			v4 = round64(v4, read64(p)); p += 8;
+		} while (p <= limit);
+
+		hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		hash = merge_round(hash, v1);
+		hash = merge_round(hash, v2);
+		hash = merge_round(hash, v3);
+		hash = merge_round(hash, v4);
+	}
+	else
+	{
+		hash = seed + PRIME64_5;
+	}
+
+	hash += (uint64_t)length;
+
+	while (p + 8 <= end)
+	{
+		hash ^= round64(0, read64(p));
+		hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		hash ^= (uint64_t)read32(p) * PRIME64_1;
+		hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		hash ^= (*p) * PRIME64_5;
+		hash = rotl64(hash, 11) * PRIME64_1;
+		p++;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+//xxHash64, a fast non cryptographic hash used to fingerprint frames and ram
+uint64_t xxhash64(const void* data, size_t length, uint64_t seed);